@@ -22,10 +22,9 @@ $(1)_DEP_FILES := $$(foreach dep,$$($(1)_DEPS),$$($$(dep)_OUTPUT))
 $(1)_LIBS += $$(foreach dep,$$($(1)_DEPS),$$($$(dep)_PUBLIC_LIBS))
 
 $$($(1)_OUTPUT): $$($(1)_OBJECTS) $$($(1)_DEP_FILES)
+	@mkdir -p $$(dir $$@)
 	$(CXX) $(CXXFLAGS) $$($(1)_LDFLAGS) -o $$@ $$^ $$($(1)_LIBS)
 
-all : $$($(1)_OUTPUT)
-
 endef
 
 define build_shlib_inner
@@ -39,6 +38,8 @@ $(1)_LDFLAGS += -shared
 
 $(call build_linked_inner,$(1))
 
+all : $$($(1)_OUTPUT)
+
 endef
 
 build_shlib = $(eval $(call build_shlib_inner,$(1)))
@@ -67,6 +68,26 @@ $(1)_OUTPUT := $(BUILD)/$$($(1)_NAME)
 
 $(call build_linked_inner,$(1))
 
+all : $$($(1)_OUTPUT)
+
 endef
 
 build_exe = $(eval $(call build_exe_inner,$(1)))
+
+# Tests are executables that aren't part of all, but are built and run by the target given as the
+# second argument instead (check for unit tests, perf for perf tests).
+define build_test_inner
+
+$(call build_objects_inner,$(1))
+
+$(1)_NAME ?= $(1)
+$(1)_OUTPUT := $(BUILD)/tests/$$($(1)_NAME)
+
+$(call build_linked_inner,$(1))
+
+$(2) :: $$($(1)_OUTPUT)
+	$$($(1)_OUTPUT)
+
+endef
+
+build_test = $(eval $(call build_test_inner,$(1),$(2)))
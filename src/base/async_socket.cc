@@ -0,0 +1,262 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/async_socket.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+#include "base/debug.h"
+
+namespace zypak {
+
+namespace {
+
+constexpr size_t kReadBufferSize = 64 * 1024;
+
+}  // namespace
+
+class AsyncSocket::OperationScope {
+ public:
+  explicit OperationScope(AsyncSocket* socket) : socket_(socket) {
+    ZYPAK_ASSERT(!socket_->in_operation_, << "Socket " << socket_->fd() << " is already busy");
+    socket_->in_operation_ = true;
+  }
+
+  OperationScope(const OperationScope& other) = delete;
+
+  ~OperationScope() { socket_->in_operation_ = false; }
+
+ private:
+  AsyncSocket* socket_;
+};
+
+AsyncSocket::AsyncSocket(EvLoop* ev, unique_fd fd) : ev_(ev), fd_(std::move(fd)) {}
+
+unique_fd AsyncSocket::TakeFd() {
+  ZYPAK_ASSERT(!in_operation_);
+  read_start_ = read_end_ = 0;
+  read_fds_.clear();
+  return std::move(fd_);
+}
+
+// static
+AsyncSocket::Deadline AsyncSocket::GetDeadline(const OperationOptions& options) {
+  if (options.timeout_ms <= 0) {
+    return {};
+  }
+
+  return Clock::now() + std::chrono::milliseconds(options.timeout_ms);
+}
+
+Task<bool> AsyncSocket::ReadFramed(std::vector<std::byte>* payload, std::vector<unique_fd>* fds,
+                                   FramedReadOptions framed_options /*= {}*/,
+                                   OperationOptions options /*= {}*/) {
+  OperationScope scope(this);
+  Deadline deadline = GetDeadline(options);
+
+  Socket::FrameHeader header;
+  bool ok = co_await ReadExactUntil(reinterpret_cast<std::byte*>(&header), sizeof(header),
+                                    deadline);
+  if (!ok) {
+    co_return false;
+  }
+
+  if (header.payload_size > framed_options.max_payload_size ||
+      header.fd_count > framed_options.max_fds) {
+    errno = EMSGSIZE;
+    co_return false;
+  }
+
+  fds->clear();
+  fds->reserve(header.fd_count);
+  for (size_t remaining = header.fd_count; remaining > 0;) {
+    // Each group of FDs arrives along with its marker byte.
+    std::byte marker;
+    ok = co_await ReadExactUntil(&marker, 1, deadline);
+    if (!ok) {
+      co_return false;
+    }
+
+    if (marker != Socket::kFrameFdChunkMarker) {
+      errno = EPROTO;
+      co_return false;
+    }
+
+    size_t count = std::min(Socket::kMaxFdsPerMessage, remaining);
+    ok = co_await ReadFdsUntil(count, fds, deadline);
+    if (!ok) {
+      co_return false;
+    }
+
+    remaining -= count;
+  }
+
+  payload->resize(header.payload_size);
+  ok = co_await ReadExactUntil(payload->data(), payload->size(), deadline);
+  if (!ok) {
+    co_return false;
+  }
+
+  if (!read_fds_.empty()) {
+    // The peer sent more FDs than the header said it would.
+    errno = EPROTO;
+    co_return false;
+  }
+
+  co_return true;
+}
+
+Task<bool> AsyncSocket::WriteAll(const std::byte* buffer, size_t size,
+                                 Socket::WriteOptions write_options /*= {}*/,
+                                 OperationOptions options /*= {}*/) {
+  OperationScope scope(this);
+  Deadline deadline = GetDeadline(options);
+  write_options.nonblocking = true;
+
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t res = Socket::WritePartial(fd_.get(), buffer + sent, size - sent, write_options);
+    if (res == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        co_return false;
+      }
+
+      bool ready = co_await WaitFor(EvLoop::Events::Status::kWrite, deadline);
+      if (!ready) {
+        co_return false;
+      }
+
+      continue;
+    }
+
+    // Any FDs went out with the first chunk.
+    write_options.fds = nullptr;
+    sent += res;
+  }
+
+  co_return true;
+}
+
+Task<bool> AsyncSocket::ReadExactUntil(std::byte* buffer, size_t size, Deadline deadline) {
+  size_t received = 0;
+  while (received < size) {
+    if (buffered() > 0) {
+      size_t count = std::min(buffered(), size - received);
+      std::copy_n(read_buffer_.get() + read_start_, count, buffer + received);
+      received += count;
+
+      read_start_ += count;
+      if (read_start_ == read_end_) {
+        read_start_ = read_end_ = 0;
+      }
+
+      continue;
+    }
+
+    // Read straight into the destination, never past the end of it, so that anything after (e.g.
+    // the payload following a frame header) doesn't need to be copied out of the buffer later.
+    ssize_t res = co_await ReadSome(buffer + received, size - received, deadline);
+    if (res == -1) {
+      co_return false;
+    }
+
+    received += res;
+  }
+
+  co_return true;
+}
+
+Task<bool> AsyncSocket::ReadFdsUntil(size_t count, std::vector<unique_fd>* fds,
+                                     Deadline deadline) {
+  while (read_fds_.size() < count) {
+    bool ok = co_await Fill(deadline);
+    if (!ok) {
+      co_return false;
+    }
+  }
+
+  fds->insert(fds->end(), std::make_move_iterator(read_fds_.begin()),
+              std::make_move_iterator(read_fds_.begin() + count));
+  read_fds_.erase(read_fds_.begin(), read_fds_.begin() + count);
+  co_return true;
+}
+
+Task<ssize_t> AsyncSocket::ReadSome(std::byte* target, size_t size, Deadline deadline) {
+  Socket::ReadOptions options;
+  options.fds = &read_fds_;
+  options.max_fds = Socket::kMaxFdsPerMessage;
+  options.nonblocking = true;
+
+  for (;;) {
+    ssize_t res = Socket::Read(fd_.get(), target, size, options);
+    if (res > 0) {
+      co_return res;
+    } else if (res == 0) {
+      errno = ECONNRESET;
+      co_return -1;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      co_return -1;
+    }
+
+    bool ready = co_await WaitFor(EvLoop::Events::Status::kRead, deadline);
+    if (!ready) {
+      co_return -1;
+    }
+  }
+}
+
+Task<bool> AsyncSocket::Fill(Deadline deadline) {
+  if (!read_buffer_) {
+    read_buffer_ = std::make_unique<std::byte[]>(kReadBufferSize);
+  }
+
+  if (read_start_ > 0) {
+    std::memmove(read_buffer_.get(), read_buffer_.get() + read_start_, buffered());
+    read_end_ -= read_start_;
+    read_start_ = 0;
+  }
+
+  if (read_end_ == kReadBufferSize) {
+    errno = ENOBUFS;
+    co_return false;
+  }
+
+  ssize_t res = co_await ReadSome(read_buffer_.get() + read_end_, kReadBufferSize - read_end_,
+                                  deadline);
+  if (res == -1) {
+    co_return false;
+  }
+
+  read_end_ += res;
+  co_return true;
+}
+
+Task<bool> AsyncSocket::WaitFor(EvLoop::Events events, Deadline deadline) {
+  int timeout_ms = 0;
+  if (deadline) {
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(*deadline - Clock::now());
+    if (remaining.count() <= 0) {
+      errno = ETIMEDOUT;
+      co_return false;
+    }
+
+    timeout_ms = remaining.count();
+  }
+
+  std::optional<EvLoop::Events> result =
+      co_await ev_->AwaitFd(fd_.get(), events, EvLoop::Priority::kDefault, timeout_ms);
+  if (result && result->empty()) {
+    errno = ETIMEDOUT;
+    co_return false;
+  }
+
+  // If the fd was closed, there may still be data left to read, so leave it to the next read or
+  // write to find out what happened.
+  co_return true;
+}
+
+}  // namespace zypak
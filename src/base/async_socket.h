@@ -0,0 +1,105 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "base/base.h"
+#include "base/coroutine.h"
+#include "base/evloop.h"
+#include "base/socket.h"
+#include "base/unique_fd.h"
+
+namespace zypak {
+
+// A socket whose reads and writes wait on an event loop instead of blocking the calling thread.
+// Reads of a known size go straight into their destination, without ever reading past it, so each
+// byte is only copied once, by the kernel. Any FDs received along the way are queued up in the
+// order they arrived, and data is only buffered when more has to be read to find them.
+// Only one operation, read or write, may be in progress at once: each one waits on the loop with
+// its own io source, and the loop won't watch the same fd twice. The socket must not be moved or
+// destroyed while an operation is in progress.
+class AsyncSocket {
+ public:
+  AsyncSocket(EvLoop* ev, unique_fd fd);
+  AsyncSocket(const AsyncSocket& other) = delete;
+  AsyncSocket(AsyncSocket&& other) = default;
+
+  int fd() const { return fd_.get(); }
+
+  // Takes back ownership of the underlying fd. Anything left unread in the buffer is discarded.
+  unique_fd TakeFd();
+
+  struct OperationOptions {
+    OperationOptions() {}
+
+    // If positive, the operation fails with ETIMEDOUT if it hasn't completed after this long.
+    int timeout_ms = 0;
+  };
+
+  // All of the below return false on failure with errno set. If the peer closes the socket before
+  // an operation completes, it fails with ECONNRESET. Starting one while another is still in
+  // progress is a fatal error.
+
+  struct FramedReadOptions {
+    FramedReadOptions() {}
+
+    // Frames whose header claims more than this are rejected with EMSGSIZE, rather than trusting
+    // the peer to send a sane amount of data.
+    size_t max_payload_size = 16 * 1024 * 1024;
+    size_t max_fds = 64 * 1024;
+  };
+
+  // Reads an entire frame sent via Socket::WriteFramed.
+  Task<bool> ReadFramed(std::vector<std::byte>* payload, std::vector<unique_fd>* fds,
+                        FramedReadOptions framed_options = {}, OperationOptions options = {});
+
+  // Writes the entire buffer, sending any FDs along with the first byte.
+  Task<bool> WriteAll(const std::byte* buffer, size_t size,
+                      Socket::WriteOptions write_options = {}, OperationOptions options = {});
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  using Deadline = std::optional<Clock::time_point>;
+
+  // Marks an operation as in progress for as long as it's alive.
+  class OperationScope;
+
+  static Deadline GetDeadline(const OperationOptions& options);
+
+  size_t buffered() const { return read_end_ - read_start_; }
+
+  // These all take a deadline, so that an operation built out of several others shares one
+  // deadline between all of them.
+  // Reads exactly the given # of bytes.
+  Task<bool> ReadExactUntil(std::byte* buffer, size_t size, Deadline deadline);
+  // Takes the given # of received FDs, in the order they were sent, reading more data to find them
+  // if needed.
+  Task<bool> ReadFdsUntil(size_t count, std::vector<unique_fd>* fds, Deadline deadline);
+  // Reads whatever is available into the target (waiting if nothing is), returning the # of bytes
+  // read, or -1 on error. Any FDs received are queued in read_fds_.
+  Task<ssize_t> ReadSome(std::byte* target, size_t size, Deadline deadline);
+  // Reads more data into the buffer.
+  Task<bool> Fill(Deadline deadline);
+  Task<bool> WaitFor(EvLoop::Events events, Deadline deadline);
+
+  EvLoop* ev_;
+  unique_fd fd_;
+
+  // Allocated the first time something needs to be buffered; read_start_ and read_end_ mark the
+  // range that's been received but not consumed yet.
+  std::unique_ptr<std::byte[]> read_buffer_;
+  size_t read_start_ = 0;
+  size_t read_end_ = 0;
+
+  std::vector<unique_fd> read_fds_;
+
+  bool in_operation_ = false;
+};
+
+}  // namespace zypak
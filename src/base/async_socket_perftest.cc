@@ -0,0 +1,148 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Counts the allocations made while reading a spawn request the way the supervisor does: two frames
+// via AsyncSocket::ReadFramed, followed by splitting the command line into views of the received
+// payload.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "base/async_socket.h"
+#include "base/cstring_view.h"
+#include "base/debug.h"
+#include "base/evloop.h"
+#include "base/socket.h"
+#include "base/unique_fd.h"
+
+using namespace zypak;
+
+namespace {
+
+constexpr int kRequests = 1000;
+
+// Roughly the size of a renderer's command line.
+constexpr size_t kArgCount = 48;
+constexpr size_t kArgSize = 96;
+// Stubs forward their stdio.
+constexpr size_t kFdCount = 3;
+
+// The size of AsyncSocket's read buffer, which should never be needed to read a request.
+constexpr size_t kReadBufferSize = 64 * 1024;
+
+// Only touched from the main thread.
+bool counting = false;
+size_t allocations = 0;
+size_t allocated_bytes = 0;
+
+Task<> ReadRequest(EvLoop* ev, unique_fd fd, bool* ok) {
+  AsyncSocket socket(ev, std::move(fd));
+  std::vector<std::byte> header;
+  std::vector<unique_fd> fds;
+  std::vector<std::byte> args_block;
+  std::vector<unique_fd> no_fds;
+
+  *ok = co_await socket.ReadFramed(&header, &fds);
+  if (*ok) {
+    AsyncSocket::FramedReadOptions args_framed_options;
+    args_framed_options.max_fds = 0;
+    *ok = co_await socket.ReadFramed(&args_block, &no_fds, args_framed_options);
+  }
+
+  if (!*ok || fds.size() != kFdCount || args_block.empty() || args_block.back() != std::byte{0}) {
+    *ok = false;
+    co_return;
+  }
+
+  std::vector<cstring_view> argv;
+  argv.reserve(kArgCount);
+  const char* args_end = reinterpret_cast<const char*>(args_block.data()) + args_block.size();
+  for (const char* arg = reinterpret_cast<const char*>(args_block.data()); arg != args_end;) {
+    cstring_view view(arg);
+    argv.push_back(view);
+    arg += view.size() + 1;
+  }
+
+  *ok = argv.size() == kArgCount;
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+  if (counting) {
+    allocations++;
+    allocated_bytes += size;
+  }
+
+  if (void* ptr = std::malloc(size)) {
+    return ptr;
+  }
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t size) noexcept { std::free(ptr); }
+
+int main() {
+  DebugContext::instance()->set_name("async_socket_perftest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  std::optional<EvLoop> ev = EvLoop::Create();
+  ZYPAK_ASSERT(ev);
+
+  std::vector<std::byte> header(sizeof(std::uint64_t) + kFdCount * sizeof(std::uint32_t));
+  std::vector<std::byte> args_block;
+  for (size_t i = 0; i < kArgCount; i++) {
+    std::string arg = "--arg-" + std::to_string(i) + "=";
+    arg.resize(kArgSize - 1, 'x');
+
+    const std::byte* data = reinterpret_cast<const std::byte*>(arg.c_str());
+    args_block.insert(args_block.end(), data, data + arg.size() + 1);
+  }
+
+  std::vector<int> fds;
+  for (size_t i = 0; i < kFdCount; i++) {
+    fds.push_back(static_cast<int>(i));
+  }
+
+  size_t total_allocations = 0;
+  size_t total_bytes = 0;
+  size_t max_bytes = 0;
+
+  for (int i = 0; i < kRequests; i++) {
+    auto pair = Socket::OpenSocketPair();
+    ZYPAK_ASSERT(pair);
+    auto [our_end, their_end] = std::move(*pair);
+
+    // The whole request fits in the socket's buffer, so the read never has to wait on the loop,
+    // and the task finishes as soon as it's started.
+    ZYPAK_ASSERT(Socket::WriteFramed(their_end.get(), header, fds));
+    ZYPAK_ASSERT(Socket::WriteFramed(their_end.get(), args_block, {}));
+
+    bool ok = false;
+    allocations = allocated_bytes = 0;
+    counting = true;
+    ReadRequest(&*ev, std::move(our_end), &ok).Detach();
+    counting = false;
+
+    ZYPAK_ASSERT(ok, << "request #" << i << " failed");
+
+    total_allocations += allocations;
+    total_bytes += allocated_bytes;
+    max_bytes = std::max(max_bytes, allocated_bytes);
+  }
+
+  // Anything that went through the read buffer would have allocated it.
+  ZYPAK_ASSERT(max_bytes < kReadBufferSize, << "up to " << max_bytes << " bytes allocated");
+
+  Log() << "Per request of " << args_block.size() << " command line bytes: "
+        << static_cast<double>(total_allocations) / kRequests << " allocations, "
+        << static_cast<double>(total_bytes) / kRequests << " bytes allocated";
+  return 0;
+}
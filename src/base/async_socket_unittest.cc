@@ -0,0 +1,216 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/async_socket.h"
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "base/debug.h"
+#include "base/evloop.h"
+#include "base/socket.h"
+#include "base/unique_fd.h"
+
+using namespace zypak;
+
+namespace {
+
+// Both well past what fits in a single message: the FDs take three chunks of kMaxFdsPerMessage, and
+// the payload (about the size of a huge command line) takes over 20 chunks and doesn't fit in the
+// socket's buffer, so the writer has to wait on the reader.
+constexpr size_t kLargeFdCount = 600;
+constexpr size_t kLargePayloadSize = 700 * 1024;
+// Room for the FDs the test needs besides the ones being sent.
+constexpr size_t kSpareFds = 64;
+
+struct ReadResult {
+  bool done = false;
+  bool ok = false;
+  int error = 0;
+  std::vector<std::byte> payload;
+  std::vector<unique_fd> fds;
+};
+
+Task<> ReadFrames(AsyncSocket* socket, std::vector<ReadResult>* results,
+                  AsyncSocket::FramedReadOptions framed_options) {
+  for (ReadResult& result : *results) {
+    bool ok = co_await socket->ReadFramed(&result.payload, &result.fds, framed_options);
+    result.ok = ok;
+    result.error = errno;
+    result.done = true;
+  }
+}
+
+// Reads the given # of frames on an event loop, while writer runs on another thread.
+std::vector<ReadResult> ReadFramesWhile(int fd, size_t count, std::function<void()> writer,
+                                        AsyncSocket::FramedReadOptions framed_options = {}) {
+  std::optional<EvLoop> ev = EvLoop::Create();
+  ZYPAK_ASSERT(ev);
+
+  AsyncSocket socket(&*ev, unique_fd(dup(fd)));
+  std::vector<ReadResult> results(count);
+
+  std::thread writer_thread(std::move(writer));
+  ReadFrames(&socket, &results, framed_options).Detach();
+
+  while (!results.back().done) {
+    ZYPAK_ASSERT(ev->Wait() == EvLoop::WaitResult::kReady);
+    ZYPAK_ASSERT(ev->Dispatch() == EvLoop::DispatchResult::kContinue);
+  }
+
+  writer_thread.join();
+  return results;
+}
+
+std::vector<std::byte> BuildPayload(size_t size) {
+  std::vector<std::byte> payload(size);
+  for (size_t i = 0; i < size; i++) {
+    payload[i] = static_cast<std::byte>(i * 31 % 251);
+  }
+
+  return payload;
+}
+
+// Each FD is a memfd holding its own index, so the receiver can tell they arrived in order.
+std::vector<unique_fd> OpenIndexedFds(size_t count) {
+  std::vector<unique_fd> fds;
+  for (size_t i = 0; i < count; i++) {
+    unique_fd fd(memfd_create("zypak-framed-test", MFD_CLOEXEC));
+    ZYPAK_ASSERT_WITH_ERRNO(!fd.invalid());
+
+    std::uint32_t index = i;
+    ZYPAK_ASSERT_WITH_ERRNO(write(fd.get(), &index, sizeof(index)) == sizeof(index));
+    fds.push_back(std::move(fd));
+  }
+
+  return fds;
+}
+
+std::vector<int> RawFds(const std::vector<unique_fd>& fds) {
+  std::vector<int> raw;
+  for (const unique_fd& fd : fds) {
+    raw.push_back(fd.get());
+  }
+
+  return raw;
+}
+
+void AssertIndexedFds(const std::vector<unique_fd>& fds, size_t count) {
+  ZYPAK_ASSERT(fds.size() == count, << fds.size() << " FDs received");
+  for (size_t i = 0; i < count; i++) {
+    std::uint32_t index;
+    ZYPAK_ASSERT_WITH_ERRNO(pread(fds[i].get(), &index, sizeof(index), 0) == sizeof(index));
+    ZYPAK_ASSERT(index == i, << "FD #" << i << " holds " << index);
+  }
+}
+
+// Both ends of the transfer hold their copy of every FD at once, which can go past the default soft
+// limit, so this raises it as far as allowed, returning false if that's still not enough.
+bool RaiseFdLimit() {
+  struct rlimit limit;
+  ZYPAK_ASSERT_WITH_ERRNO(getrlimit(RLIMIT_NOFILE, &limit) != -1);
+  limit.rlim_cur = limit.rlim_max;
+  ZYPAK_ASSERT_WITH_ERRNO(setrlimit(RLIMIT_NOFILE, &limit) != -1);
+  return limit.rlim_cur >= kLargeFdCount * 2 + kSpareFds;
+}
+
+void TestLargeFrame() {
+  if (!RaiseFdLimit()) {
+    Log() << "Skipping the large frame, the FD limit is too low to hold " << kLargeFdCount * 2
+          << " FDs";
+    return;
+  }
+
+  auto pair = Socket::OpenSocketPair();
+  ZYPAK_ASSERT(pair);
+  auto [reader_end, writer_end] = std::move(*pair);
+
+  std::vector<std::byte> payload = BuildPayload(kLargePayloadSize);
+  std::vector<unique_fd> fds = OpenIndexedFds(kLargeFdCount);
+  std::vector<unique_fd> trailing_fds = OpenIndexedFds(1);
+  std::vector<std::byte> trailing_payload = BuildPayload(16);
+
+  std::vector<ReadResult> results = ReadFramesWhile(reader_end.get(), 2, [&]() {
+    ZYPAK_ASSERT(Socket::WriteFramed(writer_end.get(), payload, RawFds(fds)));
+    // The next frame has to pick up right where the last one ended.
+    ZYPAK_ASSERT(Socket::WriteFramed(writer_end.get(), trailing_payload, RawFds(trailing_fds)));
+  });
+
+  ZYPAK_ASSERT(results[0].ok, << "errno " << results[0].error);
+  ZYPAK_ASSERT(results[0].payload == payload);
+  AssertIndexedFds(results[0].fds, kLargeFdCount);
+
+  ZYPAK_ASSERT(results[1].ok, << "errno " << results[1].error);
+  ZYPAK_ASSERT(results[1].payload == trailing_payload);
+  AssertIndexedFds(results[1].fds, 1);
+}
+
+void TestLimits() {
+  std::vector<unique_fd> fds = OpenIndexedFds(4);
+  std::vector<std::byte> payload = BuildPayload(1024);
+
+  AsyncSocket::FramedReadOptions few_fds;
+  few_fds.max_fds = fds.size() - 1;
+  AsyncSocket::FramedReadOptions small_payload;
+  small_payload.max_payload_size = payload.size() - 1;
+
+  for (const auto& options : {few_fds, small_payload}) {
+    auto pair = Socket::OpenSocketPair();
+    ZYPAK_ASSERT(pair);
+    auto [reader_end, writer_end] = std::move(*pair);
+
+    std::vector<ReadResult> results = ReadFramesWhile(
+        reader_end.get(), 1,
+        [&]() {
+          // The reader gives up after the header, so the rest may never be read; give the writer
+          // room to send it all anyway.
+          int size = kLargePayloadSize;
+          ZYPAK_ASSERT_WITH_ERRNO(
+              setsockopt(writer_end.get(), SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) != -1);
+          ZYPAK_ASSERT(Socket::WriteFramed(writer_end.get(), payload, RawFds(fds)));
+        },
+        options);
+
+    ZYPAK_ASSERT(!results[0].ok);
+    ZYPAK_ASSERT(results[0].error == EMSGSIZE, << "errno " << results[0].error);
+  }
+}
+
+// The peer going away partway through a frame fails the read, instead of leaving it waiting.
+void TestTruncatedFrame() {
+  auto pair = Socket::OpenSocketPair();
+  ZYPAK_ASSERT(pair);
+  auto [reader_end, writer_end] = std::move(*pair);
+
+  std::vector<ReadResult> results = ReadFramesWhile(reader_end.get(), 1, [&]() {
+    Socket::FrameHeader header{.payload_size = kLargePayloadSize, .fd_count = 0};
+    ZYPAK_ASSERT_WITH_ERRNO(write(writer_end.get(), &header, sizeof(header)) == sizeof(header));
+    writer_end.reset();
+  });
+
+  ZYPAK_ASSERT(!results[0].ok);
+  ZYPAK_ASSERT(results[0].error == ECONNRESET, << "errno " << results[0].error);
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("async_socket_unittest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  TestLargeFrame();
+  TestLimits();
+  TestTruncatedFrame();
+
+  Log() << "All tests passed";
+  return 0;
+}
@@ -0,0 +1,158 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+#include "base/base.h"
+#include "base/debug.h"
+
+namespace zypak {
+
+template <typename T = void>
+class Task;
+
+namespace coroutine_internal {
+
+class PromiseBase {
+ public:
+  // Tasks are lazy, they don't run until they're either awaited or detached.
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      PromiseBase& promise = handle.promise();
+      if (promise.continuation_) {
+        return promise.continuation_;
+      }
+
+      // Nothing is waiting on a detached task, so it has to clean up after itself.
+      if (promise.detached_) {
+        handle.destroy();
+      }
+
+      return std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() { std::terminate(); }
+
+ private:
+  std::coroutine_handle<> continuation_;
+  bool detached_ = false;
+
+  template <typename T>
+  friend class ::zypak::Task;
+};
+
+template <typename T>
+class Promise : public PromiseBase {
+ public:
+  Task<T> get_return_object();
+
+  void return_value(T value) { value_.emplace(std::move(value)); }
+  T TakeValue() {
+    ZYPAK_ASSERT(value_.has_value());
+    return std::move(*value_);
+  }
+
+ private:
+  std::optional<T> value_;
+};
+
+template <>
+class Promise<void> : public PromiseBase {
+ public:
+  Task<void> get_return_object();
+
+  void return_void() {}
+  void TakeValue() {}
+};
+
+}  // namespace coroutine_internal
+
+// A coroutine that can be awaited from other coroutines, resulting in a value of type T. There is
+// no scheduler here: a task runs on whatever thread resumes it, which is usually the one running
+// the EvLoop whose callback completed the task's current await. A task that isn't awaited by
+// another coroutine must be detached to be started.
+// NOTE: GCC 12 (seen with 12.2.0, at both -O0 and -O2) can miscompile a co_await written directly
+// in an if condition when the awaited operation really suspends: depending on the surrounding code,
+// the coroutine either never starts running or crashes once it's resumed. Awaits that complete
+// synchronously aren't affected, which makes it easy to miss. Always store the result in a local
+// first; coroutine_unittest.cc runs that form across real suspensions.
+template <typename T>
+class [[nodiscard]] Task {
+ public:
+  using promise_type = coroutine_internal::Promise<T>;
+
+  Task(const Task& other) = delete;
+  Task(Task&& other) : handle_(std::exchange(other.handle_, nullptr)) {}
+
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  // Starts running the task without waiting for its result. The task will destroy itself once
+  // complete.
+  void Detach() && {
+    ZYPAK_ASSERT(handle_);
+
+    std::coroutine_handle<promise_type> handle = std::exchange(handle_, nullptr);
+    handle.promise().detached_ = true;
+    handle.resume();
+  }
+
+  auto operator co_await() && {
+    struct Awaiter {
+      std::coroutine_handle<promise_type> handle;
+
+      bool await_ready() { return false; }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+        handle.promise().continuation_ = awaiting;
+        return handle;
+      }
+
+      T await_resume() { return handle.promise().TakeValue(); }
+    };
+
+    ZYPAK_ASSERT(handle_);
+    return Awaiter{handle_};
+  }
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+
+  friend promise_type;
+};
+
+namespace coroutine_internal {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+  return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+}  // namespace coroutine_internal
+
+}  // namespace zypak
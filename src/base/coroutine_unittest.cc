@@ -0,0 +1,124 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/coroutine.h"
+
+#include <coroutine>
+#include <optional>
+#include <vector>
+
+#include "base/debug.h"
+
+using namespace zypak;
+
+namespace {
+
+// Stands in for the EvLoop: awaits always suspend, and are only resumed once the test says so,
+// which is what makes the difference in how GCC 12 compiles awaits inside of conditions.
+class Resumer {
+ public:
+  auto Suspend(bool value) {
+    struct Awaiter {
+      Resumer* resumer;
+      bool value;
+
+      bool await_ready() { return false; }
+      void await_suspend(std::coroutine_handle<> handle) { resumer->pending_.push_back(handle); }
+      bool await_resume() { return value; }
+    };
+
+    return Awaiter{this, value};
+  }
+
+  // Resumes everything that's suspended, including whatever suspends while doing so, returning
+  // how many times a coroutine was resumed.
+  int RunUntilIdle() {
+    int resumed = 0;
+    while (!pending_.empty()) {
+      std::coroutine_handle<> handle = pending_.front();
+      pending_.erase(pending_.begin());
+      handle.resume();
+      resumed++;
+    }
+
+    return resumed;
+  }
+
+ private:
+  std::vector<std::coroutine_handle<>> pending_;
+};
+
+Task<bool> Check(Resumer* resumer, bool value) {
+  bool result = co_await resumer->Suspend(value);
+  co_return result;
+}
+
+Task<std::optional<int>> Count(Resumer* resumer, int limit) {
+  int count = 0;
+  for (;;) {
+    bool more = co_await Check(resumer, count < limit);
+    if (!more) {
+      break;
+    }
+
+    count++;
+  }
+
+  co_return count;
+}
+
+Task<> Run(Resumer* resumer, std::optional<int>* result, bool* finished) {
+  bool failed = co_await Check(resumer, false);
+  if (failed) {
+    co_return;
+  }
+
+  bool ok = co_await Check(resumer, true);
+  if (ok) {
+    *result = co_await Count(resumer, 4);
+  }
+
+  *finished = true;
+}
+
+// A detached task has to run to completion across suspensions, with each await seeing its own
+// result, and free itself afterwards.
+void TestResumeAcrossSuspensions() {
+  Resumer resumer;
+  std::optional<int> result;
+  bool finished = false;
+
+  Run(&resumer, &result, &finished).Detach();
+  ZYPAK_ASSERT(!finished);
+
+  // One resume each for the first two checks, then five for the counting loop.
+  ZYPAK_ASSERT(resumer.RunUntilIdle() == 7);
+  ZYPAK_ASSERT(finished);
+  ZYPAK_ASSERT(result == 4);
+}
+
+// Tasks are lazy, so one that's dropped without being awaited or detached never runs.
+void TestLazy() {
+  Resumer resumer;
+  std::optional<int> result;
+  bool finished = false;
+
+  { Task<> task = Run(&resumer, &result, &finished); }
+
+  ZYPAK_ASSERT(resumer.RunUntilIdle() == 0);
+  ZYPAK_ASSERT(!finished);
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("coroutine_unittest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  TestResumeAcrossSuspensions();
+  TestLazy();
+
+  Log() << "All tests passed";
+  return 0;
+}
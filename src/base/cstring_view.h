@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <functional>
 #include <string>
 #include <string_view>
 
@@ -31,3 +32,6 @@ class cstring_view : public std::string_view {
 };
 
 }  // namespace zypak
+
+template <>
+struct std::hash<zypak::cstring_view> : std::hash<std::string_view> {};
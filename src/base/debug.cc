@@ -17,29 +17,6 @@
 
 namespace zypak {
 
-namespace {
-
-class NullStream : public std::ostream {
- public:
-  NullStream() : std::ostream(&nullbuf_) {}
-
-  static NullStream* instance() { return &instance_; }
-
- private:
-  class NullBuffer : public std::streambuf {
-   public:
-    int overflow(int c) override { return c; }
-  };
-
-  NullBuffer nullbuf_;
-
-  static NullStream instance_;
-};
-
-}  // namespace
-
-NullStream NullStream::instance_;
-
 DebugContext::DebugContext() : enabled_(false), name_("<unset>") {}
 
 void DebugContext::LoadFromEnvironment() {
@@ -68,8 +45,7 @@ debug_internal::LogStream Errno(int value /*= 0*/) {
 }
 
 debug_internal::LogStream Debug() {
-  return DebugContext::instance()->enabled() ? Log()
-                                             : debug_internal::LogStream(NullStream::instance());
+  return DebugContext::instance()->enabled() ? Log() : debug_internal::LogStream();
 }
 
 }  // namespace zypak
@@ -17,6 +17,10 @@ namespace zypak::debug_internal {
 // static
 std::mutex LogStream::lock_;
 
+// A stream without a buffer is permanently in a bad state, so any writes to it are discarded
+// before doing any formatting.
+LogStream::LogStream() : std::ostream(nullptr), errno_save_(-1), os_(nullptr) {}
+
 LogStream::LogStream(std::ostream* os, int errno_save /*= -1*/)
     : LogStream(std::make_unique<std::stringstream>(), os, errno_save) {}
 
@@ -27,6 +31,10 @@ LogStream::LogStream(std::unique_ptr<std::stringstream> ss, std::ostream* os, in
 }
 
 LogStream::~LogStream() {
+  if (!ss_) {
+    return;
+  }
+
   if (errno_save_ != -1) {
     *ss_ << ": " << std::strerror(errno_save_) << " (errno " << errno_save_ << ")";
   }
@@ -14,6 +14,9 @@ namespace zypak::debug_internal {
 
 class LogStream : public std::ostream {
  public:
+  // Creates a disabled stream, which silently drops anything written to it without allocating or
+  // taking the output lock.
+  LogStream();
   LogStream(std::ostream* os, int errno_save = -1);
   ~LogStream();
 
@@ -25,7 +28,7 @@ class LogStream : public std::ostream {
   int errno_save_;
   std::unique_ptr<std::stringstream> ss_;
   std::ostream* os_;
-  std::lock_guard<std::mutex> lock_guard_;
+  std::unique_lock<std::mutex> lock_guard_;
 };
 
 }  // namespace zypak::debug_internal
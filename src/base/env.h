@@ -40,6 +40,8 @@ class Env {
   static constexpr cstring_view kZypakSettingLdPreload = "ZYPAK_LD_PRELOAD";
   static constexpr cstring_view kZypakSettingSpawnLatestOnReexec = "ZYPAK_SPAWN_LATEST_ON_REEXEC";
   static constexpr cstring_view kZypakSettingCefLibraryPath = "ZYPAK_CEF_LIBRARY_PATH";
+  static constexpr cstring_view kZypakSettingWatchdogMs = "ZYPAK_WATCHDOG_MS";
+  static constexpr cstring_view kZypakSettingLockStats = "ZYPAK_LOCK_STATS";
 };
 
 }  // namespace zypak
@@ -6,10 +6,17 @@
 #include "base/evloop.h"
 
 #include <sys/eventfd.h>
-#include <sys/poll.h>
+#include <time.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <limits>
+#include <map>
+#include <vector>
 
 #include <systemd/sd-event.h>
 
@@ -19,19 +26,239 @@
 
 namespace zypak {
 
+// Nearly every source has at most one destroy handler, so the first one is stored inline, and only
+// any further ones are placed in a vector.
+class EvLoop::DestroyHandlerList {
+ public:
+  void Add(DestroyHandler handler) {
+    if (!first_) {
+      first_ = std::move(handler);
+    } else {
+      rest_.push_back(std::move(handler));
+    }
+  }
+
+  void RunAll() {
+    if (first_) {
+      first_();
+    }
+
+    for (DestroyHandler& handler : rest_) {
+      handler();
+    }
+  }
+
+ private:
+  DestroyHandler first_;
+  std::vector<DestroyHandler> rest_;
+};
+
+// Dispatch stats for every source, grouped by the source descriptions. All methods must only be
+// called from the event loop's thread.
+class EvLoop::Stats {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  void RecordWake() { wake_time_ = Clock::now(); }
+
+  Clock::time_point BeginDispatch() const { return Clock::now(); }
+
+  void EndDispatch(sd_event_source* source, Clock::time_point start) {
+    Clock::time_point end = Clock::now();
+
+    const char* description = nullptr;
+    if (sd_event_source_get_description(source, &description) < 0 || description == nullptr) {
+      description = "<unnamed>";
+    }
+
+    auto it = sources_.find(std::string_view(description));
+    if (it == sources_.end()) {
+      it = sources_.emplace(description, SourceStats{}).first;
+    }
+
+    SourceStats& stats = it->second;
+    stats.dispatches++;
+    stats.run_time.Add(end - start);
+    if (wake_time_) {
+      stats.wake_latency.Add(start - *wake_time_);
+    }
+  }
+
+  void RecordTaskBatch(std::size_t tasks) {
+    task_batches_++;
+    total_tasks_ += tasks;
+    max_tasks_ = std::max(max_tasks_, tasks);
+  }
+
+  void Dump() const {
+    Log() << "Event loop stats:";
+    for (const auto& [description, stats] : sources_) {
+      Log() << "  " << description << ": " << stats.dispatches << " dispatches, run time "
+            << stats.run_time << ", wake latency " << stats.wake_latency;
+    }
+
+    Log() << "  task batches: " << task_batches_ << ", total tasks " << total_tasks_
+          << ", max tasks per batch " << max_tasks_;
+  }
+
+ private:
+  struct DurationStats {
+    Clock::duration total = Clock::duration::zero();
+    Clock::duration max = Clock::duration::zero();
+
+    void Add(Clock::duration duration) {
+      total += duration;
+      max = std::max(max, duration);
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const DurationStats& stats) {
+      using std::chrono::microseconds, std::chrono::duration_cast;
+      return os << duration_cast<microseconds>(stats.total).count() << "us total / "
+                << duration_cast<microseconds>(stats.max).count() << "us max";
+    }
+  };
+
+  struct SourceStats {
+    std::uint64_t dispatches = 0;
+    DurationStats run_time;
+    DurationStats wake_latency;
+  };
+
+  std::optional<Clock::time_point> wake_time_;
+  std::map<std::string, SourceStats, std::less<>> sources_;
+
+  std::uint64_t task_batches_ = 0;
+  std::uint64_t total_tasks_ = 0;
+  std::size_t max_tasks_ = 0;
+};
+
+class EvLoop::Wakeups {
+ public:
+  explicit Wakeups(int notify_fd) : notify_fd_(notify_fd) {}
+
+  int notify_fd() const { return notify_fd_; }
+
+  void set_owner(pid_t tid) { owner_.store(tid, std::memory_order_relaxed); }
+  // If the owner is the current thread, then the loop is either dispatching right now or about to
+  // call Wait, so it will see any newly enabled sources without needing a wakeup. A stale owner is
+  // harmless: it can only match if the loop isn't running at all, in which case it will see the
+  // sources once it starts.
+  bool IsOwner(pid_t tid) const { return owner_.load(std::memory_order_relaxed) == tid; }
+
+  void RecordSaved() { saved_.fetch_add(1, std::memory_order_relaxed); }
+  std::uint64_t saved() const { return saved_.load(std::memory_order_relaxed); }
+
+ private:
+  int notify_fd_;
+  std::atomic<pid_t> owner_ = 0;
+  std::atomic<std::uint64_t> saved_ = 0;
+};
+
 namespace {
 
+pid_t CurrentThreadId() {
+  static thread_local pid_t tid = gettid();
+  return tid;
+}
+
+// Runs the stats and tracking hooks, if enabled, for the duration of a single dispatch.
+class DispatchScope {
+ public:
+  DispatchScope(sd_event_source* source, EvLoop::Stats* stats, EvLoop::DispatchTracking* tracking)
+      : source_(source), stats_(stats), tracking_(tracking) {
+    if (stats_ != nullptr) {
+      start_ = stats_->BeginDispatch();
+    }
+
+    if (tracking_ != nullptr) {
+      struct timespec now;
+      ZYPAK_ASSERT_WITH_ERRNO(clock_gettime(CLOCK_MONOTONIC, &now) != -1);
+
+      tracking_->tid.store(CurrentThreadId(), std::memory_order_relaxed);
+      tracking_->source.store(source, std::memory_order_relaxed);
+      tracking_->started_ns.store(now.tv_sec * 1'000'000'000ull + now.tv_nsec,
+                                  std::memory_order_release);
+      tracking_->iteration.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  ~DispatchScope() {
+    if (tracking_ != nullptr) {
+      tracking_->started_ns.store(0, std::memory_order_release);
+      tracking_->source.store(nullptr, std::memory_order_relaxed);
+    }
+
+    if (stats_ != nullptr) {
+      stats_->EndDispatch(source_, start_);
+    }
+  }
+
+ private:
+  sd_event_source* source_;
+  EvLoop::Stats* stats_;
+  EvLoop::DispatchTracking* tracking_;
+  EvLoop::Stats::Clock::time_point start_;
+};
+
 constexpr int kMillisecondsPerSecond = 1000;
 constexpr int kMicrosecondsPerMillisecond = 1000;
-constexpr int kDefaultAccuracyMs = 50;
+
+constexpr int kTimerClock = CLOCK_MONOTONIC;
+
+std::int64_t ToSdEventPriority(zypak::EvLoop::Priority priority) {
+  switch (priority) {
+  case zypak::EvLoop::Priority::kHigh:
+    return SD_EVENT_PRIORITY_IMPORTANT;
+  case zypak::EvLoop::Priority::kDefault:
+    return SD_EVENT_PRIORITY_NORMAL;
+  case zypak::EvLoop::Priority::kLow:
+    return SD_EVENT_PRIORITY_IDLE;
+  }
+
+  ZYPAK_ASSERT(false, << "Invalid priority: " << static_cast<int>(priority));
+}
+
+cstring_view TaskSourceDescription(zypak::EvLoop::Priority priority) {
+  switch (priority) {
+  case zypak::EvLoop::Priority::kHigh:
+    return "tasks-high";
+  case zypak::EvLoop::Priority::kDefault:
+    return "tasks";
+  case zypak::EvLoop::Priority::kLow:
+    return "tasks-low";
+  }
+
+  ZYPAK_ASSERT(false, << "Invalid priority: " << static_cast<int>(priority));
+}
 
 template <typename Handler>
 struct CallbackParams {
   zypak::EvLoop* evloop;
+  zypak::EvLoop::Stats* stats;
+  zypak::EvLoop::DispatchTracking* tracking;
   Handler handler;
-  std::vector<zypak::EvLoop::DestroyHandler> on_destroy;
+  zypak::EvLoop::DestroyHandlerList on_destroy;
 };
 
+// The handler stored for timer sources, along with what's needed to re-arm them in place.
+struct TimerCallback {
+  zypak::EvLoop::EventHandler handler;
+  std::uint64_t interval_us;
+  bool periodic;
+
+  void operator()(zypak::EvLoop::SourceRef source) { handler(std::move(source)); }
+};
+
+std::optional<std::uint64_t> TimerTargetFromNow(sd_event* event, std::uint64_t interval_us) {
+  std::uint64_t now;
+  if (int err = sd_event_now(event, kTimerClock, &now); err < 0) {
+    Errno(-err) << "Failed to get current clock tick";
+    return {};
+  }
+
+  return now + interval_us;
+}
+
 void DisableSource(sd_event_source* source) {
   Debug() << "Disable source " << source;
 
@@ -41,6 +268,132 @@ void DisableSource(sd_event_source* source) {
 
 }  // namespace
 
+// A multi-producer, single-consumer queue of tasks. Producers push onto an intrusive lock-free
+// stack, and the consumer takes the entire stack at once, reversing it to restore FIFO order.
+// Nodes are taken from a fixed per-queue pool, only falling back to the heap when every pooled node
+// is in use, so steady-state task traffic doesn't allocate.
+class EvLoop::TaskQueue {
+ public:
+  TaskQueue() {
+    for (Node& node : pool_) {
+      node.pooled = true;
+    }
+  }
+  TaskQueue(const TaskQueue& other) = delete;
+  TaskQueue(TaskQueue&& other) = delete;
+
+  ~TaskQueue() {
+    Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+    while (node != nullptr) {
+      Node* next = node->next;
+      FreeNode(node);
+      node = next;
+    }
+  }
+
+  // Pushes a new task onto the queue, returning true if the queue was empty beforehand (i.e. the
+  // consumer may need to be woken up).
+  bool Push(TaskHandler handler) {
+    Node* node = AllocateNode();
+    node->handler = std::move(handler);
+    node->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+
+    return node->next == nullptr;
+  }
+
+  bool empty() const { return head_.load(std::memory_order_acquire) == nullptr; }
+
+  // Sets up the stats to record batches to, and the defer source that will run this queue's tasks.
+  void Attach(Stats* stats, sd_event_source* run_source) {
+    stats_ = stats;
+    run_source_ = run_source;
+  }
+
+  void set_tracking(DispatchTracking* tracking) { tracking_ = tracking; }
+
+  Stats* stats() const { return stats_; }
+  DispatchTracking* tracking() const { return tracking_; }
+  sd_event_source* run_source() const { return run_source_; }
+
+  // Runs every task that has been pushed so far, in the order they were pushed. Tasks that are
+  // pushed while this is running will be left for the next call. Must only be called from the
+  // event loop's thread.
+  void RunAll() {
+    Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+
+    Node* ordered = nullptr;
+    std::size_t count = 0;
+    while (node != nullptr) {
+      Node* next = node->next;
+      node->next = ordered;
+      ordered = node;
+      node = next;
+      count++;
+    }
+
+    if (stats_ != nullptr && count > 0) {
+      stats_->RecordTaskBatch(count);
+    }
+
+    while (ordered != nullptr) {
+      Node* current = ordered;
+      ordered = ordered->next;
+      current->handler();
+      FreeNode(current);
+    }
+  }
+
+ private:
+  static constexpr std::size_t kPoolSize = 32;
+
+  struct Node {
+    TaskHandler handler;
+    Node* next = nullptr;
+    // Only used by pooled nodes: whether or not this node is currently taken.
+    std::atomic<bool> in_use = false;
+    bool pooled = false;
+  };
+
+  Node* AllocateNode() {
+    // Start each search at a different slot, so concurrent producers don't all fight over the first
+    // few nodes.
+    std::size_t start = pool_hint_.fetch_add(1, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < kPoolSize; i++) {
+      Node* node = &pool_[(start + i) % kPoolSize];
+
+      bool expected = false;
+      if (!node->in_use.load(std::memory_order_relaxed) &&
+          node->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire,
+                                               std::memory_order_relaxed)) {
+        return node;
+      }
+    }
+
+    return new Node;
+  }
+
+  void FreeNode(Node* node) {
+    if (node->pooled) {
+      node->handler = nullptr;
+      node->in_use.store(false, std::memory_order_release);
+    } else {
+      delete node;
+    }
+  }
+
+  Stats* stats_ = nullptr;
+  DispatchTracking* tracking_ = nullptr;
+  sd_event_source* run_source_ = nullptr;
+
+  std::atomic<Node*> head_ = nullptr;
+
+  std::array<Node, kPoolSize> pool_;
+  std::atomic<std::size_t> pool_hint_ = 0;
+};
+
 // static
 std::optional<EvLoop> EvLoop::Create() {
   unique_fd notify_defer(eventfd(0, EFD_NONBLOCK));
@@ -55,11 +408,28 @@ std::optional<EvLoop> EvLoop::Create() {
     return {};
   }
 
-  return EvLoop(event, std::move(notify_defer));
+  EvLoop ev(event, std::move(notify_defer));
+  if (!ev.SetupNotifySource()) {
+    return {};
+  }
+
+  for (Priority priority : {Priority::kHigh, Priority::kDefault, Priority::kLow}) {
+    if (!ev.SetupTaskSource(priority)) {
+      return {};
+    }
+  }
+
+  return std::move(ev);
 }
 
 EvLoop::EvLoop(sd_event* event, unique_fd notify_defer_fd)
-    : event_(event), notify_defer_fd_(std::move(notify_defer_fd)) {}
+    : event_(event), notify_defer_fd_(std::move(notify_defer_fd)),
+      wakeups_(std::make_unique<Wakeups>(notify_defer_fd_.get())),
+      stats_(DebugContext::instance()->enabled() ? std::make_unique<Stats>() : nullptr),
+      tasks_(std::make_unique<TaskQueue[]>(kPriorityCount)) {}
+
+EvLoop::EvLoop(EvLoop&& other) = default;
+EvLoop::~EvLoop() {}
 
 EvLoop::SourceRef::State EvLoop::SourceRef::state() const {
   int enabled = -1;
@@ -80,77 +450,196 @@ EvLoop::SourceRef::State EvLoop::SourceRef::state() const {
 void EvLoop::SourceRef::Disable() { DisableSource(source_); }
 
 void EvLoop::SourceRef::AddDestroyHandler(DestroyHandler handler) {
-  on_destroy_->push_back(std::move(handler));
+  on_destroy_->Add(std::move(handler));
+}
+
+void EvLoop::SourceRef::SetDescription(cstring_view description) const {
+  ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_description(source_, description.c_str()));
 }
 
 void EvLoop::TriggerSourceRef::Trigger() {
+  if (source_.state() == SourceRef::State::kActiveOnce) {
+    // Whoever triggered it first already took care of waking up the loop.
+    wakeups_->RecordSaved();
+    return;
+  }
+
   Debug() << "Trigger source " << source_.source_;
 
   ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_enabled(source_.source_, SD_EVENT_ONESHOT));
   ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_floating(source_.source_, true));
 
-  ZYPAK_ASSERT_WITH_ERRNO(eventfd_write(notify_defer_fd_, 1) != -1);
+  if (wakeups_->IsOwner(CurrentThreadId())) {
+    wakeups_->RecordSaved();
+    return;
+  }
+
+  ZYPAK_ASSERT_WITH_ERRNO(eventfd_write(wakeups_->notify_fd(), 1) != -1);
 }
 
-std::optional<EvLoop::SourceRef> EvLoop::AddTask(EvLoop::EventHandler handler) {
-  auto source = AddTaskNoNotify(std::move(handler));
-  if (!source) {
-    return {};
+bool EvLoop::TimerSourceRef::RearmMs(int ms) {
+  sd_event_source* source = source_.source_;
+  auto* params = static_cast<CallbackParams<TimerCallback>*>(sd_event_source_get_userdata(source));
+  std::uint64_t interval_us = static_cast<std::uint64_t>(ms) * kMicrosecondsPerMillisecond;
+
+  auto target_time = TimerTargetFromNow(sd_event_source_get_event(source), interval_us);
+  if (!target_time) {
+    return false;
   }
 
-  // Notify any waiters.
-  if (eventfd_write(notify_defer_fd_.get(), 1) == -1) {
+  if (int err = sd_event_source_set_time(source, *target_time); err < 0) {
+    Errno(-err) << "Failed to re-arm timer";
+    return false;
+  }
+
+  params->handler.interval_us = interval_us;
+
+  Debug() << "Re-armed timer source " << source << " with duration " << ms << "ms";
+
+  ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_enabled(
+      source, params->handler.periodic ? SD_EVENT_ON : SD_EVENT_ONESHOT));
+  ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_floating(source, true));
+  return true;
+}
+
+bool EvLoop::AddTask(EvLoop::TaskHandler handler, EvLoop::Priority priority) {
+  ZYPAK_ASSERT(handler, << "Missing handler for task");
+
+  // If the queue already had tasks in it, then the loop has already been notified, and it will
+  // pick up this task in the same batch.
+  if (tasks_[static_cast<int>(priority)].Push(std::move(handler)) &&
+      eventfd_write(notify_defer_fd_.get(), 1) == -1) {
     Errno() << "WARNING: Failed to notify defer fd";
+    return false;
   }
 
-  return source;
+  return true;
 }
 
-std::optional<EvLoop::TriggerSourceRef> EvLoop::AddTrigger(EvLoop::EventHandler handler) {
-  auto source = AddTaskNoNotify(handler);
+bool EvLoop::FdAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  // Shared between the handlers of the fd source and the timeout timer. Whichever finishes the
+  // wait first resumes the coroutine and disables the other source. The destroy handlers clear the
+  // raw source pointers, so they're only ever used while the sources are still alive.
+  struct Wait {
+    std::coroutine_handle<> handle;
+    sd_event_source* fd_source = nullptr;
+    sd_event_source* timer = nullptr;
+
+    void Finish() {
+      std::coroutine_handle<> awaiting = std::exchange(handle, nullptr);
+      if (fd_source != nullptr) {
+        DisableSource(fd_source);
+      }
+      if (timer != nullptr) {
+        DisableSource(timer);
+      }
+
+      awaiting.resume();
+    }
+  };
+
+  auto wait = std::make_shared<Wait>();
+
+  auto source = ev_->AddFd(
+      fd_, events_,
+      [this, wait](SourceRef source, Events events) {
+        if (wait->handle) {
+          result_ = events;
+          wait->Finish();
+        }
+      },
+      priority_);
+  if (!source) {
+    // Resume right away, with an empty result.
+    return false;
+  }
+
+  source->SetDescription("await-fd");
+  // If the source goes away without the handler ever running (e.g. the fd was closed), resume
+  // with the empty result.
+  source->AddDestroyHandler([wait]() {
+    wait->fd_source = nullptr;
+    if (wait->handle) {
+      wait->Finish();
+    }
+  });
+  wait->fd_source = source->source_;
+
+  if (timeout_ms_ > 0) {
+    auto timer = ev_->AddTimerMs(timeout_ms_, [this, wait](SourceRef source) {
+      if (wait->handle) {
+        result_ = Events(Events::Status::kNone);
+        wait->Finish();
+      }
+    });
+    if (!timer) {
+      DisableSource(wait->fd_source);
+      return false;
+    }
+
+    SourceRef timer_source = timer->source();
+    timer_source.SetDescription("await-fd-timeout");
+    timer_source.AddDestroyHandler([wait]() { wait->timer = nullptr; });
+    wait->timer = timer_source.source_;
+  }
+
+  wait->handle = handle;
+  return true;
+}
+
+std::optional<EvLoop::TriggerSourceRef> EvLoop::AddTrigger(EvLoop::EventHandler handler,
+                                                           EvLoop::Priority priority) {
+  auto source = AddDeferNoNotify(std::move(handler));
   if (!source) {
     return {};
   }
 
   ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_enabled(source->source_, SD_EVENT_OFF));
+  ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_priority(source->source_, ToSdEventPriority(priority)));
 
-  Debug() << "Lifting task " << source->source_ << " to trigger";
-  return TriggerSourceRef(std::move(*source), notify_defer_fd_.get());
+  Debug() << "Lifting defer source " << source->source_ << " to trigger";
+  return TriggerSourceRef(std::move(*source), wakeups_.get());
 }
 
-std::optional<EvLoop::SourceRef> EvLoop::AddTimerSec(int seconds, EvLoop::EventHandler handler) {
-  return AddTimerMs(seconds * kMillisecondsPerSecond, handler);
+std::optional<EvLoop::TimerSourceRef> EvLoop::AddTimerSec(int seconds,
+                                                         EvLoop::EventHandler handler,
+                                                         EvLoop::TimerOptions options) {
+  return AddTimerMs(seconds * kMillisecondsPerSecond, std::move(handler), options);
 }
 
-std::optional<EvLoop::SourceRef> EvLoop::AddTimerMs(int ms, EvLoop::EventHandler handler) {
+std::optional<EvLoop::TimerSourceRef> EvLoop::AddTimerMs(int ms, EvLoop::EventHandler handler,
+                                                        EvLoop::TimerOptions options) {
   ZYPAK_ASSERT(handler, << "Missing handler for timer, ms = " << ms);
 
-  constexpr int kClock = CLOCK_MONOTONIC;
-
-  std::uint64_t now;
-  if (int err = sd_event_now(event_.get(), kClock, &now); err < 0) {
-    Errno(-err) << "Failed to get current clock tick";
+  std::uint64_t interval_us = static_cast<std::uint64_t>(ms) * kMicrosecondsPerMillisecond;
+  auto target_time = TimerTargetFromNow(event_.get(), interval_us);
+  if (!target_time) {
     return {};
   }
 
-  std::uint64_t target_time = now + ms * kMicrosecondsPerMillisecond;
-
   sd_event_source* source = nullptr;
-  if (int err = sd_event_add_time(event_.get(), &source, kClock, target_time,
-                                  kDefaultAccuracyMs * kMicrosecondsPerMillisecond,
+  if (int err = sd_event_add_time(event_.get(), &source, kTimerClock, *target_time,
+                                  options.accuracy_ms * kMicrosecondsPerMillisecond,
                                   &HandleTimeEvent, nullptr);
       err < 0) {
     Errno(-err) << "Failed to add timer event";
     return {};
   }
 
-  Debug() << "Added timer source " << source << " with duration " << ms << "ms";
+  if (options.periodic) {
+    ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_enabled(source, SD_EVENT_ON));
+  }
 
-  return SourceSetup(source, std::move(handler));
+  Debug() << "Added " << (options.periodic ? "periodic " : "") << "timer source " << source
+          << " with duration " << ms << "ms";
+
+  return TimerSourceRef(
+      SourceSetup(source, TimerCallback{std::move(handler), interval_us, options.periodic}));
 }
 
 std::optional<EvLoop::SourceRef> EvLoop::AddFd(int fd, Events events,
-                                               EvLoop::IoEventHandler handler) {
+                                               EvLoop::IoEventHandler handler,
+                                               EvLoop::Priority priority) {
   ZYPAK_ASSERT(!events.empty(), << "Missing events for fd" << fd);
   ZYPAK_ASSERT(handler, << "Missing handler for fd " << fd);
 
@@ -169,13 +658,16 @@ std::optional<EvLoop::SourceRef> EvLoop::AddFd(int fd, Events events,
     return {};
   }
 
+  ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_priority(source, ToSdEventPriority(priority)));
+
   Debug() << "Adding I/O source " << source << " for " << fd;
   return SourceSetup(source, std::move(handler));
 }
 
 std::optional<EvLoop::SourceRef> EvLoop::TakeFd(unique_fd fd, Events events,
-                                                EvLoop::IoEventHandler handler) {
-  auto source = AddFd(fd.get(), events, std::move(handler));
+                                                EvLoop::IoEventHandler handler,
+                                                EvLoop::Priority priority) {
+  auto source = AddFd(fd.get(), events, std::move(handler), priority);
   if (!source) {
     return {};
   }
@@ -185,66 +677,41 @@ std::optional<EvLoop::SourceRef> EvLoop::TakeFd(unique_fd fd, Events events,
 }
 
 EvLoop::WaitResult EvLoop::Wait() {
-  int pending = sd_event_prepare(event_.get());
-  if (pending < 0) {
-    Errno(-pending) << "Failed to prepare event loop";
-    return WaitResult::kError;
-  } else if (pending > 0) {
-    // No need to wait, we know some events are ready.
-    ClearNotifyDeferFd();
-    return WaitResult::kReady;
-  }
-
-  std::array<struct pollfd, 2> pfds;
-
-  pfds[0].fd = sd_event_get_fd(event_.get());
-  ZYPAK_ASSERT_SD_ERROR(pfds[0].fd);
-
-  pfds[1].fd = notify_defer_fd_.get();
-
-  pfds[0].events = pfds[1].events = POLLIN;
-  pfds[0].revents = pfds[1].revents = 0;
+  wakeups_->set_owner(CurrentThreadId());
 
-  int ready = HANDLE_EINTR(poll(pfds.data(), pfds.size(), -1));
-  if (ready == -1) {
-    Errno() << "Failed to poll on sd-event fd";
-    return WaitResult::kError;
-  }
-
-  if (ready > 0) {
-    if ((pfds[0].revents | pfds[1].revents) & (POLLHUP | POLLERR)) {
-      Log() << "sd-event fd is in an error state";
+  for (;;) {
+    int pending = sd_event_prepare(event_.get());
+    if (pending < 0) {
+      Errno(-pending) << "Failed to prepare event loop";
       return WaitResult::kError;
+    } else if (pending > 0) {
+      // No need to wait, we know some events are ready.
+      if (stats_ != nullptr) {
+        stats_->RecordWake();
+      }
+
+      return WaitResult::kReady;
     }
 
-    if ((pfds[0].revents | pfds[1].revents) & POLLIN) {
-      if (pfds[1].revents & POLLIN) {
-        ClearNotifyDeferFd();
+    // Wakeups from other threads come in via the notify fd's I/O source, so this single call is
+    // all that's needed to block.
+    pending = sd_event_wait(event_.get(), std::numeric_limits<std::uint64_t>::max());
+    if (pending < 0) {
+      Errno(-pending) << "Failed to wait on event loop";
+      return WaitResult::kError;
+    } else if (pending > 0) {
+      if (stats_ != nullptr) {
+        stats_->RecordWake();
       }
 
       return WaitResult::kReady;
     }
 
-    ZYPAK_ASSERT((pfds[0].revents | pfds[1].revents) == 0,
-                 << "Unexpected revents values: " << pfds[0].revents << ' ' << pfds[1].revents);
+    // Nothing ended up pending (e.g. a timer was disabled while we were waiting), so prepare again.
   }
-
-  Debug() << "Poll returned without events?";
-  return WaitResult::kIdle;
 }
 
 EvLoop::DispatchResult EvLoop::Dispatch() {
-  if (sd_event_get_state(event_.get()) != SD_EVENT_PENDING) {
-    int pending = sd_event_wait(event_.get(), 0);
-    if (pending < 0) {
-      Errno(-pending) << "Failed to update event loop waiting state";
-      return DispatchResult::kError;
-    } else if (pending == 0) {
-      Log() << "Wait found events, but sd-event found none";
-      return DispatchResult::kContinue;
-    }
-  }
-
   int result = sd_event_dispatch(event_.get());
   if (result < 0) {
     Errno(-result) << "Failed to run event loop iteration";
@@ -265,6 +732,26 @@ bool EvLoop::Exit(EvLoop::ExitStatus status) {
   return true;
 }
 
+EvLoop::DispatchTracking* EvLoop::EnableDispatchTracking() {
+  if (!tracking_) {
+    tracking_ = std::make_unique<DispatchTracking>();
+    for (int i = 0; i < kPriorityCount; i++) {
+      tasks_[i].set_tracking(tracking_.get());
+    }
+  }
+
+  return tracking_.get();
+}
+
+std::uint64_t EvLoop::saved_wakeups() const { return wakeups_->saved(); }
+
+void EvLoop::DumpStats() const {
+  if (stats_ != nullptr) {
+    stats_->Dump();
+    Log() << "  saved wakeups: " << saved_wakeups();
+  }
+}
+
 EvLoop::ExitStatus EvLoop::exit_status() const {
   int code;
   ZYPAK_ASSERT_SD_ERROR(sd_event_get_exit_code(event_.get(), &code));
@@ -272,37 +759,79 @@ EvLoop::ExitStatus EvLoop::exit_status() const {
   return static_cast<EvLoop::ExitStatus>(code);
 }
 
-void EvLoop::ClearNotifyDeferFd() {
-  std::uint64_t value;
-  ZYPAK_ASSERT_WITH_ERRNO(eventfd_read(notify_defer_fd_.get(), &value) != -1 || errno == EAGAIN);
+bool EvLoop::SetupNotifySource() {
+  sd_event_source* source = nullptr;
+  if (int err = sd_event_add_io(event_.get(), &source, notify_defer_fd_.get(), EPOLLIN,
+                                &HandleNotify, tasks_.get());
+      err < 0) {
+    Errno(-err) << "Failed to add notify source";
+    return false;
+  }
+
+  ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_description(source, "notify"));
+  // The notify source only forwards wakeups onto the sources that do the actual work, so it
+  // shouldn't wait behind anything else.
+  ZYPAK_ASSERT_SD_ERROR(
+      sd_event_source_set_priority(source, ToSdEventPriority(Priority::kHigh)));
+
+  // Hand our reference over to the event loop.
+  ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_floating(source, true));
+  sd_event_source_unref(source);
+
+  Debug() << "Added notify source " << source;
+  return true;
 }
 
-std::optional<EvLoop::SourceRef> EvLoop::AddTaskNoNotify(EvLoop::EventHandler handler) {
-  ZYPAK_ASSERT(handler, << "Missing handler for task");
+bool EvLoop::SetupTaskSource(EvLoop::Priority priority) {
+  TaskQueue* tasks = &tasks_[static_cast<int>(priority)];
+
+  sd_event_source* source = nullptr;
+  if (int err = sd_event_add_defer(event_.get(), &source, &HandleTasks, tasks); err < 0) {
+    Errno(-err) << "Failed to add task source";
+    return false;
+  }
+
+  ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_enabled(source, SD_EVENT_OFF));
+  ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_priority(source, ToSdEventPriority(priority)));
+  ZYPAK_ASSERT_SD_ERROR(
+      sd_event_source_set_description(source, TaskSourceDescription(priority).c_str()));
+
+  // Hand our reference over to the event loop. Unlike other sources, this one must stay floating
+  // even while disabled, since it's re-enabled every time its queue gets new tasks.
+  ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_floating(source, true));
+  sd_event_source_unref(source);
+
+  tasks->Attach(stats_.get(), source);
+
+  Debug() << "Added task source " << source;
+  return true;
+}
+
+std::optional<EvLoop::SourceRef> EvLoop::AddDeferNoNotify(EvLoop::EventHandler handler) {
+  ZYPAK_ASSERT(handler, << "Missing handler for defer source");
 
   sd_event_source* source = nullptr;
   if (int err = sd_event_add_defer(event_.get(), &source, &GenericHandler<EventHandler>, nullptr);
       err < 0) {
-    Errno(-err) << "Failed to add task";
+    Errno(-err) << "Failed to add defer source";
     return {};
   }
 
-  Debug() << "Added task source " << source;
+  Debug() << "Added defer source " << source;
   return SourceSetup(source, std::move(handler));
 }
 
 template <typename Handler>
 // static
 EvLoop::SourceRef EvLoop::SourceSetup(sd_event_source* source, Handler handler) {
-  auto* params = new CallbackParams<Handler>{this, std::move(handler)};
+  auto* params =
+      new CallbackParams<Handler>{this, stats_.get(), tracking_.get(), std::move(handler)};
 
   sd_event_source_set_floating(source, true);
   sd_event_source_set_userdata(source, params);
   sd_event_source_set_destroy_callback(source, [](void* data) {
     auto* params = static_cast<CallbackParams<Handler>*>(data);
-    for (DestroyHandler handler : params->on_destroy) {
-      handler();
-    }
+    params->on_destroy.RunAll();
     delete params;
   });
 
@@ -322,7 +851,13 @@ int EvLoop::GenericHandler(sd_event_source* source, void* data, Args&&... args)
   sd_event_source_ref(source);
   SourceRef source_ref(source, &params->on_destroy);
 
-  params->handler(std::move(source_ref), std::forward<Args>(args)...);
+  {
+    DispatchScope scope(source, params->stats, params->tracking);
+    // The handler gets its own reference, so that this one keeps the source connected to the loop
+    // even if the handler disables it (which drops the loop's floating reference), otherwise the
+    // state check below would be operating on a disconnected source.
+    params->handler(source_ref, std::forward<Args>(args)...);
+  }
 
   int enabled = -1;
   ZYPAK_ASSERT_SD_ERROR(sd_event_source_get_enabled(source, &enabled));
@@ -335,6 +870,33 @@ int EvLoop::GenericHandler(sd_event_source* source, void* data, Args&&... args)
   return 0;
 }
 
+// static
+int EvLoop::HandleNotify(sd_event_source* source, int fd, std::uint32_t revents, void* data) {
+  std::uint64_t value;
+  ZYPAK_ASSERT_WITH_ERRNO(eventfd_read(fd, &value) != -1 || errno == EAGAIN);
+
+  // Let each queue's source run its tasks at the queue's priority.
+  auto* queues = static_cast<TaskQueue*>(data);
+  for (int i = 0; i < kPriorityCount; i++) {
+    if (!queues[i].empty()) {
+      ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_enabled(queues[i].run_source(), SD_EVENT_ONESHOT));
+    }
+  }
+
+  return 0;
+}
+
+// static
+int EvLoop::HandleTasks(sd_event_source* source, void* data) {
+  Debug() << "Running queued tasks";
+
+  auto* tasks = static_cast<TaskQueue*>(data);
+
+  DispatchScope scope(source, tasks->stats(), tasks->tracking());
+  tasks->RunAll();
+  return 0;
+}
+
 // static
 int EvLoop::HandleIoEvent(sd_event_source* source, int fd, std::uint32_t revents, void* data) {
   if (revents & (EPOLLHUP | EPOLLERR)) {
@@ -357,7 +919,18 @@ int EvLoop::HandleIoEvent(sd_event_source* source, int fd, std::uint32_t revents
 
 // static
 int EvLoop::HandleTimeEvent(sd_event_source* source, std::uint64_t us, void* data) {
-  return GenericHandler<EventHandler>(source, data);
+  auto* params = static_cast<CallbackParams<TimerCallback>*>(data);
+  if (params->handler.periodic) {
+    // Schedule the next run before calling the handler, so the handler is free to re-arm or
+    // disable the timer itself. The next run is relative to now rather than to the last target
+    // time, so a loop that fell behind doesn't fire a burst of catch-up events.
+    auto target_time = TimerTargetFromNow(sd_event_source_get_event(source),
+                                          params->handler.interval_us);
+    ZYPAK_ASSERT(target_time);
+    ZYPAK_ASSERT_SD_ERROR(sd_event_source_set_time(source, *target_time));
+  }
+
+  return GenericHandler<TimerCallback>(source, data);
 }
 
 }  // namespace zypak
@@ -5,13 +5,16 @@
 
 #pragma once
 
+#include <atomic>
+#include <coroutine>
 #include <cstdint>
-#include <functional>
 #include <memory>
 #include <optional>
 
 #include <systemd/sd-event.h>
 
+#include "base/cstring_view.h"
+#include "base/small_function.h"
 #include "base/unique_fd.h"
 
 namespace zypak {
@@ -21,8 +24,8 @@ namespace zypak {
 class EvLoop {
  public:
   EvLoop(const EvLoop& other) = delete;
-  EvLoop(EvLoop&& other) = default;
-  ~EvLoop() {}
+  EvLoop(EvLoop&& other);
+  ~EvLoop();
 
   // Creates a new event loop instance, returning an empty optional if creation fails.
   static std::optional<EvLoop> Create();
@@ -60,10 +63,18 @@ class EvLoop {
   };
 
   class SourceRef;
-
-  using EventHandler = std::function<void(SourceRef)>;
-  using IoEventHandler = std::function<void(SourceRef, Events)>;
-  using DestroyHandler = std::function<void()>;
+  // Storage for a source's destroy handlers, dispatch stats, and wakeup bookkeeping, internal to
+  // the EvLoop implementation.
+  class DestroyHandlerList;
+  class Stats;
+  class Wakeups;
+
+  // Handlers are stored without allocating as long as they're small enough, so that adding short-
+  // lived sources and tasks doesn't hit malloc every time.
+  using EventHandler = SmallFunction<void(SourceRef)>;
+  using TaskHandler = SmallFunction<void()>;
+  using IoEventHandler = SmallFunction<void(SourceRef, Events)>;
+  using DestroyHandler = SmallFunction<void()>;
 
   // A reference to a single source being tracked by the event loop. Unlike vanilla sd-event, *all*
   // SourceRefs are "floating" and partly owned by the event loop. Thus, if all SourceRefs pointing
@@ -80,6 +91,7 @@ class EvLoop {
     friend void swap(SourceRef& a, SourceRef& b) {
       using std::swap;
       swap(a.source_, b.source_);
+      swap(a.on_destroy_, b.on_destroy_);
     }
 
     SourceRef& operator=(SourceRef other) {
@@ -101,20 +113,26 @@ class EvLoop {
 
     void AddDestroyHandler(DestroyHandler handler);
 
+    // Names the source, which is used to group its entries in the event loop stats.
+    void SetDescription(cstring_view description) const;
+
    private:
-    explicit SourceRef(sd_event_source* source, std::vector<DestroyHandler>* on_destroy)
+    explicit SourceRef(sd_event_source* source, DestroyHandlerList* on_destroy)
         : source_(source), on_destroy_(on_destroy) {}
 
     sd_event_source* source_;
-    std::vector<DestroyHandler>* on_destroy_;
+    DestroyHandlerList* on_destroy_;
 
     friend class EvLoop;
     friend class TriggerSourceRef;
+    friend class TimerSourceRef;
   };
 
   // A wrapper for a SourceRef that can be activated repeatedly. Once "triggered", the source will
   // run on the next event loop iteration, then be automatically disabled (i.e. on trigger, the
-  // state becomes kActiveOnce).
+  // state becomes kActiveOnce). Triggering a source that's already active is a no-op, and
+  // triggering from the loop's own thread won't bother waking it up, since the loop is going to
+  // check for pending sources before blocking again anyway.
   class TriggerSourceRef {
    public:
     void Trigger();
@@ -125,42 +143,120 @@ class EvLoop {
     void Disable() { source_.Disable(); }
 
    private:
-    TriggerSourceRef(SourceRef source, int notify_defer_fd)
-        : source_(std::move(source)), notify_defer_fd_(notify_defer_fd) {}
+    TriggerSourceRef(SourceRef source, Wakeups* wakeups)
+        : source_(std::move(source)), wakeups_(wakeups) {}
+
+    SourceRef source_;
+    Wakeups* wakeups_;
+
+    friend class EvLoop;
+  };
+
+  // A wrapper for a SourceRef pointing to a timer, which can be re-armed in place instead of
+  // adding a brand new timer every time.
+  class TimerSourceRef {
+   public:
+    // Re-arms the timer to fire the given # of milliseconds from now, re-enabling it if it was
+    // disabled. For periodic timers, this also becomes the new interval.
+    bool RearmMs(int ms);
+
+    const SourceRef& source() const { return source_; }
+
+    SourceRef::State state() const { return source_.state(); }
+    void Disable() { source_.Disable(); }
+
+   private:
+    explicit TimerSourceRef(SourceRef source) : source_(std::move(source)) {}
 
     SourceRef source_;
-    int notify_defer_fd_;
 
     friend class EvLoop;
   };
 
+  // When several sources are ready at once, higher priority ones are dispatched first.
+  enum class Priority { kHigh, kDefault, kLow };
+  static constexpr int kPriorityCount = static_cast<int>(Priority::kLow) + 1;
+
+  static constexpr int kDefaultTimerAccuracyMs = 50;
+
+  struct TimerOptions {
+    TimerOptions() {}
+
+    // If true, the timer will keep firing at its interval until it's disabled, otherwise it will
+    // be disabled after firing once.
+    bool periodic = false;
+    // How late the timer may fire, which lets sd-event coalesce wakeups.
+    int accuracy_ms = kDefaultTimerAccuracyMs;
+  };
+
   // Adds a function that should run on the next event loop iteration, in the event loop's thread
-  // and environment.
-  std::optional<SourceRef> AddTask(EventHandler handler);
+  // and environment. Unlike every other method here, this is safe to call from any thread *without*
+  // holding a lock on the event loop, as tasks are pushed onto a lock-free queue that is drained in
+  // a single batch by the loop. Each priority has its own queue, so e.g. high priority tasks will
+  // run before any low priority sources.
+  bool AddTask(TaskHandler handler, Priority priority = Priority::kDefault);
 
   // Adds a function that will be run when the returned source is triggered.
-  std::optional<TriggerSourceRef> AddTrigger(EventHandler handler);
+  std::optional<TriggerSourceRef> AddTrigger(EventHandler handler,
+                                             Priority priority = Priority::kDefault);
 
   // Add a new timer that fires after the given # of seconds / milliseconds.
-  std::optional<SourceRef> AddTimerSec(int seconds, EventHandler handler);
-  std::optional<SourceRef> AddTimerMs(int ms, EventHandler handler);
+  std::optional<TimerSourceRef> AddTimerSec(int seconds, EventHandler handler,
+                                            TimerOptions options = {});
+  std::optional<TimerSourceRef> AddTimerMs(int ms, EventHandler handler,
+                                           TimerOptions options = {});
 
   // Add a new file descriptor to poll. The file descriptor is not owned by the EvLoop instance.
-  std::optional<SourceRef> AddFd(int fd, Events events, IoEventHandler handler);
+  std::optional<SourceRef> AddFd(int fd, Events events, IoEventHandler handler,
+                                 Priority priority = Priority::kDefault);
 
   // Add a new file descriptor to poll. The file descriptor will be owned by the EvLoop instance.
-  std::optional<SourceRef> TakeFd(unique_fd fd, Events events, IoEventHandler handler);
+  std::optional<SourceRef> TakeFd(unique_fd fd, Events events, IoEventHandler handler,
+                                  Priority priority = Priority::kDefault);
+
+  // An awaitable that resumes the awaiting coroutine once the fd has any of the given events,
+  // resulting in the events that occurred. If the fd could not be polled or was closed / errored
+  // before any events arrived, the result is an empty optional. If a timeout was given and passes
+  // before any events arrive, the result is an empty set of events instead.
+  class FdAwaiter {
+   public:
+    bool await_ready() const { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    std::optional<Events> await_resume() const { return result_; }
+
+   private:
+    FdAwaiter(EvLoop* ev, int fd, Events events, Priority priority, int timeout_ms)
+        : ev_(ev), fd_(fd), events_(events), priority_(priority), timeout_ms_(timeout_ms) {}
+
+    EvLoop* ev_;
+    int fd_;
+    Events events_;
+    Priority priority_;
+    int timeout_ms_;
+    std::optional<Events> result_;
+
+    friend class EvLoop;
+  };
+
+  // Returns an awaitable for the given fd events. Like the rest of the methods here, the awaiting
+  // coroutine must hold a lock on the event loop, which is always the case for coroutines that are
+  // resumed by event loop callbacks.
+  FdAwaiter AwaitFd(int fd, Events events, Priority priority = Priority::kDefault,
+                    int timeout_ms = 0) {
+    return FdAwaiter(this, fd, events, priority, timeout_ms);
+  }
 
   // The current state of the event loop.
   enum class WaitResult {
     // The event loop is ready to dispatch events, call Dispatch next.
     kReady,
-    // The event loop has no events ready, try Wait again later.
-    kIdle,
     // The event loop is in an error state.
     kError,
   };
-  // Waits on the event loop, returning with a state that is either ready, idle, or failed.
+  // Blocks until the event loop has events ready to dispatch, returning with a state that is either
+  // ready or failed. Only a single blocking epoll_wait is performed per wakeup, as every source
+  // (including the fd used to wake the loop from other threads) is registered with sd-event itself.
+  // sd-event's own non-blocking check for pending events comes before it.
   WaitResult Wait();
 
   // The result of a dispatch operation.
@@ -184,25 +280,72 @@ class EvLoop {
   // call this before Exit.
   ExitStatus exit_status() const;
 
+  // State about the dispatch currently in progress, published for other threads (e.g. a watchdog)
+  // to read.
+  struct DispatchTracking {
+    // Incremented at the start of every dispatch.
+    std::atomic<std::uint64_t> iteration = 0;
+    // The CLOCK_MONOTONIC time the current dispatch started at in nanoseconds, or 0 if the loop
+    // isn't dispatching anything.
+    std::atomic<std::uint64_t> started_ns = 0;
+    // The source being dispatched. This may only be inspected from the loop's own thread (e.g. from
+    // a signal handler interrupting the dispatch), since it can be freed once the dispatch is done.
+    std::atomic<sd_event_source*> source = nullptr;
+    // The thread running the dispatch.
+    std::atomic<pid_t> tid = 0;
+  };
+
+  // Starts publishing dispatch tracking info, returning the tracking state, which is owned by the
+  // event loop. This must be called before adding any sources.
+  DispatchTracking* EnableDispatchTracking();
+
+  // Returns the # of times a trigger avoided waking up the loop, either because it came from the
+  // loop's own thread or because the source was already triggered.
+  std::uint64_t saved_wakeups() const;
+
+  // Logs the per-source dispatch stats collected so far. Stats are only collected when debug mode
+  // is enabled, otherwise this does nothing.
+  void DumpStats() const;
+
  private:
   EvLoop(sd_event* event, unique_fd notify_defer_fd);
 
+  class TaskQueue;
+
   struct SdEventDeleter {
     void operator()(sd_event* event) { sd_event_unref(event); }
   };
 
   std::unique_ptr<sd_event, SdEventDeleter> event_;
 
-  // If the loop's epoll fd is currently being polled on by Wait, sd_event_add_defer will not
-  // awaken it, as it does not interact with the epoll fd. Therefore, we create an eventfd that is
-  // polled on along with the epoll fd, that way it'll cause Wait to return.
+  // If the loop is currently blocked in Wait, sd_event_add_defer will not awaken it, as it does not
+  // interact with the epoll fd. Therefore, we create an eventfd that is registered with the loop as
+  // a regular I/O source, that way writing to it will cause Wait to return.
   // Note that, tasks and triggers could just use eventfds instead, but this is a bit more
   // efficient since it's not creating and polling on as many fds.
   unique_fd notify_defer_fd_;
 
-  void ClearNotifyDeferFd();
+  // Tracks the thread currently running the loop, so triggers know when the notify fd can be
+  // skipped. This lives on the heap for the same reason as the stats below.
+  std::unique_ptr<Wakeups> wakeups_;
+
+  // Only set if debug mode is enabled, so the cost of stats collection otherwise is a single null
+  // check per dispatch. This lives on the heap so sources can keep pointing to it when the EvLoop
+  // is moved.
+  std::unique_ptr<Stats> stats_;
+
+  // Only set once EnableDispatchTracking is called. Like the stats, this lives on the heap.
+  std::unique_ptr<DispatchTracking> tracking_;
+
+  // Tasks posted via AddTask, one queue per priority, indexed by the Priority values. When the
+  // notify fd's source runs, it enables a defer source for each non-empty queue at that queue's
+  // priority, which then runs the tasks. This lives on the heap for the same reason as the stats.
+  std::unique_ptr<TaskQueue[]> tasks_;
+
+  bool SetupNotifySource();
+  bool SetupTaskSource(Priority priority);
 
-  std::optional<EvLoop::SourceRef> AddTaskNoNotify(EvLoop::EventHandler handler);
+  std::optional<EvLoop::SourceRef> AddDeferNoNotify(EvLoop::EventHandler handler);
 
   template <typename Handler>
   SourceRef SourceSetup(sd_event_source* source, Handler handler);
@@ -210,6 +353,8 @@ class EvLoop {
   template <typename Handler, typename... Args>
   static int GenericHandler(sd_event_source* source, void* data, Args&&... args);
 
+  static int HandleNotify(sd_event_source* source, int fd, std::uint32_t revents, void* data);
+  static int HandleTasks(sd_event_source* source, void* data);
   static int HandleIoEvent(sd_event_source* source, int fd, std::uint32_t revents, void* data);
   static int HandleTimeEvent(sd_event_source* source, std::uint64_t us, void* data);
 };
@@ -0,0 +1,116 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures EvLoop::AddTask from other threads, the way every call into the bus thread is posted:
+// how many tasks per second the loop gets through with several threads posting at once, and how
+// long a task waits between being posted and running, both when the loop is idle (so every task
+// has to wake it up) and when it's busy.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "base/debug.h"
+#include "base/evloop.h"
+#include "base/evloop_thread.h"
+
+using namespace zypak;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kThroughputTasksPerProducer = 200 * 1000;
+constexpr int kProducerCounts[] = {1, 4, 16};
+
+constexpr int kLatencySamples = 20 * 1000;
+// Gives the loop time to go back to sleep between tasks, so each one has to wake it up.
+constexpr auto kIdleLatencyGap = std::chrono::microseconds(50);
+
+void MeasureThroughput(EvLoop* ev, int producers) {
+  std::atomic<std::uint64_t> ran = 0;
+  std::uint64_t total = static_cast<std::uint64_t>(producers) * kThroughputTasksPerProducer;
+
+  auto start = Clock::now();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < producers; i++) {
+    threads.emplace_back([ev, &ran]() {
+      for (int task = 0; task < kThroughputTasksPerProducer; task++) {
+        ZYPAK_ASSERT(ev->AddTask([&ran]() { ran.fetch_add(1, std::memory_order_relaxed); }));
+      }
+    });
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  while (ran.load(std::memory_order_relaxed) < total) {
+    std::this_thread::yield();
+  }
+
+  auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+  Log() << producers << " producer(s): " << total / elapsed.count() << " tasks/s";
+}
+
+void MeasureLatency(EvLoop* ev, const char* name, bool idle) {
+  std::vector<std::int64_t> latencies(kLatencySamples);
+  std::atomic<int> done = 0;
+
+  for (int i = 0; i < kLatencySamples; i++) {
+    if (idle) {
+      // Wait for the previous task, then let the loop block again.
+      while (done.load(std::memory_order_acquire) < i) {
+        std::this_thread::yield();
+      }
+
+      std::this_thread::sleep_for(kIdleLatencyGap);
+    }
+
+    Clock::time_point posted = Clock::now();
+    ZYPAK_ASSERT(ev->AddTask([&latencies, &done, posted, i]() {
+      latencies[i] =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - posted).count();
+      done.fetch_add(1, std::memory_order_release);
+    }));
+  }
+
+  while (done.load(std::memory_order_acquire) < kLatencySamples) {
+    std::this_thread::yield();
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](int p) { return latencies[latencies.size() * p / 100] / 1000.0; };
+  Log() << "Post-to-run latency (" << name << "): p50 " << percentile(50) << "us, p99 "
+        << percentile(99) << "us, max " << latencies.back() / 1000.0 << "us";
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("evloop_perftest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  std::unique_ptr<EvLoopThread> thread = EvLoopThread::Create("zypak-perf");
+  ZYPAK_ASSERT(thread);
+  thread->Start();
+
+  // Posting tasks doesn't need the loop's lock.
+  EvLoop* ev = thread->evloop()->unsafe();
+
+  for (int producers : kProducerCounts) {
+    MeasureThroughput(ev, producers);
+  }
+
+  MeasureLatency(ev, "idle loop", /*idle=*/true);
+  MeasureLatency(ev, "busy loop", /*idle=*/false);
+
+  thread->Shutdown();
+  return 0;
+}
@@ -0,0 +1,118 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/evloop_thread.h"
+
+#include <pthread.h>
+
+#include <cstdlib>
+#include <functional>
+
+#include "base/debug.h"
+
+namespace zypak {
+
+namespace {
+
+// Thread names are limited to 16 bytes, including the null terminator.
+constexpr size_t kMaxThreadNameLength = 15;
+
+}  // namespace
+
+EvLoopThread::~EvLoopThread() {
+  if (IsRunning()) {
+    Shutdown();
+  }
+}
+
+// static
+std::unique_ptr<EvLoopThread> EvLoopThread::Create(std::string name) {
+  auto ev = EvLoop::Create();
+  if (!ev) {
+    return nullptr;
+  }
+
+  // As with the bus thread, sd-event's exit can't be used, since it's permanent.
+  ShutdownFlag shutdown_flag = std::make_unique<std::atomic<bool>>(false);
+
+  auto shutdown_source =
+      ev->AddTrigger([flag = shutdown_flag.get()](EvLoop::SourceRef source) { flag->store(true); });
+  if (!shutdown_source) {
+    Log() << "Could not add shutdown source for thread " << name;
+    return nullptr;
+  }
+
+  shutdown_source->source().SetDescription(name + "-shutdown");
+
+  // Can't use make_unique, because our constructor is private.
+  return std::unique_ptr<EvLoopThread>(new EvLoopThread(
+      std::move(name), std::move(*ev), std::move(shutdown_flag), std::move(*shutdown_source)));
+}
+
+bool EvLoopThread::IsRunning() const { return thread_.joinable(); }
+
+void EvLoopThread::Start() {
+  ZYPAK_ASSERT(!IsRunning());
+
+  // Make sure if this is a restart, the shutdown flag isn't set.
+  shutdown_flag_->store(false);
+  thread_ = std::thread(std::bind(&EvLoopThread::ThreadMain, this));
+
+  std::string thread_name = name_.substr(0, kMaxThreadNameLength);
+  if (int err = pthread_setname_np(thread_.native_handle(), thread_name.c_str()); err != 0) {
+    Errno(err) << "Failed to set name of thread " << name_;
+  }
+}
+
+void EvLoopThread::Shutdown() {
+  Debug() << "Shutting down thread " << name_ << "...";
+
+  if (!thread_.joinable()) {
+    Log() << "Thread " << name_ << " is not joinable";
+    return;
+  }
+
+  {
+    // Need to lock to activate triggers.
+    auto ev = ev_.Acquire();
+    shutdown_trigger_.Trigger();
+  }
+
+  thread_.join();
+  thread_ = std::thread();
+
+  Debug() << "Thread " << name_ << " shutdown complete";
+}
+
+EvLoopThread::EvLoopThread(std::string name, EvLoop ev, ShutdownFlag shutdown_flag,
+                           EvLoop::TriggerSourceRef shutdown_trigger)
+    : name_(std::move(name)), ev_(std::move(ev)), shutdown_flag_(std::move(shutdown_flag)),
+      shutdown_trigger_(std::move(shutdown_trigger)) {}
+
+void EvLoopThread::ThreadMain() {
+  while (!shutdown_flag_->load()) {
+    // Don't hold any lock while waiting, so other threads can still add sources.
+    switch (ev_.unsafe()->Wait()) {
+    case EvLoop::WaitResult::kReady:
+      break;
+    case EvLoop::WaitResult::kError:
+      Log() << "EvLoop wait failed in thread " << name_ << "! Aborting...";
+      abort();
+    }
+
+    auto ev = ev_.Acquire();
+    switch (ev->Dispatch()) {
+    case EvLoop::DispatchResult::kExit:
+      // We never call Exit, so this is unexpected.
+      ZYPAK_ASSERT(false, << "Unexpected loop exit");
+    case EvLoop::DispatchResult::kContinue:
+      continue;
+    case EvLoop::DispatchResult::kError:
+      Log() << "EvLoop iteration failed in thread " << name_ << "! Aborting...";
+      abort();
+    }
+  }
+}
+
+}  // namespace zypak
@@ -0,0 +1,56 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "base/base.h"
+#include "base/evloop.h"
+#include "base/guarded_value.h"
+
+namespace zypak {
+
+// A thread that runs its own event loop, for work that shouldn't hold up another loop (e.g. the bus
+// thread's). Like the bus thread, it can be shut down and started again later, e.g. around a fork,
+// without losing any of the loop's sources.
+class EvLoopThread {
+ public:
+  EvLoopThread(const EvLoopThread& other) = delete;
+  // Once the thread is started, moving this instance no longer safe.
+  EvLoopThread(EvLoopThread&& other) = delete;
+  ~EvLoopThread();
+
+  // The name is given to the thread, and is used to describe the thread's own sources.
+  static std::unique_ptr<EvLoopThread> Create(std::string name);
+
+  // Like with the bus thread, the loop must be locked to add or modify sources, but posting tasks
+  // is thread-safe.
+  RecursiveGuardedValue<EvLoop>* evloop() { return &ev_; }
+
+  bool IsRunning() const;
+
+  void Start();
+  void Shutdown();
+
+ private:
+  using ShutdownFlag = std::unique_ptr<std::atomic<bool>>;
+
+  EvLoopThread(std::string name, EvLoop ev, ShutdownFlag shutdown_flag,
+               EvLoop::TriggerSourceRef shutdown_trigger);
+
+  void ThreadMain();
+
+  std::string name_;
+  RecursiveGuardedValue<EvLoop> ev_;
+  ShutdownFlag shutdown_flag_;
+  EvLoop::TriggerSourceRef shutdown_trigger_;
+
+  std::thread thread_;
+};
+
+}  // namespace zypak
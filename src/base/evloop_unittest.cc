@@ -0,0 +1,282 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/evloop.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/debug.h"
+#include "base/evloop_thread.h"
+#include "base/strace.h"
+#include "base/unique_fd.h"
+
+using namespace zypak;
+
+namespace {
+
+constexpr int kWarmupRounds = 16;
+constexpr int kCountedRounds = 1000;
+constexpr int kTasksPerRound = 8;
+
+// Passed to the test binary when it's re-run under strace, so it only runs the traced workload.
+constexpr std::string_view kSyscallWorkloadFlag = "--syscall-workload";
+constexpr int kTracedWakeups = 200;
+// Long enough for the loop to go back to sleep between tasks, so each one has to wake it up.
+constexpr auto kTracedWakeupGap = std::chrono::milliseconds(1);
+// A single epoll_wait blocks, but sd_event_prepare always checks for pending events with its own
+// non-blocking epoll_wait first, and the notify fd has to be read to clear it. There's a bit of
+// slack for the occasional extra call, e.g. when sd-event re-arms its timers.
+constexpr double kMaxSyscallsPerWakeup = 3.5;
+
+// Every allocation goes through these, including sd-event's own, so they're counted here. Only
+// touched from the main thread.
+bool counting = false;
+size_t allocations = 0;
+
+// Runs the loop until a task posted now has run, i.e. until everything already pending is done.
+void RunUntilIdle(EvLoop* ev) {
+  bool done = false;
+  ZYPAK_ASSERT(ev->AddTask([&done]() { done = true; }, EvLoop::Priority::kLow));
+
+  while (!done) {
+    ZYPAK_ASSERT(ev->Wait() == EvLoop::WaitResult::kReady);
+    ZYPAK_ASSERT(ev->Dispatch() == EvLoop::DispatchResult::kContinue);
+  }
+}
+
+void TestSourceRefAssignment() {
+  std::optional<EvLoop> ev = EvLoop::Create();
+  ZYPAK_ASSERT(ev);
+
+  auto first = ev->AddTrigger([](EvLoop::SourceRef source) {});
+  auto second = ev->AddTrigger([](EvLoop::SourceRef source) {});
+  ZYPAK_ASSERT(first && second);
+
+  bool first_destroyed = false;
+  bool second_destroyed = false;
+
+  {
+    // Assigning a ref has to carry over where the destroy handlers of its new source go.
+    EvLoop::SourceRef ref = first->source();
+    ref = second->source();
+    ref.AddDestroyHandler([&second_destroyed]() { second_destroyed = true; });
+    ref = first->source();
+    ref.AddDestroyHandler([&first_destroyed]() { first_destroyed = true; });
+  }
+
+  second->Disable();
+  second.reset();
+  RunUntilIdle(&*ev);
+
+  ZYPAK_ASSERT(second_destroyed);
+  ZYPAK_ASSERT(!first_destroyed);
+
+  first->Disable();
+  first.reset();
+  RunUntilIdle(&*ev);
+
+  ZYPAK_ASSERT(first_destroyed);
+}
+
+// Tasks, triggers, and the sources behind them are all reused, so a loop that's past its first few
+// iterations shouldn't allocate at all.
+void TestSteadyStateAllocations() {
+  std::optional<EvLoop> ev = EvLoop::Create();
+  ZYPAK_ASSERT(ev);
+
+  int triggered = 0;
+  auto trigger = ev->AddTrigger([&triggered](EvLoop::SourceRef source) { triggered++; });
+  ZYPAK_ASSERT(trigger);
+
+  int ran = 0;
+  // About as big as the lambdas the bus thread posts.
+  struct {
+    void* call[4];
+  } captured{};
+
+  auto round = [&]() {
+    for (int i = 0; i < kTasksPerRound; i++) {
+      ZYPAK_ASSERT(ev->AddTask([&ran, captured]() { ran++; }));
+    }
+
+    trigger->Trigger();
+    RunUntilIdle(&*ev);
+  };
+
+  for (int i = 0; i < kWarmupRounds; i++) {
+    round();
+  }
+
+  allocations = 0;
+  counting = true;
+  for (int i = 0; i < kCountedRounds; i++) {
+    round();
+  }
+  counting = false;
+
+  ZYPAK_ASSERT(ran == (kWarmupRounds + kCountedRounds) * kTasksPerRound);
+  ZYPAK_ASSERT(triggered == kWarmupRounds + kCountedRounds);
+  ZYPAK_ASSERT(allocations == 0, << allocations << " allocations over " << kCountedRounds
+                                 << " rounds");
+}
+
+// Runs in the traced process. The loop thread calls getppid right before and after the wakeups, so
+// its syscalls in between can be picked out of the trace.
+int RunSyscallWorkload() {
+  std::unique_ptr<EvLoopThread> thread = EvLoopThread::Create("zypak-traced");
+  ZYPAK_ASSERT(thread);
+  thread->Start();
+
+  EvLoop* ev = thread->evloop()->unsafe();
+  std::atomic<int> ran = 0;
+
+  auto post_and_wait = [&](EvLoop::TaskHandler handler) {
+    int target = ran.load() + 1;
+    ZYPAK_ASSERT(ev->AddTask([&ran, handler = std::move(handler)]() mutable {
+      handler();
+      ran++;
+    }));
+
+    while (ran.load() < target) {
+      std::this_thread::yield();
+    }
+  };
+
+  post_and_wait([]() { getppid(); });
+
+  for (int i = 0; i < kTracedWakeups; i++) {
+    std::this_thread::sleep_for(kTracedWakeupGap);
+    post_and_wait([]() {});
+  }
+
+  post_and_wait([]() { getppid(); });
+
+  thread->Shutdown();
+  return 0;
+}
+
+// Re-runs this binary under strace (the same way the helper does for ZYPAK_STRACE=host), counting
+// the syscalls the loop thread makes per wakeup from another thread. Any ZYPAK_STRACE_FILTER is
+// ignored, since the count needs to see every syscall.
+void TestWakeupSyscalls(const char* self) {
+  if (!Strace::ShouldTraceHost()) {
+    Log() << "Skipping the syscall count, run with ZYPAK_STRACE=host to check it";
+    return;
+  }
+
+  char log_path[] = "/tmp/zypak-evloop-strace-XXXXXX";
+  unique_fd log_fd(mkstemp(log_path));
+  ZYPAK_ASSERT(!log_fd.invalid());
+
+  pid_t pid = fork();
+  ZYPAK_ASSERT(pid != -1);
+  if (pid == 0) {
+    std::vector<const char*> argv{"strace",
+                                  "-f",
+                                  "-qq",
+                                  "-o",
+                                  log_path,
+                                  self,
+                                  kSyscallWorkloadFlag.data(),
+                                  nullptr};
+    execvp(argv[0], const_cast<char* const*>(argv.data()));
+    Errno() << "Failed to run strace";
+    _exit(1);
+  }
+
+  int status;
+  ZYPAK_ASSERT(waitpid(pid, &status, 0) == pid);
+  ZYPAK_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, << "status: " << status);
+
+  // Lines are "<tid> <syscall>(<args>) = <result>", along with some others for signals, exits, and
+  // calls that were interrupted and resumed, which are skipped over.
+  std::ifstream log(log_path);
+  std::string line;
+  pid_t loop_tid = 0;
+  bool done = false;
+  int total = 0;
+  std::map<std::string, int> counts;
+
+  while (!done && std::getline(log, line)) {
+    size_t name_start = line.find(' ');
+    size_t name_end = line.find('(');
+    if (name_start == std::string::npos || name_end == std::string::npos ||
+        name_end < name_start || line[name_start + 1] == '<') {
+      continue;
+    }
+
+    pid_t tid = std::stoi(line.substr(0, name_start));
+    std::string name = line.substr(name_start + 1, name_end - name_start - 1);
+
+    if (name == "getppid") {
+      if (loop_tid == 0) {
+        loop_tid = tid;
+      } else if (tid == loop_tid) {
+        done = true;
+      }
+    } else if (loop_tid != 0 && tid == loop_tid) {
+      total++;
+      counts[name]++;
+    }
+  }
+
+  unlink(log_path);
+  ZYPAK_ASSERT(done, << "Could not find the loop thread's syscalls in the trace");
+
+  double per_wakeup = static_cast<double>(total) / kTracedWakeups;
+  Log() << "Syscalls per wakeup: " << per_wakeup;
+  for (const auto& [name, count] : counts) {
+    Log() << "  " << name << ": " << count;
+  }
+
+  ZYPAK_ASSERT(per_wakeup <= kMaxSyscallsPerWakeup);
+}
+
+}  // namespace
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+extern "C" void* malloc(size_t size) {
+  allocations += counting;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  allocations += counting;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+  allocations += counting;
+  return __libc_realloc(ptr, size);
+}
+
+int main(int argc, char** argv) {
+  DebugContext::instance()->set_name("evloop_unittest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  if (argc == 2 && argv[1] == kSyscallWorkloadFlag) {
+    return RunSyscallWorkload();
+  }
+
+  TestSourceRefAssignment();
+  TestSteadyStateAllocations();
+  TestWakeupSyscalls(argv[0]);
+
+  Log() << "All tests passed";
+  return 0;
+}
@@ -0,0 +1,205 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/evloop_watchdog.h"
+
+#include <execinfo.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+#include <systemd/sd-event.h>
+
+#include "base/debug.h"
+#include "base/env.h"
+
+namespace zypak {
+
+namespace {
+
+constexpr int kMaxBacktraceFrames = 64;
+
+// The tracking state of the loop being reported by the watchdog, read by the signal handler.
+std::atomic<EvLoop::DispatchTracking*> stalled_tracking = nullptr;
+
+int GetStallSignal() {
+  // SIGRTMIN isn't a constant, so this can't be either. The offset is arbitrary, it just needs to
+  // be a realtime signal that Chromium doesn't use.
+  return SIGRTMIN + 4;
+}
+
+std::uint64_t GetMonotonicNs() {
+  struct timespec now;
+  ZYPAK_ASSERT_WITH_ERRNO(clock_gettime(CLOCK_MONOTONIC, &now) != -1);
+  return now.tv_sec * 1'000'000'000ull + now.tv_nsec;
+}
+
+// Only async-signal-safe functions can be used below, so this can't go through Log().
+void WriteToStderr(std::string_view message) {
+  while (!message.empty()) {
+    ssize_t written = write(STDERR_FILENO, message.data(), message.size());
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return;
+    }
+
+    message.remove_prefix(written);
+  }
+}
+
+void HandleStallSignal(int signal) {
+  int saved_errno = errno;
+
+  std::array<char, 16> pid_buffer;
+  auto [pid_end, ec] = std::to_chars(pid_buffer.begin(), pid_buffer.end(), getpid());
+  ZYPAK_ASSERT(ec == std::errc());
+
+  const char* description = "<none>";
+  if (EvLoop::DispatchTracking* tracking = stalled_tracking.load(std::memory_order_acquire)) {
+    // The signal was sent to the loop's thread, so the source can't be freed under us.
+    if (sd_event_source* source = tracking->source.load(std::memory_order_relaxed)) {
+      if (sd_event_source_get_description(source, &description) < 0 || description == nullptr) {
+        description = "<unnamed>";
+      }
+    }
+  }
+
+  WriteToStderr("[");
+  WriteToStderr(std::string_view(pid_buffer.data(), pid_end - pid_buffer.data()));
+  WriteToStderr("] Stalled while dispatching source: ");
+  WriteToStderr(description);
+  WriteToStderr("\n");
+
+  std::array<void*, kMaxBacktraceFrames> frames;
+  int frame_count = backtrace(frames.data(), frames.size());
+  backtrace_symbols_fd(frames.data(), frame_count, STDERR_FILENO);
+
+  errno = saved_errno;
+}
+
+void InstallStallSignalHandler() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    // backtrace() may allocate the first time it's called (when loading libgcc), which isn't safe
+    // in a signal handler, so get that out of the way now.
+    std::array<void*, 1> frames;
+    backtrace(frames.data(), frames.size());
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &HandleStallSignal;
+    // Restart any syscalls the stalled thread is in the middle of, so that it behaves exactly the
+    // same as it would have without the watchdog.
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(GetStallSignal(), &action, nullptr) == -1) {
+      Errno() << "Failed to install stall signal handler";
+    }
+  });
+}
+
+}  // namespace
+
+EvLoopWatchdog::EvLoopWatchdog(EvLoop::DispatchTracking* tracking,
+                               std::chrono::milliseconds budget)
+    : tracking_(tracking), budget_(budget) {}
+
+EvLoopWatchdog::~EvLoopWatchdog() { Stop(); }
+
+// static
+std::optional<std::chrono::milliseconds> EvLoopWatchdog::GetBudgetFromEnvironment() {
+  std::optional<cstring_view> value = Env::Get(Env::kZypakSettingWatchdogMs);
+  if (!value || value->empty()) {
+    return {};
+  }
+
+  int ms = 0;
+  auto [end, ec] = std::from_chars(value->data(), value->data() + value->size(), ms);
+  if (ec != std::errc() || end != value->data() + value->size() || ms <= 0) {
+    Log() << "Invalid value for " << Env::kZypakSettingWatchdogMs << ": " << *value;
+    return {};
+  }
+
+  return std::chrono::milliseconds(ms);
+}
+
+void EvLoopWatchdog::Start() {
+  if (thread_.joinable()) {
+    return;
+  }
+
+  InstallStallSignalHandler();
+  stalled_tracking.store(tracking_, std::memory_order_release);
+
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = false;
+  }
+
+  thread_ = std::thread(std::bind(&EvLoopWatchdog::ThreadMain, this));
+}
+
+void EvLoopWatchdog::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stop_ = true;
+  }
+
+  stop_cv_.notify_one();
+  thread_.join();
+  thread_ = std::thread();
+}
+
+void EvLoopWatchdog::ThreadMain() {
+  // Check twice per budget, so a stall is caught at most 1.5x the budget after it began.
+  auto interval = std::max(budget_ / 2, std::chrono::milliseconds(1));
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_cv_.wait_for(lock, interval, [this]() { return stop_; })) {
+    CheckForStall();
+  }
+}
+
+void EvLoopWatchdog::CheckForStall() {
+  std::uint64_t iteration = tracking_->iteration.load(std::memory_order_acquire);
+  std::uint64_t started_ns = tracking_->started_ns.load(std::memory_order_acquire);
+  if (started_ns == 0 || iteration == reported_iteration_) {
+    return;
+  }
+
+  std::uint64_t now_ns = GetMonotonicNs();
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::nanoseconds(now_ns - started_ns));
+  if (elapsed < budget_) {
+    return;
+  }
+
+  reported_iteration_ = iteration;
+
+  Log() << "Event loop iteration " << iteration << " has been dispatching for " << elapsed.count()
+        << "ms (budget is " << budget_.count() << "ms)";
+
+  pid_t tid = tracking_->tid.load(std::memory_order_relaxed);
+  if (tgkill(getpid(), tid, GetStallSignal()) == -1) {
+    Errno() << "Failed to signal stalled thread " << tid;
+  }
+}
+
+}  // namespace zypak
@@ -0,0 +1,51 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "base/base.h"
+#include "base/evloop.h"
+
+namespace zypak {
+
+// A thread that watches an event loop's dispatches, reporting any that run for longer than the
+// given budget. When a stall is found, the loop's thread is interrupted with a signal, so it can log
+// the description of the source being dispatched, along with a backtrace.
+class EvLoopWatchdog {
+ public:
+  EvLoopWatchdog(EvLoop::DispatchTracking* tracking, std::chrono::milliseconds budget);
+  EvLoopWatchdog(const EvLoopWatchdog& other) = delete;
+  EvLoopWatchdog(EvLoopWatchdog&& other) = delete;
+  ~EvLoopWatchdog();
+
+  // Returns the budget set via the environment, or an empty optional if the watchdog is disabled.
+  static std::optional<std::chrono::milliseconds> GetBudgetFromEnvironment();
+
+  void Start();
+  void Stop();
+
+ private:
+  void ThreadMain();
+  void CheckForStall();
+
+  EvLoop::DispatchTracking* tracking_;
+  std::chrono::milliseconds budget_;
+
+  // The last iteration that was reported, to avoid reporting the same stall repeatedly.
+  std::uint64_t reported_iteration_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable stop_cv_;
+  bool stop_ = false;
+
+  std::thread thread_;
+};
+
+}  // namespace zypak
@@ -0,0 +1,159 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/evloop_watchdog.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "base/cstring_view.h"
+#include "base/debug.h"
+#include "base/evloop.h"
+#include "base/unique_fd.h"
+
+using namespace zypak;
+
+namespace {
+
+constexpr auto kBudget = std::chrono::milliseconds(50);
+// Long enough for the watchdog to check on it several times, which must still only be reported
+// once.
+constexpr auto kStall = std::chrono::milliseconds(400);
+constexpr int kQuickTasks = 100;
+
+constexpr cstring_view kStallDescription = "injected-stall";
+
+// Sends stderr, where both the watchdog's log and its signal handler write to, into a file for as
+// long as it's alive.
+class CapturedStderr {
+ public:
+  CapturedStderr() {
+    char path[] = "/tmp/zypak-watchdog-stderr-XXXXXX";
+    unique_fd fd(mkstemp(path));
+    ZYPAK_ASSERT(!fd.invalid());
+    path_ = path;
+
+    saved_stderr_ = unique_fd(dup(STDERR_FILENO));
+    ZYPAK_ASSERT(!saved_stderr_.invalid());
+    ZYPAK_ASSERT(dup2(fd.get(), STDERR_FILENO) != -1);
+  }
+
+  ~CapturedStderr() {
+    Restore();
+    unlink(path_.c_str());
+  }
+
+  void Restore() {
+    if (!saved_stderr_.invalid()) {
+      ZYPAK_ASSERT(dup2(saved_stderr_.get(), STDERR_FILENO) != -1);
+      saved_stderr_.reset();
+    }
+  }
+
+  std::string Read() const {
+    std::ifstream file(path_);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+
+ private:
+  std::string path_;
+  unique_fd saved_stderr_;
+};
+
+size_t CountOccurrences(std::string_view haystack, std::string_view needle) {
+  size_t count = 0;
+  for (size_t pos = haystack.find(needle); pos != std::string_view::npos;
+       pos = haystack.find(needle, pos + needle.size())) {
+    count++;
+  }
+
+  return count;
+}
+
+void TestInjectedStall() {
+  std::optional<EvLoop> ev = EvLoop::Create();
+  ZYPAK_ASSERT(ev);
+  EvLoopWatchdog watchdog(ev->EnableDispatchTracking(), kBudget);
+
+  auto stall =
+      ev->AddTrigger([](EvLoop::SourceRef source) { std::this_thread::sleep_for(kStall); });
+  ZYPAK_ASSERT(stall);
+  stall->source().SetDescription(kStallDescription);
+
+  std::atomic<bool> done = false;
+  auto finish = ev->AddTrigger([&done](EvLoop::SourceRef source) { done = true; });
+  ZYPAK_ASSERT(finish);
+
+  CapturedStderr captured;
+  watchdog.Start();
+
+  std::thread loop_thread([&]() {
+    while (!done) {
+      ZYPAK_ASSERT(ev->Wait() == EvLoop::WaitResult::kReady);
+      ZYPAK_ASSERT(ev->Dispatch() == EvLoop::DispatchResult::kContinue);
+    }
+  });
+
+  // Dispatches that stay within the budget shouldn't be reported, no matter how many there are.
+  std::atomic<int> ran = 0;
+  for (int i = 0; i < kQuickTasks; i++) {
+    ZYPAK_ASSERT(ev->AddTask([&ran]() { ran++; }));
+  }
+
+  while (ran < kQuickTasks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  std::this_thread::sleep_for(kBudget * 2);
+  std::string before_stall = captured.Read();
+
+  stall->Trigger();
+  // Wait out the stall and a couple more of the watchdog's checks.
+  std::this_thread::sleep_for(kStall + kBudget * 2);
+  finish->Trigger();
+
+  loop_thread.join();
+  watchdog.Stop();
+
+  captured.Restore();
+  std::string output = captured.Read();
+
+  ZYPAK_ASSERT(before_stall.empty(), << "Reported without a stall: " << before_stall);
+
+  std::string expected_source =
+      "Stalled while dispatching source: " + std::string(kStallDescription) + "\n";
+  ZYPAK_ASSERT(CountOccurrences(output, expected_source) == 1, << "Output: " << output);
+  ZYPAK_ASSERT(CountOccurrences(output, "has been dispatching for ") == 1, << "Output: " << output);
+
+  // Checks happen twice per budget, so the stall should be caught well before it ends.
+  constexpr std::string_view kElapsedPrefix = "has been dispatching for ";
+  size_t elapsed_pos = output.find(kElapsedPrefix) + kElapsedPrefix.size();
+  int elapsed_ms = std::atoi(output.c_str() + elapsed_pos);
+  ZYPAK_ASSERT(elapsed_ms >= kBudget.count() && elapsed_ms < kStall.count(),
+               << "Caught after " << elapsed_ms << "ms");
+
+  Log() << "Stall of " << kStall.count() << "ms caught after " << elapsed_ms << "ms (budget is "
+        << kBudget.count() << "ms)";
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("evloop_watchdog_unittest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  TestInjectedStall();
+
+  Log() << "All tests passed";
+  return 0;
+}
@@ -8,30 +8,50 @@
 // Acquiring a guarded value's content involves the construction of a guard, whose
 // lifetime determines when the mutex is release (i.e. the mutex is release on guard
 // destructor).
+// Every acquisition takes the caller's source location, so that lock contention can be attributed
+// to the code responsible when stats are enabled (see LockStats).
 
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
+#include <shared_mutex>
+#include <source_location>
+#include <type_traits>
+#include <unordered_map>
 
 #include "base/base.h"
+#include "base/lock_stats.h"
 
 namespace zypak {
 
 // The listeners who should be notified when a guard is release.
 enum class GuardReleaseNotify { kNone, kOne, kAll };
 
+template <typename T, typename Key>
+class KeyedNotifyingGuardedValue;
+
 namespace guarded_value_internal {
 
 template <typename T, typename Mutex>
 class NonNotifyingGuardedValue;
 
-template <typename T, typename Mutex>
+template <typename T>
+class BasicSharedGuardedValue;
+
+template <typename T, typename Mutex, typename Lock = std::unique_lock<Mutex>>
 struct BasicGuard {
  public:
   BasicGuard(const BasicGuard& other) = delete;
   BasicGuard(BasicGuard&& other) = delete;
 
+  ~BasicGuard() {
+    if (guard_.owns_lock()) {
+      Unlock();
+    }
+  }
+
   // Various accessors for the underlying value.
 
   const T& operator*() const { return *value_; }
@@ -43,11 +63,23 @@ struct BasicGuard {
 
  protected:
   friend class NonNotifyingGuardedValue<T, Mutex>;
+  friend class BasicSharedGuardedValue<std::remove_const_t<T>>;
+  template <typename, typename>
+  friend class ::zypak::KeyedNotifyingGuardedValue;
+
+  BasicGuard(Mutex* mutex, T* value, const std::source_location& location)
+      : guard_(*mutex, std::defer_lock), value_(value), timer_(location) {
+    timer_.Lock(&guard_);
+  }
 
-  BasicGuard(Mutex* mutex, T* value) : guard_(*mutex), value_(value) {}
+  void Unlock() {
+    guard_.unlock();
+    timer_.Unlocked();
+  }
 
-  std::unique_lock<Mutex> guard_;
+  Lock guard_;
   T* value_;
+  LockTimer timer_;
 };
 
 template <typename T, typename Mutex>
@@ -74,7 +106,24 @@ class NonNotifyingGuardedValue : public BasicGuardedValue<T, Mutex> {
   using BasicGuardedValue<T, Mutex>::BasicGuardedValue;
 
   // Acquires the given value, holding the mutex until the guard's destruction.
-  BasicGuard<T, Mutex> Acquire() { return BasicGuard(&this->mutex_, &this->value_); }
+  BasicGuard<T, Mutex> Acquire(std::source_location location = std::source_location::current()) {
+    return BasicGuard<T, Mutex>(&this->mutex_, &this->value_, location);
+  }
+};
+
+template <typename T>
+class BasicSharedGuardedValue : public NonNotifyingGuardedValue<T, std::shared_mutex> {
+ public:
+  using NonNotifyingGuardedValue<T, std::shared_mutex>::NonNotifyingGuardedValue;
+
+  // Acquires the given value for reading only, holding a shared lock on the mutex until the
+  // guard's destruction. Any number of shared guards can be held at once, but never alongside
+  // a guard from Acquire.
+  BasicGuard<const T, std::shared_mutex, std::shared_lock<std::shared_mutex>>
+  AcquireShared(std::source_location location = std::source_location::current()) {
+    return BasicGuard<const T, std::shared_mutex, std::shared_lock<std::shared_mutex>>(
+        &this->mutex_, &this->value_, location);
+  }
 };
 
 }  // namespace guarded_value_internal
@@ -90,7 +139,7 @@ class NotifyingGuard : public guarded_value_internal::BasicGuard<T, std::mutex>
   NotifyingGuard(NotifyingGuard&& other) = delete;
 
   ~NotifyingGuard() {
-    this->guard_.unlock();
+    this->Unlock();
 
     switch (release_notify_) {
     case GuardReleaseNotify::kNone:
@@ -113,15 +162,17 @@ class NotifyingGuard : public guarded_value_internal::BasicGuard<T, std::mutex>
   friend class NotifyingGuardedValue<T>;
 
   NotifyingGuard(std::mutex* mutex, T* value, std::condition_variable* condition,
-                 GuardReleaseNotify notify)
-      : guarded_value_internal::BasicGuard<T, std::mutex>(mutex, value), condition_(condition),
-        release_notify_(notify) {}
+                 GuardReleaseNotify notify, const std::source_location& location)
+      : guarded_value_internal::BasicGuard<T, std::mutex>(mutex, value, location),
+        condition_(condition), release_notify_(notify) {}
 
   template <typename Pred>
   NotifyingGuard(std::mutex* mutex, T* value, std::condition_variable* condition,
-                 GuardReleaseNotify notify, Pred pred)
-      : NotifyingGuard(mutex, value, condition, notify) {
+                 GuardReleaseNotify notify, const std::source_location& location, Pred pred)
+      : NotifyingGuard(mutex, value, condition, notify, location) {
     condition_->wait(this->guard_, [&]() { return pred(value); });
+    // Time spent waiting on the condition isn't time spent holding the lock.
+    this->timer_.Reacquired();
   }
 
   std::condition_variable* condition_;
@@ -136,8 +187,9 @@ class NotifyingGuardedValue : public guarded_value_internal::BasicGuardedValue<T
   using guarded_value_internal::BasicGuardedValue<T, std::mutex>::BasicGuardedValue;
 
   // Acquires the guarded value; upon description, the guard will notify the given listeners.
-  NotifyingGuard<T> Acquire(GuardReleaseNotify notify) {
-    return NotifyingGuard(&this->mutex_, &this->value_, &condition_, notify);
+  NotifyingGuard<T> Acquire(GuardReleaseNotify notify,
+                            std::source_location location = std::source_location::current()) {
+    return NotifyingGuard(&this->mutex_, &this->value_, &condition_, notify, location);
   }
 
   // Acquires the guarded value when the given predicate returns true; upon description, the guard
@@ -145,9 +197,9 @@ class NotifyingGuardedValue : public guarded_value_internal::BasicGuardedValue<T
   // is set out, i.e. either NotifyOne/All is called, or a guard acquired with a notify value
   // is destroyed.
   template <typename Pred>
-  NotifyingGuard<T> AcquireWhen(Pred&& pred,
-                                GuardReleaseNotify notify = GuardReleaseNotify::kNone) {
-    return NotifyingGuard(&this->mutex_, &this->value_, &condition_, notify,
+  NotifyingGuard<T> AcquireWhen(Pred&& pred, GuardReleaseNotify notify = GuardReleaseNotify::kNone,
+                                std::source_location location = std::source_location::current()) {
+    return NotifyingGuard(&this->mutex_, &this->value_, &condition_, notify, location,
                           std::forward<Pred>(pred));
   }
 
@@ -155,6 +207,160 @@ class NotifyingGuardedValue : public guarded_value_internal::BasicGuardedValue<T
   std::condition_variable condition_;
 };
 
+// A guard that can wake up the listeners waiting on a particular key. Listeners are woken right
+// away, while the mutex is still held (they'll resume once the guard is destroyed), since a
+// listener is free to stop waiting and go away as soon as the mutex is released.
+template <typename T, typename Key>
+class KeyedNotifyingGuard : public guarded_value_internal::BasicGuard<T, std::shared_mutex> {
+ public:
+  KeyedNotifyingGuard(const KeyedNotifyingGuard& other) = delete;
+  KeyedNotifyingGuard(KeyedNotifyingGuard&& other) = delete;
+
+  // Notifies the listeners waiting on the given key.
+  void Notify(const Key& key) {
+    auto [begin, end] = waiters_->equal_range(key);
+    for (auto it = begin; it != end; ++it) {
+      it->second->Wake();
+    }
+  }
+
+  // Notifies a single listener waiting on the given key, skipping any that were already notified
+  // but haven't checked their predicates again yet, so that several calls in a row wake as many
+  // different listeners. Returns false if there was nobody left to notify.
+  bool NotifyOne(const Key& key) {
+    auto [begin, end] = waiters_->equal_range(key);
+    for (auto it = begin; it != end; ++it) {
+      if (!it->second->notified) {
+        it->second->Wake();
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  // Notifies all listeners, regardless of their keys.
+  void NotifyAll() {
+    for (auto& [key, waiter] : *waiters_) {
+      waiter->Wake();
+    }
+  }
+
+ private:
+  friend class KeyedNotifyingGuardedValue<T, Key>;
+
+  struct Waiter {
+    void Wake() {
+      notified = true;
+      condition.notify_one();
+    }
+
+    std::condition_variable_any condition;
+    // Set once woken, until the listener goes back to waiting.
+    bool notified = false;
+  };
+
+  using Waiters = std::unordered_multimap<Key, Waiter*>;
+
+  KeyedNotifyingGuard(std::shared_mutex* mutex, T* value, Waiters* waiters,
+                      const std::source_location& location)
+      : guarded_value_internal::BasicGuard<T, std::shared_mutex>(mutex, value, location),
+        waiters_(waiters) {}
+
+  template <typename Pred>
+  KeyedNotifyingGuard(std::shared_mutex* mutex, T* value, Waiters* waiters,
+                      const std::source_location& location, const Key& key, Pred pred)
+      : KeyedNotifyingGuard(mutex, value, waiters, location) {
+    if (pred(value)) {
+      return;
+    }
+
+    Waiter waiter;
+    auto it = waiters_->emplace(key, &waiter);
+    do {
+      waiter.notified = false;
+      waiter.condition.wait(this->guard_);
+    } while (!pred(value));
+    waiters_->erase(it);
+    this->timer_.Reacquired();
+  }
+
+  template <typename Pred, typename Rep, typename Period>
+  KeyedNotifyingGuard(std::shared_mutex* mutex, T* value, Waiters* waiters,
+                      const std::source_location& location, const Key& key, Pred pred,
+                      std::chrono::duration<Rep, Period> timeout)
+      : KeyedNotifyingGuard(mutex, value, waiters, location) {
+    if (timeout <= timeout.zero() || pred(value)) {
+      return;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    Waiter waiter;
+    auto it = waiters_->emplace(key, &waiter);
+    do {
+      waiter.notified = false;
+      if (waiter.condition.wait_until(this->guard_, deadline) == std::cv_status::timeout) {
+        break;
+      }
+    } while (!pred(value));
+    waiters_->erase(it);
+    this->timer_.Reacquired();
+  }
+
+  Waiters* waiters_;
+};
+
+// Like NotifyingGuardedValue, but listeners wait on a key, and only the listeners of the key that
+// was notified wake up to check their predicates. This avoids waking up every listener on each
+// change when most of them are waiting on something unrelated.
+// The mutex is a shared one, so lookups that don't modify the value can run alongside each other
+// via AcquireShared, while waiting and notifying always need an exclusive guard.
+template <typename T, typename Key>
+class KeyedNotifyingGuardedValue
+    : public guarded_value_internal::BasicGuardedValue<T, std::shared_mutex> {
+ public:
+  using guarded_value_internal::BasicGuardedValue<T, std::shared_mutex>::BasicGuardedValue;
+
+  // Acquires the guarded value. Nobody is notified unless the guard's Notify methods are called.
+  KeyedNotifyingGuard<T, Key>
+  Acquire(std::source_location location = std::source_location::current()) {
+    return KeyedNotifyingGuard<T, Key>(&this->mutex_, &this->value_, &waiters_, location);
+  }
+
+  // Acquires the guarded value for reading only, like BasicSharedGuardedValue::AcquireShared.
+  guarded_value_internal::BasicGuard<const T, std::shared_mutex,
+                                     std::shared_lock<std::shared_mutex>>
+  AcquireShared(std::source_location location = std::source_location::current()) {
+    return guarded_value_internal::BasicGuard<const T, std::shared_mutex,
+                                              std::shared_lock<std::shared_mutex>>(
+        &this->mutex_, &this->value_, location);
+  }
+
+  // Acquires the guarded value when the given predicate returns true. The predicate is checked
+  // once up front, then again every time the key is notified.
+  template <typename Pred>
+  KeyedNotifyingGuard<T, Key>
+  AcquireWhen(const Key& key, Pred&& pred,
+              std::source_location location = std::source_location::current()) {
+    return KeyedNotifyingGuard<T, Key>(&this->mutex_, &this->value_, &waiters_, location, key,
+                                       std::forward<Pred>(pred));
+  }
+
+  // Like AcquireWhen, but stops waiting once the timeout passes, in which case the value is
+  // acquired regardless of the predicate, so the caller needs to check it again.
+  template <typename Pred, typename Rep, typename Period>
+  KeyedNotifyingGuard<T, Key>
+  AcquireWhenOrTimeout(const Key& key, Pred&& pred, std::chrono::duration<Rep, Period> timeout,
+                       std::source_location location = std::source_location::current()) {
+    return KeyedNotifyingGuard<T, Key>(&this->mutex_, &this->value_, &waiters_, location, key,
+                                       std::forward<Pred>(pred), timeout);
+  }
+
+ private:
+  // Guarded by the mutex.
+  typename KeyedNotifyingGuard<T, Key>::Waiters waiters_;
+};
+
 // A basic guard, wrapping a std::mutex. See BasicGuard for relevant documentation.
 template <typename T>
 using Guard = guarded_value_internal::BasicGuard<T, std::mutex>;
@@ -164,6 +370,17 @@ using Guard = guarded_value_internal::BasicGuard<T, std::mutex>;
 template <typename T>
 using GuardedValue = guarded_value_internal::NonNotifyingGuardedValue<T, std::mutex>;
 
+// A guard holding a shared lock, which only gives read-only access to the value. See BasicGuard for
+// relevant documentation.
+template <typename T>
+using SharedGuard = guarded_value_internal::BasicGuard<const T, std::shared_mutex,
+                                                       std::shared_lock<std::shared_mutex>>;
+
+// A guarded value wrapping a std::shared_mutex, for values that are read far more often than they
+// are modified. See BasicSharedGuardedValue for relevant documentation.
+template <typename T>
+using SharedGuardedValue = guarded_value_internal::BasicSharedGuardedValue<T>;
+
 // A guard for a value that can be acquired recursively, wrapping a std::recursive_Mutex.
 // See BasicGuard for relevant documentation.
 template <typename T>
@@ -0,0 +1,144 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how waking one waiter out of many scales with the # of waiters, the way the supervisor's
+// launcher threads each wait on their own stub: every waiter waits for its own key to change, and a
+// notifier changes one key at a time, waiting for that key's waiter to see it before moving on.
+// KeyedNotifyingGuardedValue, which only wakes the waiter on the changed key, is compared against
+// NotifyingGuardedValue with GuardReleaseNotify::kAll, which wakes every waiter to check its
+// predicate. Reports the events per second and how many predicate checks each event caused, which
+// is at least 2: the woken waiter checks once when woken, then again when it starts waiting for the
+// next change.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "base/debug.h"
+#include "base/guarded_value.h"
+
+using namespace zypak;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kWaiterCounts[] = {1, 8, 32, 128};
+// Split evenly between the waiters.
+constexpr int kEventsPerRun = 4096;
+
+struct Counters {
+  explicit Counters(int count) : values(count) {}
+
+  std::vector<std::uint64_t> values;
+};
+
+// Tells the notifier which round each waiter last saw, outside of the guarded value, so that the
+// notifier doesn't need the lock to find out.
+struct Acks {
+  explicit Acks(int count) : rounds(count) {}
+
+  std::vector<std::atomic<std::uint64_t>> rounds;
+};
+
+void Report(const char* name, int waiters, Clock::duration elapsed, std::uint64_t checks) {
+  int events = kEventsPerRun / waiters * waiters;
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  Log() << name << ", " << waiters << " waiter(s): " << events / seconds << " events/s, "
+        << static_cast<double>(checks) / events << " predicate checks per event";
+}
+
+template <typename WaitFunc, typename NotifyFunc>
+void Run(const char* name, int waiters, WaitFunc wait, NotifyFunc notify) {
+  int rounds = kEventsPerRun / waiters;
+  Acks acks(waiters);
+  std::atomic<std::uint64_t> checks = 0;
+
+  std::vector<std::thread> threads;
+  for (int key = 0; key < waiters; key++) {
+    threads.emplace_back([&, key]() {
+      for (std::uint64_t round = 1; round <= static_cast<std::uint64_t>(rounds); round++) {
+        wait(key, round, &checks);
+        acks.rounds[key].store(round, std::memory_order_release);
+      }
+    });
+  }
+
+  // Don't count the checks every waiter makes when it first starts waiting.
+  while (checks.load() < static_cast<std::uint64_t>(waiters)) {
+    std::this_thread::yield();
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  checks = 0;
+
+  Clock::time_point start = Clock::now();
+  for (std::uint64_t round = 1; round <= static_cast<std::uint64_t>(rounds); round++) {
+    for (int key = 0; key < waiters; key++) {
+      notify(key);
+      while (acks.rounds[key].load(std::memory_order_acquire) < round) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  Clock::duration elapsed = Clock::now() - start;
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  Report(name, waiters, elapsed, checks.load());
+}
+
+void MeasureKeyed(int waiters) {
+  KeyedNotifyingGuardedValue<Counters, int> counters{Counters(waiters)};
+
+  Run(
+      "Keyed", waiters,
+      [&counters](int key, std::uint64_t round, std::atomic<std::uint64_t>* checks) {
+        counters.AcquireWhen(key, [key, round, checks](Counters* counters) {
+          (*checks)++;
+          return counters->values[key] >= round;
+        });
+      },
+      [&counters](int key) {
+        auto guard = counters.Acquire();
+        guard->values[key]++;
+        guard.Notify(key);
+      });
+}
+
+void MeasureNotifyAll(int waiters) {
+  NotifyingGuardedValue<Counters> counters{Counters(waiters)};
+
+  Run(
+      "Notify all", waiters,
+      [&counters](int key, std::uint64_t round, std::atomic<std::uint64_t>* checks) {
+        counters.AcquireWhen([key, round, checks](Counters* counters) {
+          (*checks)++;
+          return counters->values[key] >= round;
+        });
+      },
+      [&counters](int key) {
+        auto guard = counters.Acquire(GuardReleaseNotify::kAll);
+        guard->values[key]++;
+      });
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("guarded_value_perftest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  for (int waiters : kWaiterCounts) {
+    MeasureKeyed(waiters);
+    MeasureNotifyAll(waiters);
+  }
+
+  return 0;
+}
@@ -58,11 +58,11 @@ std::vector<std::string> Launcher::Helper::BuildCommandWrapper(const FdMap& fd_m
   return wrapper;
 }
 
-bool Launcher::Run(std::vector<std::string> command, const FdMap& fd_map) {
+bool Launcher::Run(std::vector<cstring_view> command, const FdMap& fd_map) {
   // XXX: similar to HasTypeArg in the preload code
   std::string child_type;
   constexpr std::string_view kTypeArgPrefix = "--type=";
-  for (const std::string& arg : command) {
+  for (cstring_view arg : command) {
     if (arg.starts_with(kTypeArgPrefix)) {
       child_type = arg.substr(kTypeArgPrefix.size());
       break;
@@ -4,9 +4,12 @@
 
 #pragma once
 
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "base/base.h"
+#include "base/cstring_view.h"
 #include "base/enum_util.h"
 #include "base/fd_map.h"
 
@@ -40,19 +43,23 @@ class Launcher {
   // A delegate is responsible for actually executing the command, given various requirements for
   // its launch. It should use the helper argument to build a command line that will be prepended
   // the the command itself.
+  // The command and environment are only views, which stay valid as long as the strings given to
+  // Run do (the environment entries all point into the process environment or constants).
   class Delegate {
    public:
-    using EnvMap = std::unordered_map<std::string_view, std::string_view>;
+    using EnvMap = std::unordered_map<cstring_view, cstring_view>;
 
     virtual ~Delegate() {}
-    virtual bool Spawn(const Helper& helper, std::vector<std::string> command, const FdMap& fd_map,
-                       EnvMap env, std::vector<std::string> exposed_paths, Flags flags) = 0;
+    virtual bool Spawn(const Helper& helper, std::vector<cstring_view> command,
+                       const FdMap& fd_map, EnvMap env, std::vector<std::string> exposed_paths,
+                       Flags flags) = 0;
   };
 
   Launcher(Delegate* delegate) : delegate_(delegate) {}
 
-  // Runs the given command using the stored delegate.
-  bool Run(std::vector<std::string> command, const FdMap& fd_map);
+  // Runs the given command using the stored delegate. The command's strings aren't copied, so they
+  // must outlive anything the delegate builds from them.
+  bool Run(std::vector<cstring_view> command, const FdMap& fd_map);
 
  private:
   Delegate* delegate_;
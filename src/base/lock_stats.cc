@@ -0,0 +1,180 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/lock_stats.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <ostream>
+#include <string_view>
+#include <tuple>
+
+#include "base/debug.h"
+#include "base/singleton.h"
+
+namespace zypak {
+
+namespace {
+
+// A histogram of durations with power-of-two buckets: the first holds everything under 1us, and
+// each one after that holds durations up to twice as long as the previous one, with the last
+// holding anything longer.
+class DurationHistogram {
+ public:
+  void Add(LockStats::Clock::duration duration) {
+    std::uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    size_t bucket = std::min<size_t>(std::bit_width(us), kBuckets - 1);
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    std::uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    total_ns_.fetch_add(ns, std::memory_order_relaxed);
+
+    std::uint64_t max_ns = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max_ns && !max_ns_.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed)) {
+    }
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const DurationHistogram& histogram) {
+    os << histogram.total_ns_.load(std::memory_order_relaxed) / 1000 << "us total / "
+       << histogram.max_ns_.load(std::memory_order_relaxed) / 1000 << "us max [";
+
+    bool first = true;
+    for (size_t i = 0; i < kBuckets; i++) {
+      std::uint64_t count = histogram.buckets_[i].load(std::memory_order_relaxed);
+      if (count == 0) {
+        continue;
+      }
+
+      if (!first) {
+        os << ' ';
+      }
+
+      first = false;
+      if (i == kBuckets - 1) {
+        os << ">=" << (1ull << (i - 1)) << "us";
+      } else {
+        os << '<' << (1ull << i) << "us";
+      }
+
+      os << ':' << count;
+    }
+
+    return os << ']';
+  }
+
+ private:
+  static constexpr size_t kBuckets = 24;
+
+  std::array<std::atomic<std::uint64_t>, kBuckets> buckets_{};
+  std::atomic<std::uint64_t> total_ns_ = 0;
+  std::atomic<std::uint64_t> max_ns_ = 0;
+};
+
+}  // namespace
+
+class LockStats::Site {
+ public:
+  explicit Site(const std::source_location& location) : location_(location) {}
+
+  void RecordWait(Clock::duration wait) {
+    acquisitions_.fetch_add(1, std::memory_order_relaxed);
+    wait_.Add(wait);
+  }
+
+  void RecordHold(Clock::duration hold) { hold_.Add(hold); }
+
+  void Dump() const {
+    Log() << "  " << location_.file_name() << ':' << location_.line() << ':' << location_.column()
+          << " (" << location_.function_name()
+          << "): " << acquisitions_.load(std::memory_order_relaxed) << " acquisitions";
+    Log() << "    wait " << wait_;
+    Log() << "    hold " << hold_;
+  }
+
+ private:
+  std::source_location location_;
+  std::atomic<std::uint64_t> acquisitions_ = 0;
+  DurationHistogram wait_;
+  DurationHistogram hold_;
+};
+
+namespace {
+
+class SiteRegistry {
+ public:
+  LockStats::Site* Get(const std::source_location& location) {
+    Key key(location.file_name(), location.line(), location.column());
+
+    // Every site after its first acquisition only needs the shared lock.
+    {
+      std::shared_lock<std::shared_mutex> guard(mutex_);
+      if (auto it = sites_.find(key); it != sites_.end()) {
+        return it->second.get();
+      }
+    }
+
+    std::unique_lock<std::shared_mutex> guard(mutex_);
+    if (sites_.empty()) {
+      std::atexit(&LockStats::Dump);
+    }
+
+    auto it = sites_.find(key);
+    if (it == sites_.end()) {
+      it = sites_.emplace(key, std::make_unique<LockStats::Site>(location)).first;
+    }
+
+    return it->second.get();
+  }
+
+  void Dump() {
+    std::shared_lock<std::shared_mutex> guard(mutex_);
+    Log() << "Lock stats:";
+    for (const auto& [key, site] : sites_) {
+      site->Dump();
+    }
+  }
+
+  static SiteRegistry* instance() {
+    // Never destroyed, since guards may still be acquired by other static destructors.
+    static Singleton<SiteRegistry> registry;
+    return registry.get();
+  }
+
+ private:
+  using Key = std::tuple<std::string_view, std::uint_least32_t, std::uint_least32_t>;
+
+  std::shared_mutex mutex_;
+  std::map<Key, std::unique_ptr<LockStats::Site>> sites_;
+};
+
+}  // namespace
+
+// static
+LockStats::Site* LockStats::GetSite(const std::source_location& location) {
+  ZYPAK_ASSERT(enabled());
+  return SiteRegistry::instance()->Get(location);
+}
+
+// static
+void LockStats::RecordWait(Site* site, Clock::duration wait) { site->RecordWait(wait); }
+
+// static
+void LockStats::RecordHold(Site* site, Clock::duration hold) { site->RecordHold(hold); }
+
+// static
+void LockStats::Dump() {
+  if (enabled()) {
+    SiteRegistry::instance()->Dump();
+  }
+}
+
+}  // namespace zypak
@@ -0,0 +1,78 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <chrono>
+#include <source_location>
+
+#include "base/base.h"
+#include "base/env.h"
+
+namespace zypak {
+
+// Contention stats for guarded values, labelled by the call site that acquired them: how many times
+// each site acquired its guard, how long it waited for the lock, and how long it held it. Collection
+// is opt-in via ZYPAK_LOCK_STATS, and the stats are logged when the process exits.
+class LockStats {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  class Site;
+
+  static bool enabled() {
+    static const bool enabled = Env::Test(Env::kZypakSettingLockStats);
+    return enabled;
+  }
+
+  // Returns the stats for the given call site, creating them the first time it's seen. Must only
+  // be called if stats are enabled.
+  static Site* GetSite(const std::source_location& location);
+
+  static void RecordWait(Site* site, Clock::duration wait);
+  static void RecordHold(Site* site, Clock::duration hold);
+
+  // Logs the stats collected so far.
+  static void Dump();
+};
+
+// Times a single acquisition of a lock, reporting it to LockStats if enabled.
+class LockTimer {
+ public:
+  explicit LockTimer(const std::source_location& location)
+      : site_(LockStats::enabled() ? LockStats::GetSite(location) : nullptr) {}
+
+  template <typename Lockable>
+  void Lock(Lockable* lock) {
+    if (site_ == nullptr) {
+      lock->lock();
+      return;
+    }
+
+    LockStats::Clock::time_point start = LockStats::Clock::now();
+    lock->lock();
+    held_since_ = LockStats::Clock::now();
+    LockStats::RecordWait(site_, held_since_ - start);
+  }
+
+  // Restarts the hold time, for when the lock was released and re-acquired in the meantime (e.g.
+  // while waiting on a condition variable).
+  void Reacquired() {
+    if (site_ != nullptr) {
+      held_since_ = LockStats::Clock::now();
+    }
+  }
+
+  void Unlocked() {
+    if (site_ != nullptr) {
+      LockStats::RecordHold(site_, LockStats::Clock::now() - held_since_);
+    }
+  }
+
+ private:
+  LockStats::Site* site_;
+  LockStats::Clock::time_point held_since_;
+};
+
+}  // namespace zypak
@@ -0,0 +1,44 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/pidfd.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "base/debug.h"
+
+// Older libc headers may not have these yet.
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+namespace zypak {
+
+// static
+std::optional<unique_fd> Pidfd::Open(pid_t pid) {
+  int fd = syscall(SYS_pidfd_open, pid, 0);
+  if (fd == -1) {
+    Errno() << "Failed to open pidfd for " << pid;
+    return {};
+  }
+
+  return unique_fd(fd);
+}
+
+// static
+bool Pidfd::SendSignal(int pidfd, int signal) {
+  if (syscall(SYS_pidfd_send_signal, pidfd, signal, nullptr, 0) == -1) {
+    Errno() << "Failed to send signal " << signal << " via pidfd";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace zypak
@@ -0,0 +1,27 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <optional>
+
+#include "base/base.h"
+#include "base/unique_fd.h"
+
+namespace zypak {
+
+// A pidfd refers to one specific process, so unlike a raw pid, it can't end up pointing to an
+// unrelated process once the original one is reaped. It becomes readable once the process exits.
+class Pidfd {
+ public:
+  // Opens a pidfd for the given process, returning an empty optional on failure.
+  static std::optional<unique_fd> Open(pid_t pid);
+
+  // Sends the signal to the process the pidfd refers to.
+  static bool SendSignal(int pidfd, int signal);
+};
+
+}  // namespace zypak
@@ -0,0 +1,158 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/process_usage.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <string>
+#include <string_view>
+
+#include "base/cstring_view.h"
+#include "base/debug.h"
+
+namespace zypak {
+
+namespace {
+
+// The fields of /proc/<pid>/stat that are read, 1-indexed like in proc(5).
+constexpr int kStatFirstField = 3;  // The process state, right after the command name.
+constexpr int kStatMinFlt = 10;
+constexpr int kStatCMinFlt = 11;
+constexpr int kStatMajFlt = 12;
+constexpr int kStatCMajFlt = 13;
+constexpr int kStatUTime = 14;
+constexpr int kStatSTime = 15;
+constexpr int kStatCUTime = 16;
+constexpr int kStatCSTime = 17;
+
+constexpr std::string_view kStatusPeakRss = "\nVmHWM:";
+
+std::optional<std::string> ReadProcFile(int proc_dir, cstring_view name) {
+  unique_fd fd(HANDLE_EINTR(openat(proc_dir, name.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd.invalid()) {
+    // ESRCH just means the process has exited.
+    if (errno != ESRCH && errno != ENOENT) {
+      Errno() << "Failed to open " << name;
+    }
+
+    return {};
+  }
+
+  std::string contents;
+  std::array<char, 4096> buffer;
+  for (;;) {
+    ssize_t bytes_read = HANDLE_EINTR(read(fd.get(), buffer.data(), buffer.size()));
+    if (bytes_read == -1) {
+      if (errno != ESRCH) {
+        Errno() << "Failed to read " << name;
+      }
+
+      return {};
+    } else if (bytes_read == 0) {
+      break;
+    }
+
+    contents.append(buffer.data(), bytes_read);
+  }
+
+  return contents;
+}
+
+bool ParseNumber(std::string_view text, long* value) {
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), *value);
+  return ec == std::errc() && end == text.data() + text.size();
+}
+
+struct timeval TicksToTimeval(long ticks, long ticks_per_sec) {
+  struct timeval time;
+  time.tv_sec = ticks / ticks_per_sec;
+  time.tv_usec = (ticks % ticks_per_sec) * 1'000'000 / ticks_per_sec;
+  return time;
+}
+
+bool ParseStat(std::string_view stat, struct rusage* usage) {
+  // The command name may contain anything, including spaces and parentheses, so skip past its
+  // final closing parenthesis.
+  size_t comm_end = stat.rfind(')');
+  if (comm_end == std::string_view::npos) {
+    return false;
+  }
+
+  std::array<long, kStatCSTime + 1> fields{};
+  std::string_view rest = stat.substr(comm_end + 1);
+  for (int field = kStatFirstField; field <= kStatCSTime; field++) {
+    rest.remove_prefix(std::min(rest.find_first_not_of(' '), rest.size()));
+    size_t end = std::min(rest.find(' '), rest.size());
+    std::string_view text = rest.substr(0, end);
+    rest.remove_prefix(end);
+
+    // The state is a letter, the rest of the fields used here are all numbers.
+    if (text.empty() || (field != kStatFirstField && !ParseNumber(text, &fields[field]))) {
+      return false;
+    }
+  }
+
+  static const long ticks_per_sec = sysconf(_SC_CLK_TCK);
+
+  usage->ru_utime = TicksToTimeval(fields[kStatUTime] + fields[kStatCUTime], ticks_per_sec);
+  usage->ru_stime = TicksToTimeval(fields[kStatSTime] + fields[kStatCSTime], ticks_per_sec);
+  usage->ru_minflt = fields[kStatMinFlt] + fields[kStatCMinFlt];
+  usage->ru_majflt = fields[kStatMajFlt] + fields[kStatCMajFlt];
+  return true;
+}
+
+bool ParseStatus(std::string_view status, struct rusage* usage) {
+  size_t start = status.find(kStatusPeakRss);
+  if (start == std::string_view::npos) {
+    // Kernel threads and zombies don't have any memory stats.
+    return true;
+  }
+
+  std::string_view rest = status.substr(start + kStatusPeakRss.size());
+  rest.remove_prefix(std::min(rest.find_first_not_of(" \t"), rest.size()));
+  // Always given in kB, which is what ru_maxrss uses as well.
+  return ParseNumber(rest.substr(0, rest.find(' ')), &usage->ru_maxrss);
+}
+
+}  // namespace
+
+// static
+std::optional<unique_fd> ProcessUsage::OpenProcDir(pid_t pid) {
+  std::string path = "/proc/" + std::to_string(pid);
+  unique_fd fd(HANDLE_EINTR(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+  if (fd.invalid()) {
+    Errno() << "Failed to open " << path;
+    return {};
+  }
+
+  return fd;
+}
+
+// static
+std::optional<struct rusage> ProcessUsage::Read(int proc_dir) {
+  std::optional<std::string> stat = ReadProcFile(proc_dir, "stat");
+  if (!stat) {
+    return {};
+  }
+
+  std::optional<std::string> status = ReadProcFile(proc_dir, "status");
+  if (!status) {
+    return {};
+  }
+
+  struct rusage usage {};
+  if (!ParseStat(*stat, &usage) || !ParseStatus(*status, &usage)) {
+    Log() << "Failed to parse process stats";
+    return {};
+  }
+
+  return usage;
+}
+
+}  // namespace zypak
@@ -0,0 +1,30 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include <optional>
+
+#include "base/base.h"
+#include "base/unique_fd.h"
+
+namespace zypak {
+
+// Reads the resource usage of processes that can't be waited on directly, from their /proc
+// directories. Only the fields /proc has are filled in: the CPU times (including those of waited-on
+// children, as wait4 would), the page fault counts, and the peak resident set size.
+class ProcessUsage {
+ public:
+  // Opens the /proc directory of the given process. Unlike the pid, the directory keeps referring
+  // to the same process, and reading from it fails once the process is gone.
+  static std::optional<unique_fd> OpenProcDir(pid_t pid);
+
+  // Returns an empty optional if the process is gone, or its files could not be parsed.
+  static std::optional<struct rusage> Read(int proc_dir);
+};
+
+}  // namespace zypak
@@ -0,0 +1,145 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "base/debug.h"
+
+namespace zypak {
+
+template <typename Signature>
+class SmallFunction;
+
+// A move-only alternative to std::function. Callables that fit in kInlineSize bytes (which covers
+// the lambdas used throughout the event loop code) are stored inline, without allocating; anything
+// larger falls back to the heap.
+template <typename R, typename... Args>
+class SmallFunction<R(Args...)> {
+ public:
+  static constexpr std::size_t kInlineSize = 64;
+
+  SmallFunction() {}
+  SmallFunction(std::nullptr_t) {}
+
+  template <typename F, typename = std::enable_if_t<
+                            !std::is_same_v<std::decay_t<F>, SmallFunction> &&
+                            std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+  SmallFunction(F&& func) {
+    using Stored = std::decay_t<F>;
+
+    if constexpr (kStoredInline<Stored>) {
+      new (&storage_) Stored(std::forward<F>(func));
+      ops_ = &kInlineOps<Stored>;
+    } else {
+      new (&storage_) Stored*(new Stored(std::forward<F>(func)));
+      ops_ = &kHeapOps<Stored>;
+    }
+  }
+
+  SmallFunction(const SmallFunction& other) = delete;
+  SmallFunction(SmallFunction&& other) { *this = std::move(other); }
+
+  ~SmallFunction() { reset(); }
+
+  SmallFunction& operator=(SmallFunction&& other) {
+    if (this != &other) {
+      reset();
+
+      if (other.ops_ != nullptr) {
+        other.ops_->move_to(&other.storage_, &storage_);
+        ops_ = other.ops_;
+        other.ops_ = nullptr;
+      }
+    }
+
+    return *this;
+  }
+
+  SmallFunction& operator=(std::nullptr_t) {
+    reset();
+    return *this;
+  }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+
+  // Like std::function, the stored callable is invoked as non-const even though this is const.
+  R operator()(Args... args) const {
+    ZYPAK_ASSERT(ops_ != nullptr, << "Calling an empty SmallFunction");
+    return ops_->invoke(const_cast<Storage*>(&storage_), std::forward<Args>(args)...);
+  }
+
+ private:
+  using Storage = std::aligned_storage_t<kInlineSize, alignof(std::max_align_t)>;
+
+  struct Ops {
+    R (*invoke)(Storage* storage, Args&&... args);
+    // Move-constructs the callable into the destination, then destroys the source.
+    void (*move_to)(Storage* from, Storage* to);
+    void (*destroy)(Storage* storage);
+  };
+
+  template <typename F>
+  static constexpr bool kStoredInline = sizeof(F) <= kInlineSize &&
+                                        alignof(F) <= alignof(Storage) &&
+                                        std::is_nothrow_move_constructible_v<F>;
+
+  // Like std::function, discards the callable's return value if R is void.
+  template <typename F>
+  static R Invoke(F& func, Args&&... args) {
+    if constexpr (std::is_void_v<R>) {
+      func(std::forward<Args>(args)...);
+    } else {
+      return func(std::forward<Args>(args)...);
+    }
+  }
+
+  template <typename F>
+  static F* InlineGet(Storage* storage) {
+    return std::launder(reinterpret_cast<F*>(storage));
+  }
+
+  template <typename F>
+  static F*& HeapGet(Storage* storage) {
+    return *std::launder(reinterpret_cast<F**>(storage));
+  }
+
+  template <typename F>
+  static constexpr Ops kInlineOps = {
+      [](Storage* storage, Args&&... args) -> R {
+        return Invoke(*InlineGet<F>(storage), std::forward<Args>(args)...);
+      },
+      [](Storage* from, Storage* to) {
+        F* func = InlineGet<F>(from);
+        new (to) F(std::move(*func));
+        func->~F();
+      },
+      [](Storage* storage) { InlineGet<F>(storage)->~F(); },
+  };
+
+  template <typename F>
+  static constexpr Ops kHeapOps = {
+      [](Storage* storage, Args&&... args) -> R {
+        return Invoke(*HeapGet<F>(storage), std::forward<Args>(args)...);
+      },
+      [](Storage* from, Storage* to) { new (to) F*(HeapGet<F>(from)); },
+      [](Storage* storage) { delete HeapGet<F>(storage); },
+  };
+
+  void reset() {
+    if (ops_ != nullptr) {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+  Storage storage_;
+  const Ops* ops_ = nullptr;
+};
+
+}  // namespace zypak
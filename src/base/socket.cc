@@ -7,21 +7,30 @@
 
 #include <sys/socket.h>
 
+#include <algorithm>
+#include <array>
 #include <cstring>
 #include <memory>
 
 #include "base/debug.h"
 
+// Older libc headers may not have this yet.
+#ifndef SO_PEERPIDFD
+#define SO_PEERPIDFD 77
+#endif
+
 namespace {
 
+using zypak::Socket;
+
 class ControlBufferSpace {
  public:
   static constexpr size_t kUcredSize = CMSG_SPACE(sizeof(struct ucred));
 
-  ControlBufferSpace(int nfds, bool with_ucred)
+  constexpr ControlBufferSpace(int nfds, bool with_ucred)
       : fd_buffer_size_(nfds * sizeof(int)), with_ucred_(with_ucred) {}
 
-  size_t ctl_buffer_size() const {
+  constexpr size_t ctl_buffer_size() const {
     return CMSG_SPACE(fd_buffer_size_) + (with_ucred_ ? kUcredSize : 0);
   }
 
@@ -35,8 +44,73 @@ class ControlBufferSpace {
   bool with_ucred_;
 };
 
+// Big enough for the control data of any single message, so Read and Write don't need to allocate
+// their control buffers (unless a Write is going to fail anyway for sending too many FDs).
+constexpr size_t kMaxStackControlSize =
+    ControlBufferSpace(Socket::kMaxFdsPerMessage, /*with_ucred=*/true).ctl_buffer_size();
+
 size_t GetCMsgSize(struct cmsghdr* cmsg) { return cmsg->cmsg_len - CMSG_LEN(0); }
 
+// Pulls any FDs and credentials out of a received message's control data. Either output may be
+// null, in which case the corresponding data is ignored.
+void ReceiveControlMessages(struct msghdr* msg, std::vector<zypak::unique_fd>* fds, pid_t* pid) {
+  if (msg->msg_controllen == 0) {
+    return;
+  }
+
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET) {
+      if (cmsg->cmsg_type == SCM_RIGHTS) {
+        if (fds == nullptr) {
+          continue;
+        }
+
+        size_t nfds = GetCMsgSize(cmsg) / sizeof(int);
+        fds->reserve(fds->size() + nfds);
+        int* cmsg_fds = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+        for (size_t i = 0; i < nfds; i++) {
+          fds->emplace_back(cmsg_fds[i]);
+        }
+      } else if (cmsg->cmsg_type == SCM_CREDENTIALS) {
+        if (pid == nullptr) {
+          continue;
+        }
+
+        ZYPAK_ASSERT(GetCMsgSize(cmsg) == sizeof(struct ucred));
+        struct ucred* cred = reinterpret_cast<struct ucred*>(CMSG_DATA(cmsg));
+        ZYPAK_ASSERT(cred->pid != 0);
+        *pid = cred->pid;
+      }
+    }
+  }
+}
+
+// Returns the errno value describing why a received message is unusable, or 0 if it's fine.
+int CheckReceivedMessage(const struct msghdr& msg, const pid_t* pid) {
+  if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+    return EMSGSIZE;
+  }
+
+  if (pid != nullptr && *pid == -1) {
+    return ESRCH;
+  }
+
+  return 0;
+}
+
+// Fills in an SCM_RIGHTS control message at the start of the given buffer, which must be at least
+// space.ctl_buffer_size() bytes long.
+void FillRightsControlMessage(std::byte* buffer, const ControlBufferSpace& space,
+                              const std::vector<int>& fds) {
+  struct cmsghdr* cmsg = reinterpret_cast<struct cmsghdr*>(buffer);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = space.rights_cmsg_len();
+
+  int* it = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+  std::copy(fds.begin(), fds.end(), it);
+}
+
 }  // namespace
 
 namespace zypak {
@@ -52,14 +126,13 @@ ssize_t Socket::Read(int fd, std::byte* buffer, size_t size, ReadOptions options
   msg.msg_iov = &iov;
   msg.msg_iovlen = 1;
 
-  std::unique_ptr<std::byte[]> ctl_buffer;
+  alignas(struct cmsghdr) std::array<std::byte, kMaxStackControlSize> ctl_buffer;
   if (options.fds != nullptr || options.pid != nullptr) {
-    constexpr size_t kMaxFileDescriptors = 16;
-    ControlBufferSpace space(options.fds != nullptr ? kMaxFileDescriptors : 0,
+    ZYPAK_ASSERT(options.max_fds <= kMaxFdsPerMessage);
+    ControlBufferSpace space(options.fds != nullptr ? options.max_fds : 0,
                              /*with_ucred=*/options.pid != nullptr);
 
-    ctl_buffer = std::make_unique<std::byte[]>(space.ctl_buffer_size());
-    msg.msg_control = ctl_buffer.get();
+    msg.msg_control = ctl_buffer.data();
     msg.msg_controllen = space.ctl_buffer_size();
 
     if (options.pid != nullptr) {
@@ -67,47 +140,15 @@ ssize_t Socket::Read(int fd, std::byte* buffer, size_t size, ReadOptions options
     }
   }
 
-  ssize_t res = HANDLE_EINTR(recvmsg(fd, &msg, 0));
+  ssize_t res = HANDLE_EINTR(recvmsg(fd, &msg, options.nonblocking ? MSG_DONTWAIT : 0));
   if (res == -1) {
     return -1;
   }
 
-  if (msg.msg_controllen > 0 && ctl_buffer) {
-    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
-         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-      if (cmsg->cmsg_level == SOL_SOCKET) {
-        if (cmsg->cmsg_type == SCM_RIGHTS) {
-          if (options.fds == nullptr) {
-            continue;
-          }
-
-          size_t nfds = GetCMsgSize(cmsg) / sizeof(int);
-          options.fds->reserve(nfds);
-          int* cmsg_fds = reinterpret_cast<int*>(CMSG_DATA(cmsg));
-          for (size_t i = 0; i < nfds; i++) {
-            options.fds->emplace_back(cmsg_fds[i]);
-          }
-        } else if (cmsg->cmsg_type == SCM_CREDENTIALS) {
-          if (options.pid == nullptr) {
-            continue;
-          }
-
-          ZYPAK_ASSERT(GetCMsgSize(cmsg) == sizeof(struct ucred));
-          struct ucred* cred = reinterpret_cast<struct ucred*>(CMSG_DATA(cmsg));
-          ZYPAK_ASSERT(cred->pid != 0);
-          *options.pid = cred->pid;
-        }
-      }
-    }
-  }
+  ReceiveControlMessages(&msg, options.fds, options.pid);
 
-  if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
-    errno = EMSGSIZE;
-    return -1;
-  }
-
-  if (options.pid != nullptr && *options.pid == -1) {
-    errno = ESRCH;
+  if (int error = CheckReceivedMessage(msg, options.pid)) {
+    errno = error;
     return -1;
   }
 
@@ -119,8 +160,68 @@ ssize_t Socket::Read(int fd, std::vector<std::byte>* buffer, ReadOptions options
   return Read(fd, buffer->data(), buffer->size(), std::move(options));
 }
 
+Socket::ReadBatch::ReadBatch(size_t capacity, size_t message_size, Options options /*= {}*/)
+    : message_size_(message_size),
+      control_size_(options.max_fds > 0 || options.receive_pid
+                        ? ControlBufferSpace(options.max_fds, options.receive_pid).ctl_buffer_size()
+                        : 0),
+      options_(options), data_(capacity * message_size), control_(capacity * control_size_),
+      iovecs_(capacity), headers_(capacity), messages_(capacity) {
+  ZYPAK_ASSERT(capacity > 0);
+}
+
 // static
-bool Socket::Write(int fd, const std::byte* buffer, size_t size, WriteOptions options /*= {}*/) {
+ssize_t Socket::ReadMany(int fd, ReadBatch* batch, ReadManyOptions options /*= {}*/) {
+  ZYPAK_ASSERT(batch != nullptr);
+
+  size_t capacity = batch->capacity();
+  batch->received_ = 0;
+
+  // The kernel overwrites the lengths after each read, so the headers need to be reset every time.
+  for (size_t i = 0; i < capacity; i++) {
+    struct iovec& iov = batch->iovecs_[i];
+    iov.iov_base = batch->data_.data() + i * batch->message_size_;
+    iov.iov_len = batch->message_size_;
+
+    struct msghdr& msg = batch->headers_[i].msg_hdr;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (batch->control_size_ > 0) {
+      msg.msg_control = batch->control_.data() + i * batch->control_size_;
+      msg.msg_controllen = batch->control_size_;
+    }
+  }
+
+  int flags = options.nonblocking ? MSG_DONTWAIT : MSG_WAITFORONE;
+  int count = HANDLE_EINTR(recvmmsg(fd, batch->headers_.data(), capacity, flags, nullptr));
+  if (count == -1) {
+    return -1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    struct mmsghdr& header = batch->headers_[i];
+    ReadBatch::Message& message = batch->messages_[i];
+
+    message.data = static_cast<const std::byte*>(header.msg_hdr.msg_iov->iov_base);
+    message.size = header.msg_len;
+    message.fds.clear();
+    message.pid = -1;
+
+    std::vector<unique_fd>* fds = batch->options_.max_fds > 0 ? &message.fds : nullptr;
+    pid_t* pid = batch->options_.receive_pid ? &message.pid : nullptr;
+    ReceiveControlMessages(&header.msg_hdr, fds, pid);
+    message.error = CheckReceivedMessage(header.msg_hdr, pid);
+  }
+
+  batch->received_ = count;
+  return count;
+}
+
+// static
+ssize_t Socket::WritePartial(int fd, const std::byte* buffer, size_t size,
+                             WriteOptions options /*= {}*/) {
   ZYPAK_ASSERT(buffer != nullptr);
 
   struct msghdr msg;
@@ -130,26 +231,31 @@ bool Socket::Write(int fd, const std::byte* buffer, size_t size, WriteOptions op
   msg.msg_iov = &iov;
   msg.msg_iovlen = 1;
 
-  std::unique_ptr<std::byte[]> ctl_buffer;
+  alignas(struct cmsghdr) std::array<std::byte, kMaxStackControlSize> ctl_stack_buffer;
+  std::unique_ptr<std::byte[]> ctl_heap_buffer;
 
   if (options.fds != nullptr) {
-    ControlBufferSpace space(options.fds != nullptr ? options.fds->size() : 0,
-                             /*with_ucred=*/false);
+    ControlBufferSpace space(options.fds->size(), /*with_ucred=*/false);
 
-    ctl_buffer = std::make_unique<std::byte[]>(space.ctl_buffer_size());
-    msg.msg_control = ctl_buffer.get();
-    msg.msg_controllen = space.ctl_buffer_size();
+    std::byte* ctl_buffer = ctl_stack_buffer.data();
+    if (space.ctl_buffer_size() > ctl_stack_buffer.size()) {
+      ctl_heap_buffer = std::make_unique<std::byte[]>(space.ctl_buffer_size());
+      ctl_buffer = ctl_heap_buffer.get();
+    }
 
-    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
-    cmsg->cmsg_level = SOL_SOCKET;
-    cmsg->cmsg_type = SCM_RIGHTS;
-    cmsg->cmsg_len = space.rights_cmsg_len();
+    msg.msg_control = ctl_buffer;
+    msg.msg_controllen = space.ctl_buffer_size();
 
-    int* it = reinterpret_cast<int*>(CMSG_DATA(cmsg));
-    std::copy(options.fds->begin(), options.fds->end(), it);
+    FillRightsControlMessage(ctl_buffer, space, *options.fds);
   }
 
-  ssize_t sent = HANDLE_EINTR(sendmsg(fd, &msg, MSG_NOSIGNAL));
+  int flags = MSG_NOSIGNAL | (options.nonblocking ? MSG_DONTWAIT : 0);
+  return HANDLE_EINTR(sendmsg(fd, &msg, flags));
+}
+
+// static
+bool Socket::Write(int fd, const std::byte* buffer, size_t size, WriteOptions options /*= {}*/) {
+  ssize_t sent = WritePartial(fd, buffer, size, std::move(options));
   return sent != -1 ? static_cast<size_t>(sent) == size : false;
 }
 
@@ -165,6 +271,108 @@ bool Socket::Write(int fd, std::string_view buffer, WriteOptions options /*= {}*
                std::move(options));
 }
 
+void Socket::WriteBatch::Add(const std::byte* buffer, size_t size,
+                             WriteOptions options /*= {}*/) {
+  ZYPAK_ASSERT(buffer != nullptr);
+
+  Entry entry;
+  entry.iov = {const_cast<void*>(reinterpret_cast<const void*>(buffer)), size};
+  entry.control_offset = control_.size();
+  entry.control_size = 0;
+
+  if (options.fds != nullptr) {
+    ControlBufferSpace space(options.fds->size(), /*with_ucred=*/false);
+    entry.control_size = space.ctl_buffer_size();
+
+    // Every control message's size is a multiple of the cmsghdr alignment, so each one that's
+    // appended here stays aligned.
+    control_.resize(control_.size() + entry.control_size);
+    FillRightsControlMessage(control_.data() + entry.control_offset, space, *options.fds);
+  }
+
+  entries_.push_back(entry);
+}
+
+void Socket::WriteBatch::Clear() {
+  entries_.clear();
+  control_.clear();
+}
+
+// static
+bool Socket::WriteMany(int fd, WriteBatch* batch) {
+  ZYPAK_ASSERT(batch != nullptr);
+
+  size_t count = batch->entries_.size();
+  batch->headers_.resize(count);
+
+  // The control data may have been re-allocated as messages were added, so the pointers into it
+  // can only be filled in now.
+  for (size_t i = 0; i < count; i++) {
+    WriteBatch::Entry& entry = batch->entries_[i];
+
+    struct msghdr& msg = batch->headers_[i].msg_hdr;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &entry.iov;
+    msg.msg_iovlen = 1;
+
+    if (entry.control_size > 0) {
+      msg.msg_control = batch->control_.data() + entry.control_offset;
+      msg.msg_controllen = entry.control_size;
+    }
+  }
+
+  size_t sent = 0;
+  while (sent < count) {
+    int res =
+        HANDLE_EINTR(sendmmsg(fd, batch->headers_.data() + sent, count - sent, MSG_NOSIGNAL));
+    if (res == -1) {
+      return false;
+    }
+
+    for (int i = 0; i < res; i++) {
+      // Like Write, a partially sent message is a failure, since re-sending the rest would also
+      // send its FDs again.
+      if (batch->headers_[sent + i].msg_len != batch->entries_[sent + i].iov.iov_len) {
+        return false;
+      }
+    }
+
+    sent += res;
+  }
+
+  return true;
+}
+
+// static
+bool Socket::WriteFramed(int fd, const std::vector<std::byte>& payload,
+                         const std::vector<int>& fds) {
+  FrameHeader header{payload.size(), fds.size()};
+  if (!Write(fd, reinterpret_cast<const std::byte*>(&header), sizeof(header))) {
+    return false;
+  }
+
+  std::vector<int> chunk_fds;
+  for (size_t offset = 0; offset < fds.size(); offset += kMaxFdsPerMessage) {
+    size_t count = std::min(kMaxFdsPerMessage, fds.size() - offset);
+    chunk_fds.assign(fds.begin() + offset, fds.begin() + offset + count);
+
+    WriteOptions options;
+    options.fds = &chunk_fds;
+    if (!Write(fd, &kFrameFdChunkMarker, 1, options)) {
+      return false;
+    }
+  }
+
+  for (size_t offset = 0; offset < payload.size(); offset += kFrameChunkSize) {
+    size_t size = std::min(kFrameChunkSize, payload.size() - offset);
+    if (!Write(fd, payload.data() + offset, size)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
 // static
 bool Socket::EnableReceivePid(int fd) {
   int value = 1;
@@ -177,9 +385,24 @@ bool Socket::EnableReceivePid(int fd) {
 }
 
 // static
-std::optional<std::pair<unique_fd, unique_fd>> Socket::OpenSocketPair() {
+std::optional<unique_fd> Socket::GetPeerPidfd(int fd) {
+  int pidfd = -1;
+  socklen_t size = sizeof(pidfd);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERPIDFD, &pidfd, &size) == -1) {
+    if (errno != ENOPROTOOPT) {
+      Errno() << "Failed to get peer pidfd";
+    }
+
+    return {};
+  }
+
+  return unique_fd(pidfd);
+}
+
+// static
+std::optional<std::pair<unique_fd, unique_fd>> Socket::OpenSocketPair(int type /*= SOCK_STREAM*/) {
   std::array<int, 2> fds;
-  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data()) == -1) {
+  if (socketpair(AF_UNIX, type, 0, fds.data()) == -1) {
     Errno() << "Failed to open socket pair";
     return {};
   }
@@ -5,11 +5,16 @@
 
 #pragma once
 
+#include <sys/socket.h>
+#include <sys/uio.h>
+
 #include <array>
+#include <cstdint>
 #include <optional>
 #include <vector>
 
 #include "base/base.h"
+#include "base/debug.h"
 #include "base/unique_fd.h"
 
 namespace zypak {
@@ -18,11 +23,19 @@ namespace zypak {
 // 'fds' is always a vector of file descriptors being passed over a socket.
 class Socket {
  public:
+  // The kernel's limit on the # of FDs that can be sent in a single message (SCM_MAX_FD).
+  static constexpr size_t kMaxFdsPerMessage = 253;
+
   struct ReadOptions {
     ReadOptions() {}
 
     // If not null, any FDs received from the peer will be stored here.
     std::vector<unique_fd>* fds = nullptr;
+    // The max # of FDs that can be received, which cannot be above kMaxFdsPerMessage. If the peer
+    // sends more than this, the read will fail with EMSGSIZE.
+    size_t max_fds = 16;
+    // If true, fail with EAGAIN instead of blocking when there's nothing to read.
+    bool nonblocking = false;
     // If not null, the peer's PID will be stored here.
     pid_t* pid = nullptr;
   };
@@ -35,13 +48,86 @@ class Socket {
     return Read(fd, buffer->data(), N, std::move(options));
   }
 
+  // Reusable storage for reading a batch of messages with a single syscall. All the buffers are
+  // allocated up front, so reading into the same batch repeatedly never allocates (other than for
+  // storing any received FDs).
+  class ReadBatch {
+   public:
+    struct Options {
+      Options() {}
+
+      // The max # of FDs that may be received alongside each message.
+      size_t max_fds = 0;
+      // If true, the sender's PID will be received with each message. EnableReceivePid must have
+      // been called on the socket.
+      bool receive_pid = false;
+    };
+
+    struct Message {
+      // Points into the batch's storage, so this is only valid until the next read.
+      const std::byte* data = nullptr;
+      size_t size = 0;
+      std::vector<unique_fd> fds;
+      pid_t pid = -1;
+      // If non-zero, the errno value describing why this message was invalid (e.g. EMSGSIZE if it
+      // was truncated), in which case the other fields should be ignored.
+      int error = 0;
+    };
+
+    ReadBatch(size_t capacity, size_t message_size, Options options = {});
+    ReadBatch(const ReadBatch& other) = delete;
+    ReadBatch(ReadBatch&& other) = default;
+
+    size_t capacity() const { return messages_.size(); }
+
+    // The # of messages received by the last read.
+    size_t size() const { return received_; }
+    Message& message(size_t index) {
+      ZYPAK_ASSERT(index < received_);
+      return messages_[index];
+    }
+
+   private:
+    size_t message_size_;
+    size_t control_size_;
+    Options options_;
+
+    std::vector<std::byte> data_;
+    std::vector<std::byte> control_;
+    std::vector<struct iovec> iovecs_;
+    std::vector<struct mmsghdr> headers_;
+    std::vector<Message> messages_;
+    size_t received_ = 0;
+
+    friend class Socket;
+  };
+
+  struct ReadManyOptions {
+    ReadManyOptions() {}
+
+    // If true, fail with EAGAIN instead of blocking when no messages are available.
+    bool nonblocking = false;
+  };
+
+  // Waits for at least one message to be available (unless nonblocking), then reads as many as are
+  // immediately available, up to the batch's capacity. Returns the # of messages read, or -1 on
+  // error.
+  static ssize_t ReadMany(int fd, ReadBatch* batch, ReadManyOptions options = {});
+
   struct WriteOptions {
     WriteOptions() {}
 
     // A list of FDs to pass over the socket.
     const std::vector<int>* fds = nullptr;
+    // If true, fail with EAGAIN instead of blocking when the socket's buffer is full.
+    bool nonblocking = false;
   };
 
+  // Writes as much of the buffer as the socket will currently take, returning the # of bytes
+  // written, or -1 on error. Any FDs are sent along with the first byte.
+  static ssize_t WritePartial(int fd, const std::byte* buffer, size_t size,
+                              WriteOptions options = {});
+
   static bool Write(int fd, const std::byte* buffer, size_t length, WriteOptions options = {});
   static bool Write(int fd, const std::vector<std::byte>& buffer, WriteOptions options = {});
   static bool Write(int fd, std::string_view buffer, WriteOptions options = {});
@@ -51,11 +137,66 @@ class Socket {
     return Write(fd, buffer.data(), N, std::move(options));
   }
 
+  // A batch of messages to send with a single syscall. The batch can be cleared and reused, in
+  // which case its storage won't be re-allocated unless it needs to grow.
+  class WriteBatch {
+   public:
+    WriteBatch() {}
+    WriteBatch(const WriteBatch& other) = delete;
+    WriteBatch(WriteBatch&& other) = default;
+
+    // Adds a message to the batch. The buffer is not copied, so it must remain alive until the
+    // batch is written. The FDs, however, are copied immediately.
+    void Add(const std::byte* buffer, size_t size, WriteOptions options = {});
+    void Clear();
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+
+   private:
+    struct Entry {
+      struct iovec iov;
+      size_t control_offset;
+      size_t control_size;
+    };
+
+    std::vector<Entry> entries_;
+    std::vector<std::byte> control_;
+    std::vector<struct mmsghdr> headers_;
+
+    friend class Socket;
+  };
+
+  // Writes every message in the batch, returning true only if all were sent in full.
+  static bool WriteMany(int fd, WriteBatch* batch);
+
+  // Framed transfers carry a payload and a list of FDs of any size, by splitting them across as
+  // many messages as needed: first a FrameHeader, then the FDs in groups of at most
+  // kMaxFdsPerMessage (each attached to a single kFrameFdChunkMarker byte), then the payload in
+  // chunks of at most kFrameChunkSize bytes. Frames are read via AsyncSocket::ReadFramed.
+  static constexpr size_t kFrameChunkSize = 32 * 1024;
+  static constexpr std::byte kFrameFdChunkMarker{0};
+
+  // Both ends are always on the same machine, so this is sent as-is.
+  struct FrameHeader {
+    std::uint64_t payload_size;
+    std::uint64_t fd_count;
+  };
+
+  // Writes an entire frame, blocking until everything is sent.
+  static bool WriteFramed(int fd, const std::vector<std::byte>& payload,
+                          const std::vector<int>& fds);
+
   // Enables the ability for the given FD to receive peer's PID on socket read operations.
   static bool EnableReceivePid(int fd);
 
-  // Opens a pair of two sockets, returning an empty optional on failure.
-  static std::optional<std::pair<unique_fd, unique_fd>> OpenSocketPair();
+  // Returns a pidfd for the process that opened the peer end of the socket, or an empty optional if
+  // that's not supported (SO_PEERPIDFD is only available since Linux 6.5).
+  static std::optional<unique_fd> GetPeerPidfd(int fd);
+
+  // Opens a pair of two sockets of the given type (e.g. SOCK_SEQPACKET, to preserve message
+  // boundaries), returning an empty optional on failure.
+  static std::optional<std::pair<unique_fd, unique_fd>> OpenSocketPair(int type = SOCK_STREAM);
 };
 
 }  // namespace zypak
@@ -36,6 +36,7 @@ void Bus::Shutdown() {
   }
 
   bus_thread_->Shutdown();
+  bus_thread_->evloop()->Acquire()->DumpStats();
   bus_thread_.reset();
 
   signal_handlers_.clear();
@@ -6,6 +6,7 @@
 
 #include <dbus/dbus.h>
 
+#include <coroutine>
 #include <memory>
 #include <thread>
 #include <unordered_set>
@@ -71,6 +72,34 @@ class Bus {
   // Performs a blocking call to the given MethodCall, returning the reply once complete.
   Reply CallBlocking(MethodCall call);
 
+  // An awaitable that performs an async call, resuming the awaiting coroutine on the bus thread
+  // with the reply once available.
+  class CallAwaiter {
+   public:
+    bool await_ready() const { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+      bus_->CallAsync(std::move(call_), [this, handle](Reply reply) {
+        reply_.emplace(std::move(reply));
+        handle.resume();
+      });
+    }
+
+    Reply await_resume() { return std::move(*reply_); }
+
+   private:
+    CallAwaiter(Bus* bus, MethodCall call) : bus_(bus), call_(std::move(call)) {}
+
+    Bus* bus_;
+    MethodCall call_;
+    std::optional<Reply> reply_;
+
+    friend class Bus;
+  };
+
+  // Returns an awaitable that performs an async call to the given MethodCall.
+  CallAwaiter AwaitCall(MethodCall call) { return CallAwaiter(this, std::move(call)); }
+
   // Connects to the given signal emitted by the given interface.
   void SignalConnect(std::string interface, std::string signal, SignalHandler handler);
 
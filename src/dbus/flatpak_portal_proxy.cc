@@ -45,26 +45,27 @@ std::optional<FlatpakPortalProxy::SpawnReply> FlatpakPortalProxy::SpawnBlocking(
   return GetSpawnReply(bus_->CallBlocking(method_call));
 }
 
-void FlatpakPortalProxy::SpawnAsync(FlatpakPortalProxy::SpawnCall spawn,
-                                    SpawnReplyHandler handler) {
-  MethodCall method_call = BuildSpawnMethodCall(std::move(spawn));
-  bus_->CallAsync(std::move(method_call), [handler](Reply reply) {
-    if (auto spawn_reply = GetSpawnReply(std::move(reply))) {
-      handler(std::move(*spawn_reply));
-    }
-  });
+Task<std::optional<FlatpakPortalProxy::SpawnReply>>
+FlatpakPortalProxy::AwaitSpawn(MethodCall call) {
+  co_return GetSpawnReply(co_await bus_->AwaitCall(std::move(call)));
 }
 
 std::optional<InvocationError> FlatpakPortalProxy::SpawnSignalBlocking(std::uint32_t pid,
                                                                        std::uint32_t signal) {
-  MethodCall call(kFlatpakPortalRef, "SpawnSignal");
-  MessageWriter writer = call.OpenWriter();
+  Reply reply = bus_->CallBlocking(BuildSpawnSignalMethodCall(pid, signal));
+  return reply.ReadError();
+}
 
-  writer.Write<TypeCode::kUInt32>(pid);
-  writer.Write<TypeCode::kUInt32>(signal);
+void FlatpakPortalProxy::SpawnSignalAsync(std::uint32_t pid, std::uint32_t signal,
+                                          SpawnSignalReplyHandler handler) {
+  bus_->CallAsync(BuildSpawnSignalMethodCall(pid, signal),
+                  [handler](Reply reply) { handler(reply.ReadError()); });
+}
 
-  Reply reply = bus_->CallBlocking(std::move(call));
-  return reply.ReadError();
+Task<std::optional<InvocationError>> FlatpakPortalProxy::AwaitSpawnSignal(std::uint32_t pid,
+                                                                          std::uint32_t signal) {
+  Reply reply = co_await bus_->AwaitCall(BuildSpawnSignalMethodCall(pid, signal));
+  co_return reply.ReadError();
 }
 
 void FlatpakPortalProxy::SubscribeToSpawnStarted(SpawnStartedHandler handler) {
@@ -106,7 +107,7 @@ MethodCall FlatpakPortalProxy::BuildSpawnMethodCall(SpawnCall spawn) {
   {
     ZYPAK_ASSERT(!spawn.argv.empty());
     MessageWriter argv_writer = writer.EnterContainer<TypeCode::kArray>("ay");
-    for (const std::string& arg : spawn.argv) {
+    for (cstring_view arg : spawn.argv) {
       argv_writer.WriteFixedArray<TypeCode::kByte>(reinterpret_cast<const std::byte*>(arg.c_str()),
                                                    arg.size() + 1);  // include null terminator
     }
@@ -165,6 +166,17 @@ MethodCall FlatpakPortalProxy::BuildSpawnMethodCall(SpawnCall spawn) {
   return call;
 }
 
+MethodCall FlatpakPortalProxy::BuildSpawnSignalMethodCall(std::uint32_t pid,
+                                                          std::uint32_t signal) {
+  MethodCall call(kFlatpakPortalRef, "SpawnSignal");
+  MessageWriter writer = call.OpenWriter();
+
+  writer.Write<TypeCode::kUInt32>(pid);
+  writer.Write<TypeCode::kUInt32>(signal);
+
+  return call;
+}
+
 // static
 std::optional<FlatpakPortalProxy::SpawnReply> FlatpakPortalProxy::GetSpawnReply(Reply reply) {
   if (std::optional<InvocationError> error = reply.ReadError()) {
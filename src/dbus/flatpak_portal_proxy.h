@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "base/base.h"
+#include "base/coroutine.h"
 #include "base/cstring_view.h"
 #include "base/enum_util.h"
 #include "base/fd_map.h"
@@ -22,7 +23,7 @@ namespace zypak::dbus {
 class FlatpakPortalProxy {
  public:
   using SpawnReply = std::variant<std::uint32_t, InvocationError>;
-  using SpawnReplyHandler = std::function<void(SpawnReply)>;
+  using SpawnSignalReplyHandler = std::function<void(std::optional<InvocationError>)>;
 
   // The message emitted with the SpawnStarted signal.
   struct SpawnStartedMessage {
@@ -85,23 +86,35 @@ class FlatpakPortalProxy {
   // Gets the runtime flags supported by the portal.
   std::optional<Supports> GetSupportsBlocking();
 
+  // Like the fds, the strings are not owned by the call, so they must outlive it (though not the
+  // message built from it). This avoids copying a command line more than the once it takes to
+  // write it into the message.
   struct SpawnCall {
     SpawnCall() {}
 
     cstring_view cwd;
-    std::vector<std::string> argv;
+    std::vector<cstring_view> argv;
     const FdMap* fds = nullptr;
-    std::unordered_map<std::string, std::string> env;
+    std::unordered_map<cstring_view, cstring_view> env;
     SpawnFlags flags = kNoSpawnFlags;
     SpawnOptions options;
   };
 
   // Calls the Spawn method to spawn a new process using the given call options.
   std::optional<SpawnReply> SpawnBlocking(SpawnCall spawn);
-  void SpawnAsync(SpawnCall spawn, SpawnReplyHandler handler);
+  // Like SpawnBlocking, but as a coroutine, and sends a call that was already built via
+  // BuildSpawnMethodCall. If the reply could not be parsed, the result is empty.
+  Task<std::optional<SpawnReply>> AwaitSpawn(MethodCall call);
+
+  // Builds the message for a Spawn call without sending it. This doesn't touch the bus, so it can
+  // be done on any thread, e.g. to keep the work of building the message off of the bus thread.
+  MethodCall BuildSpawnMethodCall(SpawnCall spawn);
 
   // Calls the SpawnSignal method to send a signal to a spawned process.
   std::optional<InvocationError> SpawnSignalBlocking(std::uint32_t pid, std::uint32_t signal);
+  void SpawnSignalAsync(std::uint32_t pid, std::uint32_t signal, SpawnSignalReplyHandler handler);
+  // Like SpawnSignalBlocking, but as a coroutine, so it can be used from the bus thread.
+  Task<std::optional<InvocationError>> AwaitSpawnSignal(std::uint32_t pid, std::uint32_t signal);
 
   void SubscribeToSpawnStarted(SpawnStartedHandler handler);
   void SubscribeToSpawnExited(SpawnExitedHandler handler);
@@ -111,7 +124,7 @@ class FlatpakPortalProxy {
       FloatingRef("org.freedesktop.portal.Flatpak", "/org/freedesktop/portal/Flatpak",
                   "org.freedesktop.portal.Flatpak");
 
-  MethodCall BuildSpawnMethodCall(SpawnCall spawn);
+  MethodCall BuildSpawnSignalMethodCall(std::uint32_t pid, std::uint32_t signal);
   // static so it can be used easily in a callback without having to capture `this`
   static std::optional<SpawnReply> GetSpawnReply(Reply reply);
 
@@ -21,6 +21,11 @@ std::unique_ptr<BusThread> BusThread::Create(BusConnection connection,
     return nullptr;
   }
 
+  std::unique_ptr<EvLoopWatchdog> watchdog;
+  if (auto budget = EvLoopWatchdog::GetBudgetFromEnvironment()) {
+    watchdog = std::make_unique<EvLoopWatchdog>(ev->EnableDispatchTracking(), *budget);
+  }
+
   // Note that we can't just use sd-event's exit functionality here, as a bus thread may be
   // *temporarily* shut down so a fork can safely occur, but an sd-event exit is permanent.
   ShutdownFlag shutdown_flag = std::make_unique<std::atomic<bool>>(false);
@@ -32,33 +37,42 @@ std::unique_ptr<BusThread> BusThread::Create(BusConnection connection,
   shutdown_source =
       ev->AddTrigger([flag = shutdown_flag.get()](EvLoop::SourceRef source) { flag->store(true); });
 
-  dispatch_source = ev->AddTrigger([conn = connection.get()](EvLoop::SourceRef source) {
-    Debug() << "Dispatching on bus thread";
-
-    for (;;) {
-      switch (dbus_connection_get_dispatch_status(conn)) {
-      case DBUS_DISPATCH_DATA_REMAINS:
-        dbus_connection_dispatch(conn);
-        break;
-      case DBUS_DISPATCH_COMPLETE:
-        return;
-      case DBUS_DISPATCH_NEED_MEMORY:
-        ZYPAK_ASSERT(false, << "D-Bus hit OOM");
-      }
-    }
-  });
+  // D-Bus dispatch runs at a high priority, so that incoming signals (e.g. processes starting or
+  // exiting) are handled before any bulk traffic on other sources.
+  dispatch_source = ev->AddTrigger(
+      [conn = connection.get()](EvLoop::SourceRef source) {
+        Debug() << "Dispatching on bus thread";
+
+        for (;;) {
+          switch (dbus_connection_get_dispatch_status(conn)) {
+          case DBUS_DISPATCH_DATA_REMAINS:
+            dbus_connection_dispatch(conn);
+            break;
+          case DBUS_DISPATCH_COMPLETE:
+            return;
+          case DBUS_DISPATCH_NEED_MEMORY:
+            ZYPAK_ASSERT(false, << "D-Bus hit OOM");
+          }
+        }
+      },
+      EvLoop::Priority::kHigh);
 
   if (!shutdown_source || !dispatch_source) {
     Log() << "Could not add required sources for bus thread";
     return {};
   }
 
+  shutdown_source->source().SetDescription("bus-shutdown");
+  dispatch_source->source().SetDescription("bus-dispatch");
+
   Triggers tasks{std::move(*shutdown_source), std::move(*dispatch_source)};
 
   // Can't use make_unique, because our constructor is private.
-  return std::unique_ptr<BusThread>(new BusThread(std::move(connection), std::move(signal_handler),
-                                                  std::move(*ev), std::move(shutdown_flag),
-                                                  std::move(tasks)));
+  auto thread = std::unique_ptr<BusThread>(new BusThread(std::move(connection),
+                                                         std::move(signal_handler), std::move(*ev),
+                                                         std::move(shutdown_flag), std::move(tasks)));
+  thread->watchdog_ = std::move(watchdog);
+  return thread;
 }
 
 bool BusThread::IsRunning() const { return thread_.joinable(); }
@@ -69,11 +83,21 @@ void BusThread::Start() {
 
   // Re-initialize the thread value to start the main loop.
   thread_ = std::thread(std::bind(&BusThread::ThreadMain, this));
+
+  if (watchdog_) {
+    watchdog_->Start();
+  }
 }
 
 void BusThread::Shutdown() {
   Debug() << "Shutting down bus thread...";
 
+  // The watchdog is stopped alongside the bus thread, so that no extra threads are left running
+  // if this is being paused for a fork.
+  if (watchdog_) {
+    watchdog_->Stop();
+  }
+
   if (thread_.joinable()) {
     {
       // Need to lock to activate triggers.
@@ -90,8 +114,9 @@ void BusThread::Shutdown() {
 }
 
 void BusThread::SendCall(MethodCall call, CallHandler handler) {
-  auto ev = ev_.Acquire();
-  ZYPAK_ASSERT(ev->AddTask([this, call = std::move(call), handler](EvLoop::SourceRef source) {
+  // Posting tasks is thread-safe, so there's no need to lock the event loop here.
+  ZYPAK_ASSERT(ev_.unsafe()->AddTask([this, call = std::move(call),
+                                      handler = std::move(handler)]() mutable {
     DBusPendingCall* pending = nullptr;
     ZYPAK_ASSERT(dbus_connection_send_with_reply(connection_.get(), call.message(), &pending, -1));
     ZYPAK_ASSERT(pending);
@@ -102,13 +127,12 @@ void BusThread::SendCall(MethodCall call, CallHandler handler) {
           auto* handler = static_cast<CallHandler*>(data);
           (*handler)(Reply(dbus_pending_call_steal_reply(pending)));
         },
-        new CallHandler(handler), [](void* data) { delete static_cast<CallHandler*>(data); }));
+        new CallHandler(std::move(handler)), [](void* data) { delete static_cast<CallHandler*>(data); }));
   }));
 }
 
 void BusThread::AddMatch(std::string match, MatchErrorHandler handler) {
-  auto ev = ev_.Acquire();
-  ev->AddTask([this, match = std::move(match), handler](EvLoop::SourceRef source) {
+  ev_.unsafe()->AddTask([this, match = std::move(match), handler = std::move(handler)]() {
     Error error;
     dbus_bus_add_match(connection_.get(), match.c_str(), error.get());
     handler(std::move(error));
@@ -152,8 +176,6 @@ void BusThread::ThreadMain() {
     // Don't hold any lock while waiting, otherwise other threads won't be able to touch the bus at
     // all.
     switch (ev_.unsafe()->Wait()) {
-    case EvLoop::WaitResult::kIdle:
-      continue;
     case EvLoop::WaitResult::kReady:
       break;
     case EvLoop::WaitResult::kError:
@@ -218,28 +240,34 @@ dbus_bool_t BusThread::HandleDBusWatchAdd(DBusWatch* watch) {
   }
 
   auto ev = ev_.Acquire();
-  auto source = ev->AddFd(fd, events, [watch](EvLoop::SourceRef source, EvLoop::Events events) {
-    Debug() << "Incoming events on D-Bus watch " << dbus_watch_get_unix_fd(watch) << ": "
-            << static_cast<int>(events.status());
-
-    uint flags = 0;
-    ZYPAK_ASSERT(!events.empty());
-    if (events.contains(EvLoop::Events::Status::kRead)) {
-      flags |= DBUS_WATCH_READABLE;
-    }
-    if (events.contains(EvLoop::Events::Status::kWrite)) {
-      flags |= DBUS_WATCH_WRITABLE;
-    }
-
-    ZYPAK_ASSERT(dbus_watch_handle(watch, flags));
-    return true;
-  });
+  // Like dispatch, reading from the bus takes priority over other sources.
+  auto source = ev->AddFd(
+      fd, events,
+      [watch](EvLoop::SourceRef source, EvLoop::Events events) {
+        Debug() << "Incoming events on D-Bus watch " << dbus_watch_get_unix_fd(watch) << ": "
+                << static_cast<int>(events.status());
+
+        uint flags = 0;
+        ZYPAK_ASSERT(!events.empty());
+        if (events.contains(EvLoop::Events::Status::kRead)) {
+          flags |= DBUS_WATCH_READABLE;
+        }
+        if (events.contains(EvLoop::Events::Status::kWrite)) {
+          flags |= DBUS_WATCH_WRITABLE;
+        }
+
+        ZYPAK_ASSERT(dbus_watch_handle(watch, flags));
+        return true;
+      },
+      EvLoop::Priority::kHigh);
 
   if (!source) {
     Log() << "Failed to add event poller for D-Bus watcher";
     return false;
   }
 
+  source->SetDescription("bus-watch");
+
   EvLoop::SourceRef* heap_source = new EvLoop::SourceRef(*source);
   dbus_watch_set_data(watch, heap_source,
                       [](void* data) { delete static_cast<EvLoop::SourceRef*>(data); });
@@ -274,26 +302,42 @@ dbus_bool_t BusThread::HandleDBusTimeoutAdd(DBusTimeout* timeout) {
 
   auto ev = ev_.Acquire();
   int ms = dbus_timeout_get_interval(timeout);
-  auto source = ev->AddTimerMs(ms, [this, timeout](EvLoop::SourceRef source) {
-    ZYPAK_ASSERT(dbus_timeout_handle(timeout));
-    // XXX: Ugly code to re-arm the timer.
-    HandleDBusTimeoutAdd(timeout);
-  });
+
+  // D-Bus re-adds timeouts that were removed or toggled off, so re-use the existing timer instead
+  // of creating a new one.
+  if (auto* source = static_cast<EvLoop::TimerSourceRef*>(dbus_timeout_get_data(timeout))) {
+    if (!source->RearmMs(ms)) {
+      Log() << "Failed to re-arm event poller for D-Bus timeout";
+      return false;
+    }
+
+    return true;
+  }
+
+  // D-Bus timeouts keep firing at their interval until they're removed.
+  EvLoop::TimerOptions options;
+  options.periodic = true;
+
+  auto source = ev->AddTimerMs(
+      ms, [timeout](EvLoop::SourceRef source) { ZYPAK_ASSERT(dbus_timeout_handle(timeout)); },
+      options);
 
   if (!source) {
     Log() << "Failed to add event poller for D-Bus timeout";
     return false;
   }
 
-  EvLoop::SourceRef* heap_source = new EvLoop::SourceRef(*source);
+  source->source().SetDescription("bus-timeout");
+
+  EvLoop::TimerSourceRef* heap_source = new EvLoop::TimerSourceRef(*source);
   dbus_timeout_set_data(timeout, heap_source,
-                        [](void* data) { delete static_cast<EvLoop::SourceRef*>(data); });
+                        [](void* data) { delete static_cast<EvLoop::TimerSourceRef*>(data); });
 
   return true;
 }
 
 void BusThread::HandleDBusTimeoutRemove(DBusTimeout* timeout) {
-  if (auto* source = static_cast<EvLoop::SourceRef*>(dbus_timeout_get_data(timeout))) {
+  if (auto* source = static_cast<EvLoop::TimerSourceRef*>(dbus_timeout_get_data(timeout))) {
     // Need to lock to disable sources.
     auto ev = ev_.Acquire();
     source->Disable();
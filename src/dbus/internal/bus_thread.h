@@ -7,11 +7,13 @@
 #include <dbus/dbus.h>
 
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <thread>
 
 #include "base/base.h"
 #include "base/evloop.h"
+#include "base/evloop_watchdog.h"
 #include "base/guarded_value.h"
 #include "dbus/bus_error.h"
 
@@ -92,6 +94,9 @@ class BusThread {
 
   std::thread thread_;
 
+  // Only set if the watchdog is enabled via the environment.
+  std::unique_ptr<EvLoopWatchdog> watchdog_;
+
   // This *MUST* be last, as D-Bus will call into callbacks as it closes the connection, so ev_
   // must still be alive.
   BusConnection connection_;
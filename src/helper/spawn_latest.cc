@@ -26,34 +26,38 @@ bool SpawnLatest(std::vector<cstring_view> args, bool wrap_with_zypak) {
   spawn.cwd = cwd.get();
 
   if (Env::Test(Env::kZypakSettingDisableSandbox)) {
-    spawn.env[Env::kZypakSettingDisableSandbox.ToOwned()] = "1";
+    spawn.env[Env::kZypakSettingDisableSandbox] = "1";
   }
 
+  // Must outlive the call, which only refers to it.
+  std::string helper_path;
+
   if (wrap_with_zypak) {
     // XXX: This is similar to sandbox/launcher.cc
-    spawn.env[Env::kZypakBin.ToOwned()] = Env::Require(Env::kZypakBin);
-    spawn.env[Env::kZypakLib.ToOwned()] = Env::Require(Env::kZypakLib);
+    spawn.env[Env::kZypakBin] = Env::Require(Env::kZypakBin);
+    spawn.env[Env::kZypakLib] = Env::Require(Env::kZypakLib);
 
     if (auto widevine_path = Env::Get(Env::kZypakSettingExposeWidevinePath)) {
-      spawn.env[Env::kZypakSettingExposeWidevinePath.ToOwned()] = *widevine_path;
+      spawn.env[Env::kZypakSettingExposeWidevinePath] = *widevine_path;
     }
 
     if (auto sandbox_filename = Env::Get(Env::kZypakSettingSandboxFilename)) {
-      spawn.env[Env::kZypakSettingSandboxFilename.ToOwned()] = *sandbox_filename;
+      spawn.env[Env::kZypakSettingSandboxFilename] = *sandbox_filename;
     }
 
     if (auto ld_preload = Env::Get(Env::kZypakSettingLdPreload)) {
-      spawn.env[Env::kZypakSettingLdPreload.ToOwned()] = *ld_preload;
+      spawn.env[Env::kZypakSettingLdPreload] = *ld_preload;
     }
 
-    auto helper = std::filesystem::path(Env::Require(Env::kZypakBin).ToOwned()) / "zypak-helper";
-    spawn.argv.push_back(helper.string());
+    helper_path =
+        (std::filesystem::path(Env::Require(Env::kZypakBin).ToOwned()) / "zypak-helper").string();
+    spawn.argv.push_back(helper_path);
     spawn.argv.push_back("host");
     spawn.argv.push_back("-");
   }
 
-  for (const cstring_view& arg : args) {
-    spawn.argv.emplace_back(arg);
+  for (cstring_view arg : args) {
+    spawn.argv.push_back(arg);
   }
 
   spawn.flags = dbus::FlatpakPortalProxy::SpawnFlags::kSpawnLatest;
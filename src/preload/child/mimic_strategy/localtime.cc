@@ -30,7 +30,8 @@ namespace {
 constexpr int kSandboxServiceLocaltimeMethod = 32;
 constexpr int kLocaltimeReplyMaxLength = 512;
 
-GuardedValue<std::unordered_set<std::string>> g_timezones;
+// Only ever grows by a handful of entries, after which every lookup finds a match.
+SharedGuardedValue<std::unordered_set<std::string>> g_timezones;
 
 std::optional<std::vector<std::byte>>
 SendSandboxRequestAndReadReply(const std::vector<std::byte>& request) {
@@ -115,6 +116,14 @@ void GetTimeFromSandboxService(time_t time, struct tm* result, std::string* time
     *timezone_storage = timezone;
     result->tm_zone = timezone_storage->c_str();
   } else {
+    {
+      auto timezones = g_timezones.AcquireShared();
+      if (auto it = timezones->find(timezone); it != timezones->end()) {
+        result->tm_zone = it->c_str();
+        return;
+      }
+    }
+
     auto timezones = g_timezones.Acquire();
     result->tm_zone = timezones->insert(timezone).first->c_str();
   }
@@ -15,8 +15,10 @@
 #include "dbus/bus.h"
 #include "preload/declare_override.h"
 #include "preload/host/spawn_strategy/close/no_close_host_fd.h"
+#include "preload/host/spawn_strategy/supervisor.h"
 
 using namespace zypak;
+using namespace zypak::preload;
 
 namespace {
 
@@ -39,6 +41,9 @@ DECLARE_OVERRIDE(pid_t, fork) {
   }
 
   Debug() << "Prepare for fork";
+  // The supervisor's ingestion thread hands its work to the bus thread, so stop it first.
+  Supervisor* supervisor = Supervisor::Acquire();
+  supervisor->Pause();
   bus->Pause();
 
   pid_t result = original();
@@ -52,6 +57,7 @@ DECLARE_OVERRIDE(pid_t, fork) {
   Debug() << "Resume bus in parent";
   // In the parent, re-init the bus, regardless of the fork result.
   bus->Resume();
+  supervisor->Resume();
 
   return result;
 }
@@ -0,0 +1,181 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <unordered_map>
+
+#include "base/base.h"
+#include "base/debug.h"
+
+namespace zypak::preload {
+
+// Tracks the stubs that waits on any child or on a process group can target: every stub that the
+// supervisor is in charge of, from when its request arrives until the stub itself is reaped. The
+// stubs whose processes exited, but whose statuses weren't taken yet, are queued in the order they
+// exited, both overall and per process group, so taking the next one for any target (or dropping
+// a specific one) never needs a scan.
+class ExitQueue {
+ public:
+  // Targets every process group.
+  static constexpr pid_t kAnyGroup = -1;
+
+  size_t size() const { return stubs_.size(); }
+
+  bool Contains(pid_t stub) const { return stubs_.contains(stub); }
+
+  // Returns true if any tracked stub is in the group.
+  bool HasStubs(pid_t group) const {
+    return group == kAnyGroup ? !stubs_.empty() : stubs_per_group_.contains(group);
+  }
+
+  // Returns true if any queued exit is in the group.
+  bool HasExits(pid_t group) const {
+    return group == kAnyGroup ? !exits_.empty() : exits_by_group_.contains(group);
+  }
+
+  // Starts tracking the stub, replacing any previous stub with the same pid. The generation tells
+  // apart stubs that reused the same pid. The group must be a real process group, i.e. positive,
+  // or 0 if unknown, in which case only waits on any group can target the stub.
+  void Add(pid_t stub, std::uint64_t generation, pid_t group) {
+    ZYPAK_ASSERT(group >= 0);
+
+    if (auto it = stubs_.find(stub); it != stubs_.end()) {
+      Erase(it);
+    }
+
+    stubs_.emplace(stub, Stub{generation, group});
+    stubs_per_group_[group]++;
+  }
+
+  // Queues the exit of the stub's process. Returns false if the stub isn't tracked or already
+  // exited.
+  bool MarkExited(pid_t stub) {
+    auto it = stubs_.find(stub);
+    if (it == stubs_.end() || it->second.exited) {
+      return false;
+    }
+
+    Stub& data = it->second;
+    data.exited = true;
+    data.queued_exit = exits_.insert(exits_.end(), stub);
+
+    std::list<pid_t>& group_exits = exits_by_group_[data.group];
+    data.queued_group_exit = group_exits.insert(group_exits.end(), stub);
+    return true;
+  }
+
+  // Returns true if the stub's process exited, regardless of whether its exit is still queued.
+  bool HasExited(pid_t stub, std::uint64_t generation) const {
+    auto it = stubs_.find(stub);
+    return it != stubs_.end() && it->second.generation == generation && it->second.exited;
+  }
+
+  // Calls the function with each group that has any queued exits.
+  template <typename Func>
+  void ForEachGroupWithExits(Func func) const {
+    for (const auto& [group, group_exits] : exits_by_group_) {
+      func(group);
+    }
+  }
+
+  // Removes the first queued exit in the group and returns its stub, which stays tracked.
+  std::optional<pid_t> TakeNext(pid_t group) {
+    pid_t stub;
+    if (group == kAnyGroup) {
+      if (exits_.empty()) {
+        return {};
+      }
+
+      stub = exits_.front();
+    } else {
+      auto it = exits_by_group_.find(group);
+      if (it == exits_by_group_.end()) {
+        return {};
+      }
+
+      stub = it->second.front();
+    }
+
+    auto it = stubs_.find(stub);
+    ZYPAK_ASSERT(it != stubs_.end());
+    Dequeue(&it->second);
+    return stub;
+  }
+
+  // Removes the stub's exit from the queue, after its status was taken directly. The stub stays
+  // tracked.
+  void DropExit(pid_t stub) {
+    if (auto it = stubs_.find(stub); it != stubs_.end()) {
+      Dequeue(&it->second);
+    }
+  }
+
+  // Stops tracking the stub, dropping its exit if it's still queued. Returns the stub's group, or
+  // an empty optional if the stub with that generation wasn't tracked.
+  std::optional<pid_t> Remove(pid_t stub, std::uint64_t generation) {
+    auto it = stubs_.find(stub);
+    if (it == stubs_.end() || it->second.generation != generation) {
+      return {};
+    }
+
+    pid_t group = it->second.group;
+    Erase(it);
+    return group;
+  }
+
+ private:
+  struct Stub {
+    std::uint64_t generation;
+    pid_t group;
+    bool exited = false;
+    // Only set while the exit is queued.
+    std::optional<std::list<pid_t>::iterator> queued_exit;
+    std::list<pid_t>::iterator queued_group_exit;
+  };
+
+  using StubMap = std::unordered_map<pid_t, Stub>;
+
+  void Dequeue(Stub* data) {
+    if (!data->queued_exit) {
+      return;
+    }
+
+    exits_.erase(*data->queued_exit);
+    data->queued_exit.reset();
+
+    auto group_it = exits_by_group_.find(data->group);
+    ZYPAK_ASSERT(group_it != exits_by_group_.end());
+    group_it->second.erase(data->queued_group_exit);
+    if (group_it->second.empty()) {
+      exits_by_group_.erase(group_it);
+    }
+  }
+
+  void Erase(StubMap::iterator it) {
+    Dequeue(&it->second);
+
+    auto group_it = stubs_per_group_.find(it->second.group);
+    ZYPAK_ASSERT(group_it != stubs_per_group_.end());
+    if (--group_it->second == 0) {
+      stubs_per_group_.erase(group_it);
+    }
+
+    stubs_.erase(it);
+  }
+
+  StubMap stubs_;
+  // The # of tracked stubs in each group, only holding groups with at least one.
+  std::unordered_map<pid_t, size_t> stubs_per_group_;
+  // The queued exits, overall and per group, only holding groups with at least one.
+  std::list<pid_t> exits_;
+  std::unordered_map<pid_t, std::list<pid_t>> exits_by_group_;
+};
+
+}  // namespace zypak::preload
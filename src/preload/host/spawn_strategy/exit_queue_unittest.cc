@@ -0,0 +1,271 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "preload/host/spawn_strategy/exit_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include "base/debug.h"
+#include "base/guarded_value.h"
+
+using namespace zypak;
+using namespace zypak::preload;
+
+namespace {
+
+constexpr pid_t kAny = ExitQueue::kAnyGroup;
+
+using Exits = KeyedNotifyingGuardedValue<ExitQueue, pid_t>;
+
+// Same as the supervisor's: wakes a single wait that can take an exit in the group.
+void HandOffExit(KeyedNotifyingGuard<ExitQueue, pid_t>* exits, pid_t group) {
+  if (!exits->NotifyOne(group)) {
+    exits->NotifyOne(kAny);
+  }
+}
+
+void TestOrder() {
+  ExitQueue queue;
+  queue.Add(10, 1, 100);
+  queue.Add(11, 2, 200);
+  queue.Add(12, 3, 100);
+  queue.Add(13, 4, 200);
+
+  ZYPAK_ASSERT(!queue.HasExits(kAny));
+  ZYPAK_ASSERT(!queue.TakeNext(kAny));
+
+  for (pid_t stub : {13, 10, 12, 11}) {
+    ZYPAK_ASSERT(queue.MarkExited(stub));
+  }
+
+  ZYPAK_ASSERT(!queue.MarkExited(10));
+
+  // Waits on a group only see that group's exits, in the order they happened, and waits on any
+  // group see them all.
+  ZYPAK_ASSERT(queue.TakeNext(100) == 10);
+  ZYPAK_ASSERT(queue.TakeNext(kAny) == 13);
+  ZYPAK_ASSERT(queue.TakeNext(200) == 11);
+  ZYPAK_ASSERT(!queue.HasExits(200));
+  ZYPAK_ASSERT(queue.TakeNext(kAny) == 12);
+  ZYPAK_ASSERT(!queue.HasExits(kAny));
+  ZYPAK_ASSERT(!queue.HasExits(100));
+
+  // Taking an exit doesn't stop tracking the stub.
+  ZYPAK_ASSERT(queue.size() == 4);
+  ZYPAK_ASSERT(queue.HasExited(10, 1));
+}
+
+void TestDropAndRemove() {
+  ExitQueue queue;
+  queue.Add(10, 1, 100);
+  queue.Add(11, 2, 100);
+  queue.MarkExited(10);
+  queue.MarkExited(11);
+
+  // A status taken directly leaves the rest of the queue intact.
+  queue.DropExit(10);
+  queue.DropExit(10);
+  ZYPAK_ASSERT(queue.TakeNext(100) == 11);
+  ZYPAK_ASSERT(!queue.TakeNext(kAny));
+
+  // Stubs whose statuses were taken still count as targeted until they're removed, so nobody
+  // falls back to reaping them.
+  ZYPAK_ASSERT(queue.HasStubs(100));
+  ZYPAK_ASSERT(queue.Contains(10));
+
+  // Removing needs the right generation, so a stale stub can't remove a newer one with its pid.
+  ZYPAK_ASSERT(!queue.Remove(10, 2));
+  ZYPAK_ASSERT(queue.Remove(10, 1) == 100);
+  ZYPAK_ASSERT(!queue.Contains(10));
+  ZYPAK_ASSERT(queue.HasStubs(100));
+  ZYPAK_ASSERT(queue.Remove(11, 2) == 100);
+  ZYPAK_ASSERT(!queue.HasStubs(100));
+  ZYPAK_ASSERT(!queue.HasStubs(kAny));
+
+  // Removing a stub whose exit is still queued drops the exit as well.
+  queue.Add(12, 3, 300);
+  queue.MarkExited(12);
+  ZYPAK_ASSERT(queue.Remove(12, 3) == 300);
+  ZYPAK_ASSERT(!queue.HasExits(300));
+  ZYPAK_ASSERT(!queue.HasExits(kAny));
+}
+
+void TestReplace() {
+  ExitQueue queue;
+  queue.Add(10, 1, 100);
+  queue.MarkExited(10);
+
+  // A stub with a reused pid replaces the old one, along with its queued exit and its group.
+  queue.Add(10, 2, 200);
+  ZYPAK_ASSERT(queue.size() == 1);
+  ZYPAK_ASSERT(!queue.HasExits(kAny));
+  ZYPAK_ASSERT(!queue.HasStubs(100));
+  ZYPAK_ASSERT(!queue.HasExited(10, 1));
+  ZYPAK_ASSERT(!queue.HasExited(10, 2));
+
+  ZYPAK_ASSERT(queue.MarkExited(10));
+  ZYPAK_ASSERT(queue.HasExited(10, 2));
+  ZYPAK_ASSERT(queue.TakeNext(200) == 10);
+}
+
+// Mirrors how the supervisor waits on the queue: waits on a group and waits on any group must
+// each be woken by the exits they can take, without one taking the other's wakeup.
+void TestKeyedWaits() {
+  Exits exits;
+  {
+    auto guard = exits.Acquire();
+    guard->Add(10, 1, 100);
+    guard->Add(11, 2, 200);
+  }
+
+  auto wait_for_exit = [&](pid_t target, std::atomic<pid_t>* taken) {
+    auto guard = exits.AcquireWhenOrTimeout(
+        target,
+        [target](ExitQueue* queue) {
+          return queue->HasExits(target) || !queue->HasStubs(target);
+        },
+        std::chrono::seconds(10));
+    if (std::optional<pid_t> stub = guard->TakeNext(target)) {
+      *taken = *stub;
+    }
+  };
+
+  std::atomic<pid_t> group_taken = 0;
+  std::atomic<pid_t> any_taken = 0;
+  std::thread group_waiter(wait_for_exit, 100, &group_taken);
+  std::thread any_waiter(wait_for_exit, kAny, &any_taken);
+
+  // Give both a chance to start waiting.
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    auto guard = exits.Acquire();
+    guard->MarkExited(11);
+    HandOffExit(&guard, 200);
+  }
+
+  any_waiter.join();
+  ZYPAK_ASSERT(any_taken == 11);
+  ZYPAK_ASSERT(group_taken == 0);
+
+  {
+    auto guard = exits.Acquire();
+    guard->MarkExited(10);
+    HandOffExit(&guard, 100);
+  }
+
+  group_waiter.join();
+  ZYPAK_ASSERT(group_taken == 10);
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  ZYPAK_ASSERT(elapsed < std::chrono::seconds(5), << "waiters were not woken");
+
+  // With nothing left to exit in the group, the wait ends right away.
+  {
+    auto guard = exits.Acquire();
+    guard->Remove(10, 1);
+    guard->Remove(11, 2);
+  }
+
+  std::atomic<pid_t> unused = 0;
+  start = std::chrono::steady_clock::now();
+  wait_for_exit(100, &unused);
+  ZYPAK_ASSERT(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+  ZYPAK_ASSERT(unused == 0);
+}
+
+// Each exit has to wake exactly one of the waits on its group, not all of them, while still
+// waking a different one for every exit.
+void TestHandOffToOneWaiter() {
+  constexpr int kWaiters = 4;
+
+  Exits exits;
+  {
+    auto guard = exits.Acquire();
+    for (int i = 0; i < kWaiters; i++) {
+      guard->Add(10 + i, i + 1, 100);
+    }
+  }
+
+  std::atomic<int> checks = 0;
+  std::atomic<int> taken = 0;
+  std::atomic<pid_t> taken_stubs[kWaiters] = {};
+
+  std::vector<std::thread> waiters;
+  for (int i = 0; i < kWaiters; i++) {
+    waiters.emplace_back([&, i]() {
+      auto guard = exits.AcquireWhenOrTimeout(
+          100,
+          [&checks](ExitQueue* queue) {
+            checks++;
+            return queue->HasExits(100);
+          },
+          std::chrono::seconds(10));
+      std::optional<pid_t> stub = guard->TakeNext(100);
+      ZYPAK_ASSERT(stub);
+      taken_stubs[i] = *stub;
+      taken++;
+    });
+  }
+
+  // Give them all a chance to start waiting.
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ZYPAK_ASSERT(checks == kWaiters);
+
+  {
+    auto guard = exits.Acquire();
+    guard->MarkExited(10);
+    HandOffExit(&guard, 100);
+  }
+
+  while (taken < 1) {
+    std::this_thread::yield();
+  }
+
+  // Nobody else should wake up to find nothing left.
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ZYPAK_ASSERT(taken == 1);
+  ZYPAK_ASSERT(checks == kWaiters + 1, << checks);
+
+  // Several exits at once, before any of the waits gets to run, still wake one wait each.
+  {
+    auto guard = exits.Acquire();
+    for (int i = 1; i < kWaiters; i++) {
+      guard->MarkExited(10 + i);
+      HandOffExit(&guard, 100);
+    }
+  }
+
+  for (std::thread& waiter : waiters) {
+    waiter.join();
+  }
+
+  ZYPAK_ASSERT(checks == kWaiters * 2, << checks);
+
+  std::vector<pid_t> stubs(std::begin(taken_stubs), std::end(taken_stubs));
+  std::sort(stubs.begin(), stubs.end());
+  ZYPAK_ASSERT(std::adjacent_find(stubs.begin(), stubs.end()) == stubs.end());
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("exit_queue_unittest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  TestOrder();
+  TestDropAndRemove();
+  TestReplace();
+  TestKeyedWaits();
+  TestHandOffToOneWaiter();
+
+  Log() << "All tests passed";
+  return 0;
+}
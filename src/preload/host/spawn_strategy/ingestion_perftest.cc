@@ -0,0 +1,242 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Drives the spawn request ingestion path the way the supervisor runs it, minus the launcher and
+// the D-Bus call: stubs pass their end of a request socket over a shared SOCK_SEQPACKET socket and
+// write their request frames into it, while an EvLoopThread picks up the sockets in batches, reads
+// the frames back via AsyncSocket, and splits up the command line. Reports the throughput with 1,
+// 4, and 16 stubs sending requests at once.
+
+#include <sys/socket.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/async_socket.h"
+#include "base/cstring_view.h"
+#include "base/debug.h"
+#include "base/evloop_thread.h"
+#include "base/socket.h"
+#include "base/unique_fd.h"
+
+using namespace zypak;
+
+namespace {
+
+constexpr int kRequestsPerStub = 2000;
+constexpr int kConcurrentStubs[] = {1, 4, 16};
+
+// Roughly the size of a renderer's command line.
+constexpr size_t kArgCount = 48;
+constexpr size_t kArgSize = 96;
+// Stubs forward their stdio.
+constexpr size_t kFdCount = 3;
+
+constexpr size_t kMaxRequestsPerRead = 16;
+
+constexpr std::string_view kRequest = "request";
+constexpr std::string_view kReply = "ok";
+// Both include the null terminator.
+constexpr size_t kRequestSize = kRequest.size() + 1;
+constexpr size_t kReplySize = kReply.size() + 1;
+
+struct Request {
+  std::vector<std::byte> header;
+  std::vector<std::byte> args_block;
+  std::vector<int> fds;
+};
+
+Request BuildRequest() {
+  Request request;
+
+  // Same layout as the nickle-encoded header: the argc, then the target of each FD.
+  std::uint64_t argc = kArgCount;
+  request.header.resize(sizeof(argc) + kFdCount * sizeof(std::uint32_t));
+  std::memcpy(request.header.data(), &argc, sizeof(argc));
+
+  for (size_t i = 0; i < kArgCount; i++) {
+    std::string arg = "--arg-" + std::to_string(i) + "=";
+    arg.resize(kArgSize - 1, 'x');
+
+    const std::byte* data = reinterpret_cast<const std::byte*>(arg.c_str());
+    request.args_block.insert(request.args_block.end(), data, data + arg.size() + 1);
+  }
+
+  for (size_t i = 0; i < kFdCount; i++) {
+    request.fds.push_back(static_cast<int>(i));
+  }
+
+  return request;
+}
+
+class Ingestion {
+ public:
+  explicit Ingestion(std::atomic<int>* failures) : failures_(failures) {}
+
+  bool Init(EvLoopThread* thread) {
+    auto pair = Socket::OpenSocketPair(SOCK_SEQPACKET);
+    if (!pair) {
+      return false;
+    }
+
+    request_fd_ = std::move(pair->first);
+    client_fd_ = std::move(pair->second);
+
+    Socket::ReadBatch::Options batch_options;
+    batch_options.max_fds = 1;
+    batch_.emplace(kMaxRequestsPerRead, kRequestSize, batch_options);
+
+    ev_ = thread->evloop()->unsafe();
+    auto source = thread->evloop()->Acquire()->AddFd(
+        request_fd_.get(), EvLoop::Events::Status::kRead,
+        [this](EvLoop::SourceRef source, EvLoop::Events events) { HandleRequests(); });
+    return source.has_value();
+  }
+
+  // The end that stubs send their request sockets to.
+  int client_fd() const { return client_fd_.get(); }
+
+ private:
+  void HandleRequests() {
+    Socket::ReadManyOptions options;
+    options.nonblocking = true;
+
+    for (;;) {
+      ssize_t count = Socket::ReadMany(request_fd_.get(), &*batch_, options);
+      if (count == -1) {
+        ZYPAK_ASSERT(errno == EAGAIN || errno == EWOULDBLOCK);
+        return;
+      }
+
+      for (ssize_t i = 0; i < count; i++) {
+        Socket::ReadBatch::Message& message = batch_->message(i);
+        ZYPAK_ASSERT(message.error == 0 && message.fds.size() == 1);
+        ReadRequest(std::move(message.fds[0])).Detach();
+      }
+
+      if (static_cast<size_t>(count) < batch_->capacity()) {
+        return;
+      }
+    }
+  }
+
+  Task<> ReadRequest(unique_fd fd) {
+    AsyncSocket socket(ev_, std::move(fd));
+    std::vector<std::byte> header;
+    std::vector<unique_fd> fds;
+    std::vector<std::byte> args_block;
+    std::vector<unique_fd> no_fds;
+
+    bool ok = co_await socket.ReadFramed(&header, &fds);
+    if (ok) {
+      AsyncSocket::FramedReadOptions args_framed_options;
+      args_framed_options.max_fds = 0;
+      ok = co_await socket.ReadFramed(&args_block, &no_fds, args_framed_options);
+    }
+
+    if (!ok || args_block.empty() || args_block.back() != std::byte{0}) {
+      (*failures_)++;
+      co_return;
+    }
+
+    std::uint64_t argc;
+    std::memcpy(&argc, header.data(), sizeof(argc));
+
+    std::vector<cstring_view> argv;
+    argv.reserve(argc);
+    const char* args_end = reinterpret_cast<const char*>(args_block.data()) + args_block.size();
+    for (const char* arg = reinterpret_cast<const char*>(args_block.data()); arg != args_end;) {
+      cstring_view view(arg);
+      argv.push_back(view);
+      arg += view.size() + 1;
+    }
+
+    if (argv.size() != argc || fds.size() != kFdCount) {
+      (*failures_)++;
+      co_return;
+    }
+
+    if (!Socket::Write(socket.fd(), kReply)) {
+      (*failures_)++;
+    }
+  }
+
+  EvLoop* ev_ = nullptr;
+  unique_fd request_fd_;
+  unique_fd client_fd_;
+  std::optional<Socket::ReadBatch> batch_;
+  std::atomic<int>* failures_;
+};
+
+// Sends requests one after another, waiting for each to be read, like a stub would.
+void RunStub(int client_fd, const Request& request) {
+  for (int i = 0; i < kRequestsPerStub; i++) {
+    auto pair = Socket::OpenSocketPair();
+    ZYPAK_ASSERT(pair);
+    auto [our_end, their_end] = std::move(*pair);
+
+    std::vector<int> request_fds{their_end.get()};
+    Socket::WriteOptions options;
+    options.fds = &request_fds;
+    ZYPAK_ASSERT(Socket::Write(client_fd, kRequest, options));
+    their_end.reset();
+
+    ZYPAK_ASSERT(Socket::WriteFramed(our_end.get(), request.header, request.fds));
+    ZYPAK_ASSERT(Socket::WriteFramed(our_end.get(), request.args_block, {}));
+
+    std::array<std::byte, kReplySize> reply;
+    ZYPAK_ASSERT(Socket::Read(our_end.get(), &reply) == static_cast<ssize_t>(reply.size()),
+                 << "request #" << i << " was not read");
+  }
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("ingestion_perftest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  Request request = BuildRequest();
+
+  for (int stubs : kConcurrentStubs) {
+    std::unique_ptr<EvLoopThread> thread = EvLoopThread::Create("zypak-ingest");
+    ZYPAK_ASSERT(thread);
+
+    std::atomic<int> failures = 0;
+    Ingestion ingestion(&failures);
+    ZYPAK_ASSERT(ingestion.Init(thread.get()));
+    thread->Start();
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> stub_threads;
+    for (int i = 0; i < stubs; i++) {
+      stub_threads.emplace_back(RunStub, ingestion.client_fd(), std::cref(request));
+    }
+
+    for (std::thread& stub_thread : stub_threads) {
+      stub_thread.join();
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    thread->Shutdown();
+
+    ZYPAK_ASSERT(failures == 0, << failures << " requests failed");
+
+    int requests = stubs * kRequestsPerStub;
+    Log() << stubs << " concurrent stub(s): " << requests << " requests in " << elapsed.count()
+          << "s, " << requests / elapsed.count() << " requests/s, "
+          << elapsed.count() * 1e6 / requests << "us per request";
+  }
+
+  return 0;
+}
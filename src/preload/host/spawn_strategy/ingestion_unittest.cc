@@ -0,0 +1,360 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Stress test for the spawn request ingestion path, run the way the supervisor runs it (minus the
+// launcher and the D-Bus call): 64 stub processes all send requests over the shared SOCK_SEQPACKET
+// socket at once, each along with its own connection that the request frames go through. Every
+// request has to arrive intact and attributed to the right stub, every stub going away has to be
+// noticed via its connection, and stubs that die partway through a request must not leave the
+// reader waiting.
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/async_socket.h"
+#include "base/cstring_view.h"
+#include "base/debug.h"
+#include "base/evloop.h"
+#include "base/socket.h"
+#include "base/unique_fd.h"
+
+using namespace zypak;
+
+namespace {
+
+constexpr int kStubs = 64;
+constexpr int kRequestsPerStub = 8;
+// Every this many stubs, one dies in the middle of its last request.
+constexpr int kStubsPerDyingStub = 8;
+constexpr int kDyingStubs = kStubs / kStubsPerDyingStub;
+constexpr int kCompletedRequests = kStubs * kRequestsPerStub - kDyingStubs;
+
+constexpr size_t kFillerArgs = 32;
+constexpr size_t kFillerArgSize = 96;
+constexpr size_t kFdCount = 3;
+
+constexpr size_t kMaxRequestsPerRead = 16;
+
+constexpr std::string_view kRequest = "SPAWN";
+constexpr std::string_view kReply = "ok";
+// Both include the null terminator.
+constexpr size_t kRequestSize = kRequest.size() + 1;
+constexpr size_t kReplySize = kReply.size() + 1;
+
+constexpr int kRequestTimeoutMs = 10 * 1000;
+// If a stub fails, the requests it had left are never sent, so don't wait on them forever.
+constexpr int kTestTimeoutMs = 10 * 1000;
+
+constexpr std::string_view kStubArgPrefix = "--stub=";
+constexpr std::string_view kRequestArgPrefix = "--request=";
+
+std::vector<std::string> BuildArgs(pid_t stub, int request) {
+  std::vector<std::string> args;
+  args.push_back(std::string(kStubArgPrefix) + std::to_string(stub));
+  args.push_back(std::string(kRequestArgPrefix) + std::to_string(request));
+
+  for (size_t i = 0; i < kFillerArgs; i++) {
+    std::string arg = "--arg-" + std::to_string(i) + "=";
+    // Each stub's arguments look a little different, so any mixup shows.
+    arg.resize(kFillerArgSize - 1, static_cast<char>('a' + (stub + request + i) % 26));
+    args.push_back(std::move(arg));
+  }
+
+  return args;
+}
+
+// Runs in each forked stub, sending requests one after another like zypak-sandbox would, once the
+// start pipe is closed (so every stub starts at once).
+[[noreturn]] void RunStub(int index, int client_fd, int start_fd) {
+  char start;
+  ZYPAK_ASSERT(HANDLE_EINTR(read(start_fd, &start, 1)) == 0);
+
+  bool dies_early = index % kStubsPerDyingStub == kStubsPerDyingStub - 1;
+
+  for (int request = 0; request < kRequestsPerStub; request++) {
+    auto pair = Socket::OpenSocketPair();
+    ZYPAK_ASSERT(pair);
+    auto [our_end, their_end] = std::move(*pair);
+
+    std::vector<int> request_fds{their_end.get()};
+    Socket::WriteOptions options;
+    options.fds = &request_fds;
+    ZYPAK_ASSERT(Socket::Write(client_fd, kRequest, options));
+    their_end.reset();
+
+    std::vector<std::string> args = BuildArgs(getpid(), request);
+
+    std::vector<std::byte> header(sizeof(std::uint64_t) + kFdCount * sizeof(std::uint32_t));
+    std::uint64_t argc = args.size();
+    std::memcpy(header.data(), &argc, sizeof(argc));
+    std::vector<int> fds{STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    ZYPAK_ASSERT(Socket::WriteFramed(our_end.get(), header, fds));
+
+    if (dies_early && request == kRequestsPerStub - 1) {
+      // Gone before the command line was sent.
+      _exit(0);
+    }
+
+    std::vector<std::byte> args_block;
+    for (const std::string& arg : args) {
+      const std::byte* data = reinterpret_cast<const std::byte*>(arg.c_str());
+      args_block.insert(args_block.end(), data, data + arg.size() + 1);
+    }
+
+    ZYPAK_ASSERT(Socket::WriteFramed(our_end.get(), args_block, {}));
+
+    std::array<std::byte, kReplySize> reply;
+    ZYPAK_ASSERT(Socket::Read(our_end.get(), &reply) == static_cast<ssize_t>(reply.size()));
+  }
+
+  _exit(0);
+}
+
+class Ingestion {
+ public:
+  bool Init(EvLoop* ev) {
+    auto pair = Socket::OpenSocketPair(SOCK_SEQPACKET);
+    if (!pair || !Socket::EnableReceivePid(pair->first.get())) {
+      return false;
+    }
+
+    ev_ = ev;
+    request_fd_ = std::move(pair->first);
+    client_fd_ = std::move(pair->second);
+
+    Socket::ReadBatch::Options batch_options;
+    batch_options.max_fds = 1;
+    batch_options.receive_pid = true;
+    batch_.emplace(kMaxRequestsPerRead, kRequestSize, batch_options);
+
+    auto source = ev_->AddFd(request_fd_.get(), EvLoop::Events::Status::kRead,
+                             [this](EvLoop::SourceRef source, EvLoop::Events events) {
+                               HandleRequests();
+                             });
+    return source.has_value();
+  }
+
+  // The end that stubs send their request sockets to. Like the supervisor's, it stays open in this
+  // process, so the request socket never sees the stubs all going away.
+  int client_fd() const { return client_fd_.get(); }
+
+  bool done() const { return finished_ == kStubs * kRequestsPerStub; }
+
+  void Verify() const {
+    ZYPAK_ASSERT(invalid_messages_ == 0, << invalid_messages_ << " invalid messages");
+    ZYPAK_ASSERT(invalid_requests_ == 0, << invalid_requests_ << " invalid requests");
+    ZYPAK_ASSERT(completed_ == kCompletedRequests, << completed_ << " requests completed");
+    ZYPAK_ASSERT(truncated_ == kDyingStubs, << truncated_ << " requests truncated");
+    ZYPAK_ASSERT(seen_.size() == static_cast<size_t>(kCompletedRequests));
+    ZYPAK_ASSERT(hangups_ == kCompletedRequests, << hangups_ << " hangups");
+    Log() << kCompletedRequests << " requests from " << kStubs << " stubs over " << reads_
+          << " batched reads, " << kDyingStubs << " stubs died mid-request";
+  }
+
+ private:
+  void HandleRequests() {
+    Socket::ReadManyOptions options;
+    options.nonblocking = true;
+
+    for (;;) {
+      ssize_t count = Socket::ReadMany(request_fd_.get(), &*batch_, options);
+      if (count == -1) {
+        ZYPAK_ASSERT(errno == EAGAIN || errno == EWOULDBLOCK);
+        return;
+      }
+
+      reads_++;
+
+      for (ssize_t i = 0; i < count; i++) {
+        Socket::ReadBatch::Message& message = batch_->message(i);
+        bool valid = message.error == 0 && message.size == kRequestSize &&
+                     std::memcmp(message.data, kRequest.data(), kRequestSize) == 0 &&
+                     message.fds.size() == 1 && message.pid > 0;
+        if (!valid) {
+          invalid_messages_++;
+          finished_++;
+          continue;
+        }
+
+        ReadRequest(std::move(message.fds[0]), message.pid).Detach();
+      }
+
+      if (static_cast<size_t>(count) < batch_->capacity()) {
+        return;
+      }
+    }
+  }
+
+  Task<> ReadRequest(unique_fd fd, pid_t stub) {
+    // Counts this request as finished however it ends, so failures don't leave the test waiting.
+    struct FinishedScope {
+      int* finished;
+      ~FinishedScope() { (*finished)++; }
+    } finished_scope{&finished_};
+
+    AsyncSocket socket(ev_, std::move(fd));
+    std::vector<std::byte> header;
+    std::vector<unique_fd> fds;
+    std::vector<std::byte> args_block;
+    std::vector<unique_fd> no_fds;
+
+    AsyncSocket::OperationOptions read_options;
+    read_options.timeout_ms = kRequestTimeoutMs;
+
+    bool ok = co_await socket.ReadFramed(&header, &fds, {}, read_options);
+    if (!ok) {
+      invalid_requests_++;
+      co_return;
+    }
+
+    AsyncSocket::FramedReadOptions args_framed_options;
+    args_framed_options.max_fds = 0;
+    ok = co_await socket.ReadFramed(&args_block, &no_fds, args_framed_options, read_options);
+    if (!ok) {
+      // Only the stubs that die early can get here, and they all do it the same way.
+      if (errno == ECONNRESET) {
+        truncated_++;
+      } else {
+        invalid_requests_++;
+      }
+
+      co_return;
+    }
+
+    std::uint64_t argc;
+    std::memcpy(&argc, header.data(), sizeof(argc));
+
+    std::vector<cstring_view> argv;
+    const char* args_end = reinterpret_cast<const char*>(args_block.data()) + args_block.size();
+    for (const char* arg = reinterpret_cast<const char*>(args_block.data()); arg != args_end;) {
+      cstring_view view(arg);
+      argv.push_back(view);
+      arg += view.size() + 1;
+    }
+
+    if (argv.size() != argc || fds.size() != kFdCount || argv.size() < 2 ||
+        !argv[0].starts_with(kStubArgPrefix) || !argv[1].starts_with(kRequestArgPrefix)) {
+      invalid_requests_++;
+      co_return;
+    }
+
+    // The request must have come from the stub that sent the message, with exactly the arguments
+    // it built.
+    pid_t arg_stub = std::stoi(std::string(argv[0].substr(kStubArgPrefix.size())));
+    int request = std::stoi(std::string(argv[1].substr(kRequestArgPrefix.size())));
+    std::vector<std::string> expected = BuildArgs(stub, request);
+    bool matches = arg_stub == stub && expected.size() == argv.size();
+    for (size_t i = 0; matches && i < argv.size(); i++) {
+      matches = expected[i] == argv[i];
+    }
+
+    if (!matches || !seen_.emplace(stub, request).second) {
+      invalid_requests_++;
+      co_return;
+    }
+
+    completed_++;
+    if (!Socket::Write(socket.fd(), kReply)) {
+      invalid_requests_++;
+      co_return;
+    }
+
+    // Like the supervisor does, notice the stub closing its end (once it's moved on to the next
+    // request, or exited) via the connection. The loop drops sources for fds that hang up rather
+    // than dispatching them, so the wait ends either way, and the read shows which it was.
+    std::optional<EvLoop::Events> events =
+        co_await ev_->AwaitFd(socket.fd(), EvLoop::Events::Status::kRead);
+    std::array<std::byte, 1> unused;
+    if ((!events || !events->empty()) && Socket::Read(socket.fd(), &unused) == 0) {
+      hangups_++;
+    } else {
+      invalid_requests_++;
+    }
+  }
+
+  EvLoop* ev_ = nullptr;
+  unique_fd request_fd_;
+  unique_fd client_fd_;
+  std::optional<Socket::ReadBatch> batch_;
+
+  int reads_ = 0;
+  int invalid_messages_ = 0;
+  int invalid_requests_ = 0;
+  int completed_ = 0;
+  int truncated_ = 0;
+  int hangups_ = 0;
+  int finished_ = 0;
+  std::set<std::pair<pid_t, int>> seen_;
+};
+
+void TestConcurrentStubs() {
+  std::optional<EvLoop> ev = EvLoop::Create();
+  ZYPAK_ASSERT(ev);
+
+  Ingestion ingestion;
+  ZYPAK_ASSERT(ingestion.Init(&*ev));
+
+  int start_pipe[2];
+  ZYPAK_ASSERT_WITH_ERRNO(pipe2(start_pipe, O_CLOEXEC) != -1);
+  unique_fd start_read(start_pipe[0]);
+  unique_fd start_write(start_pipe[1]);
+
+  std::vector<pid_t> stubs;
+  for (int i = 0; i < kStubs; i++) {
+    pid_t pid = fork();
+    ZYPAK_ASSERT_WITH_ERRNO(pid != -1);
+    if (pid == 0) {
+      start_write.reset();
+      RunStub(i, ingestion.client_fd(), start_read.get());
+    }
+
+    stubs.push_back(pid);
+  }
+
+  // Let the stubs all start at once.
+  start_write.reset();
+
+  auto timeout = ev->AddTimerMs(kTestTimeoutMs, [&](EvLoop::SourceRef source) {
+    ingestion.Verify();
+    ZYPAK_ASSERT(false, << "Timed out waiting on the stubs");
+  });
+  ZYPAK_ASSERT(timeout);
+
+  while (!ingestion.done()) {
+    ZYPAK_ASSERT(ev->Wait() == EvLoop::WaitResult::kReady);
+    ZYPAK_ASSERT(ev->Dispatch() == EvLoop::DispatchResult::kContinue);
+  }
+
+  for (pid_t stub : stubs) {
+    int status;
+    ZYPAK_ASSERT_WITH_ERRNO(waitpid(stub, &status, 0) == stub);
+    ZYPAK_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                 << "stub " << stub << " failed with status " << status);
+  }
+
+  ingestion.Verify();
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("ingestion_unittest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  TestConcurrentStubs();
+
+  Log() << "All tests passed";
+  return 0;
+}
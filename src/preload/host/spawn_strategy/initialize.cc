@@ -34,6 +34,7 @@ int MAIN_OVERRIDE(int argc, char** argv, char** envp) {
   ZYPAK_ASSERT(supervisor->InitAndAttachToBusThread(bus));
 
   int ret = true_main(argc, argv, envp);
+  supervisor->Shutdown();
   bus->Shutdown();
 
   return ret;
@@ -0,0 +1,169 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how long kill() takes for a spawned process the way the supervisor delivers it, minus
+// the D-Bus side: the process's pidfd is looked up in the process table under a shared lock, then
+// signaled directly. There are 200 live children, and the latency is reported with the table
+// otherwise idle, and with another thread handling SpawnStarted messages for them at the same time,
+// once opening the pidfd and /proc directory under the table's lock (as the handler used to) and
+// once before taking it.
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "base/debug.h"
+#include "base/guarded_value.h"
+#include "base/pidfd.h"
+#include "base/process_usage.h"
+#include "base/unique_fd.h"
+#include "preload/host/spawn_strategy/process_table.h"
+
+using namespace zypak;
+using namespace zypak::preload;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kChildCount = 200;
+constexpr int kKillSamples = 20 * 1000;
+// How often SpawnStarted messages arrive, which is far more often than in practice, but keeps the
+// # of times the lock is taken the same no matter how long each one holds it.
+constexpr auto kStartedInterval = std::chrono::microseconds(100);
+
+struct Child {
+  unique_fd pidfd;
+  unique_fd proc_dir;
+};
+
+using Table = KeyedNotifyingGuardedValue<ProcessTable<Child>, pid_t>;
+
+enum class StartedHandler { kNone, kOpenUnderLock, kOpenBeforeLock };
+
+// Same as Supervisor::HandleSpawnStarted, minus finding the stub by its external pid.
+void HandleStarted(Table* table, pid_t pid, StartedHandler handler) {
+  std::optional<unique_fd> pidfd;
+  std::optional<unique_fd> proc_dir;
+  if (handler == StartedHandler::kOpenBeforeLock) {
+    pidfd = Pidfd::Open(pid);
+    proc_dir = ProcessUsage::OpenProcDir(pid);
+  }
+
+  auto guard = table->Acquire();
+  Child* child = guard->Find(pid);
+  ZYPAK_ASSERT(child != nullptr);
+
+  if (handler == StartedHandler::kOpenUnderLock) {
+    pidfd = Pidfd::Open(pid);
+    proc_dir = ProcessUsage::OpenProcDir(pid);
+  }
+
+  // The handler fills in a new entry, so there's nothing to close there. Here, the old FDs are
+  // swapped out and closed once the lock is released.
+  ZYPAK_ASSERT(pidfd && proc_dir);
+  std::swap(child->pidfd, *pidfd);
+  std::swap(child->proc_dir, *proc_dir);
+}
+
+// Same as Supervisor::SendSignal for a process that already started.
+void Kill(Table* table, pid_t pid) {
+  auto guard = table->AcquireShared();
+  const Child* child = guard->Find(pid);
+  ZYPAK_ASSERT(child != nullptr);
+  ZYPAK_ASSERT(Pidfd::SendSignal(child->pidfd.get(), SIGUSR1));
+}
+
+void MeasureKillLatency(Table* table, const std::vector<pid_t>& children, const char* name,
+                        StartedHandler handler) {
+  std::atomic<bool> done = false;
+  std::optional<std::thread> started_thread;
+  if (handler != StartedHandler::kNone) {
+    started_thread.emplace([&]() {
+      Clock::time_point next = Clock::now();
+      for (size_t i = 0; !done.load(std::memory_order_relaxed); i++) {
+        HandleStarted(table, children[i % children.size()], handler);
+        next += kStartedInterval;
+        std::this_thread::sleep_until(next);
+      }
+    });
+  }
+
+  std::vector<std::int64_t> latencies(kKillSamples);
+  for (int i = 0; i < kKillSamples; i++) {
+    Clock::time_point start = Clock::now();
+    Kill(table, children[i % children.size()]);
+    latencies[i] =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+  }
+
+  done = true;
+  if (started_thread) {
+    started_thread->join();
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](int p) { return latencies[latencies.size() * p / 100] / 1000.0; };
+  Log() << "kill() latency (" << name << "): p50 " << percentile(50) << "us, p99 "
+        << percentile(99) << "us, max " << latencies.back() / 1000.0 << "us";
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("kill_perftest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  // The children inherit this, so the signals are actually delivered and handled, instead of being
+  // dropped as ignored.
+  struct sigaction action {};
+  action.sa_handler = [](int signal) {};
+  ZYPAK_ASSERT_WITH_ERRNO(sigaction(SIGUSR1, &action, nullptr) == 0);
+
+  std::vector<pid_t> children;
+  for (int i = 0; i < kChildCount; i++) {
+    pid_t pid = fork();
+    ZYPAK_ASSERT_WITH_ERRNO(pid != -1);
+    if (pid == 0) {
+      for (;;) {
+        pause();
+      }
+    }
+
+    children.push_back(pid);
+  }
+
+  Table table;
+  for (pid_t pid : children) {
+    table.Acquire()->Insert(pid);
+    HandleStarted(&table, pid, StartedHandler::kOpenBeforeLock);
+  }
+
+  // Warm up the table and the signal paths first, so the first measurement isn't the odd one out.
+  for (int i = 0; i < kKillSamples; i++) {
+    Kill(&table, children[i % children.size()]);
+  }
+
+  MeasureKillLatency(&table, children, "idle table", StartedHandler::kNone);
+  MeasureKillLatency(&table, children, "SpawnStarted opening under the lock",
+                     StartedHandler::kOpenUnderLock);
+  MeasureKillLatency(&table, children, "SpawnStarted opening before the lock",
+                     StartedHandler::kOpenBeforeLock);
+
+  for (pid_t pid : children) {
+    ZYPAK_ASSERT_WITH_ERRNO(kill(pid, SIGKILL) == 0);
+    ZYPAK_ASSERT_WITH_ERRNO(HANDLE_EINTR(waitpid(pid, nullptr, 0)) == pid);
+  }
+
+  return 0;
+}
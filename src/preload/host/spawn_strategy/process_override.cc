@@ -3,10 +3,15 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
-// Overrides waitpid / kill so they talk to the portal when needed.
+// Overrides kill and the wait family of functions so they talk to the portal when needed.
 
+#include <sys/resource.h>
 #include <sys/signal.h>
 #include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
 
 #include "preload/declare_override.h"
 #include "preload/host/spawn_strategy/supervisor.h"
@@ -14,13 +19,129 @@
 using namespace zypak;
 using namespace zypak::preload;
 
+namespace {
+
+// While blocked waiting on any child or on a group, how often to check for local children as well.
+// Spawned processes wake the wait as soon as they exit, but nothing can do the same for local
+// children.
+constexpr std::chrono::milliseconds kLocalChildPollInterval(50);
+
+// Returns the pid of a local child targeted by the given waitpid() pid that can be reaped, without
+// actually reaping it. Stubs are left alone, because the supervisor is in charge of those.
+pid_t PeekExitedLocalChild(Supervisor* supervisor, pid_t pid) {
+  idtype_t type = pid == -1 ? P_ALL : P_PGID;
+  id_t id = pid == -1 ? 0 : pid == 0 ? getpgrp() : -pid;
+
+  siginfo_t info;
+  info.si_pid = 0;
+  if (waitid(type, id, &info, WEXITED | WNOHANG | WNOWAIT) == -1) {
+    return 0;
+  }
+
+  // Only the first exited child can be seen this way, so if it's a stub, anything behind it has to
+  // wait until the supervisor reaps it (which happens right after it exits).
+  if (info.si_pid == 0 || supervisor->ManagesStub(info.si_pid)) {
+    return 0;
+  }
+
+  return info.si_pid;
+}
+
+// Fills in the siginfo for an exit, like waitid would, from a waitpid-style exit status.
+void StatusToSiginfo(pid_t pid, int status, siginfo_t* info) {
+  info->si_signo = SIGCHLD;
+  info->si_pid = pid;
+  info->si_uid = getuid();
+
+  if (WIFEXITED(status)) {
+    info->si_code = CLD_EXITED;
+    info->si_status = WEXITSTATUS(status);
+  } else {
+    info->si_code = WCOREDUMP(status) ? CLD_DUMPED : CLD_KILLED;
+    info->si_status = WTERMSIG(status);
+  }
+}
+
+// The shared implementation of the wait overrides, taking a waitpid-style pid. Anything that isn't
+// a spawned process is passed on to the fallback, which calls the original function.
+template <typename Fallback>
+pid_t WaitForChild(cstring_view func, pid_t pid, int* status, int options, struct rusage* usage,
+                   Fallback fallback) {
+  Supervisor* supervisor = Supervisor::Acquire();
+
+  if (options & (WUNTRACED | WCONTINUED)) {
+    Log() << "Warning: " << func << " override ignores WUNTRACED/WCONTINUED";
+  }
+
+  if (pid <= 0) {
+    // Both local children and spawned processes can be targeted, so check both until one of them
+    // has exited.
+    for (;;) {
+      if (pid_t local = PeekExitedLocalChild(supervisor, pid)) {
+        return fallback(local, status, options);
+      }
+
+      std::chrono::milliseconds timeout(0);
+      if (!(options & WNOHANG)) {
+        timeout = kLocalChildPollInterval;
+      }
+
+      pid_t stub_pid = 0;
+      Supervisor::Result result =
+          supervisor->TakeNextExitStatus(pid, &stub_pid, status, timeout, usage);
+      if (result == Supervisor::Result::kOk) {
+        return stub_pid;
+      } else if (result == Supervisor::Result::kNotFound) {
+        // Only local children are left. Stubs stay targeted until they're reaped, even after their
+        // statuses were taken, so this can't reap one out from under the supervisor.
+        return fallback(pid, status, options);
+      } else if (result != Supervisor::Result::kTryLater) {
+        errno = EIO;
+        return -1;
+      } else if (options & WNOHANG) {
+        return 0;
+      }
+    }
+  }
+
+  Supervisor::Result result = options & WNOHANG
+                                  ? supervisor->GetExitStatus(pid, status, usage)
+                                  : supervisor->WaitForExitStatus(pid, status, usage);
+  if (result == Supervisor::Result::kNotFound) {
+    return fallback(pid, status, options);
+  } else if (result == Supervisor::Result::kTryLater) {
+    ZYPAK_ASSERT(options & WNOHANG);
+    return 0;
+  } else if (result != Supervisor::Result::kOk) {
+    errno = EIO;
+    return -1;
+  } else {
+    return pid;
+  }
+}
+
+}  // namespace
+
 DECLARE_OVERRIDE(int, kill, pid_t pid, int sig) {
   auto original = LoadOriginal();
   Supervisor* supervisor = Supervisor::Acquire();
 
   if (pid <= 0) {
-    Log() << "Warning: kill override ignores groups";
-    return original(pid, sig);
+    // The local processes in the group (including the stubs) are signaled as usual, but the
+    // processes spawned for the stubs need to be signaled separately, all at once.
+    Supervisor::Result result = supervisor->SendGroupSignal(pid, sig);
+    int ret = original(pid, sig);
+    if (ret == -1 && errno == ESRCH && result != Supervisor::Result::kNotFound) {
+      // Nothing local was targeted, but the spawned processes were.
+      ret = 0;
+    }
+
+    if (ret == 0 && result == Supervisor::Result::kFailed) {
+      errno = EIO;
+      return -1;
+    }
+
+    return ret;
   }
 
   Supervisor::Result result = supervisor->SendSignal(pid, sig);
@@ -36,30 +157,86 @@ DECLARE_OVERRIDE(int, kill, pid_t pid, int sig) {
 
 DECLARE_OVERRIDE_THROW(pid_t, waitpid, pid_t pid, int* status, int options) {
   auto original = LoadOriginal();
-  Supervisor* supervisor = Supervisor::Acquire();
 
   Debug() << "waitpid(" << pid << ")";
+  return WaitForChild("waitpid", pid, status, options, nullptr,
+                      [original](pid_t pid, int* status, int options) {
+                        return original(pid, status, options);
+                      });
+}
 
-  if (pid <= 0) {
-    Log() << "Warning: waitpid override ignores groups";
-    return original(pid, status, options);
+DECLARE_OVERRIDE(pid_t, wait4, pid_t pid, int* status, int options, struct rusage* usage) {
+  auto original = LoadOriginal();
+
+  Debug() << "wait4(" << pid << ")";
+  return WaitForChild("wait4", pid, status, options, usage,
+                      [original, usage](pid_t pid, int* status, int options) {
+                        return original(pid, status, options, usage);
+                      });
+}
+
+DECLARE_OVERRIDE(pid_t, wait3, int* status, int options, struct rusage* usage) {
+  auto original = LoadOriginal();
+
+  Debug() << "wait3()";
+  return WaitForChild("wait3", -1, status, options, usage,
+                      [original, usage](pid_t pid, int* status, int options) {
+                        ZYPAK_ASSERT(pid == -1 || pid > 0);
+                        // wait3 can only wait on any child, so use wait4 for specific ones.
+                        return pid == -1 ? original(status, options, usage)
+                                         : wait4(pid, status, options, usage);
+                      });
+}
+
+DECLARE_OVERRIDE_THROW(int, waitid, idtype_t idtype, id_t id, siginfo_t* info, int options) {
+  auto original = LoadOriginal();
+
+  Debug() << "waitid(" << idtype << ", " << id << ")";
+
+  pid_t pid;
+  switch (idtype) {
+  case P_PID:
+    pid = id;
+    break;
+  case P_PGID:
+    pid = -static_cast<pid_t>(id);
+    break;
+  case P_ALL:
+    pid = -1;
+    break;
+  default:
+    // pidfds can only refer to local children.
+    return original(idtype, id, info, options);
   }
 
-  if (options & (WUNTRACED | WCONTINUED)) {
-    Log() << "Warning: waitpid override ignores WUNTRACED/WCONTINUED";
+  if (!(options & WEXITED) || (options & WNOWAIT)) {
+    // Spawned processes only ever report their exit, and can't be left in a waitable state.
+    Log() << "Warning: waitid override ignores calls without WEXITED or with WNOWAIT";
+    return original(idtype, id, info, options);
   }
 
-  Supervisor::Result result = options & WNOHANG ? supervisor->GetExitStatus(pid, status)
-                                                : supervisor->WaitForExitStatus(pid, status);
-  if (result == Supervisor::Result::kNotFound) {
-    return original(pid, status, options);
-  } else if (result == Supervisor::Result::kTryLater) {
-    ZYPAK_ASSERT(options & WNOHANG);
-    return 0;
-  } else if (result != Supervisor::Result::kOk) {
-    errno = EIO;
+  bool filled_by_original = false;
+  int status = 0;
+  pid_t result = WaitForChild(
+      "waitid", pid, &status, options & ~WEXITED, nullptr,
+      [&](pid_t pid, int* status, int options) -> pid_t {
+        filled_by_original = true;
+        idtype_t target_type = pid > 0 ? P_PID : idtype;
+        id_t target_id = pid > 0 ? pid : id;
+        if (original(target_type, target_id, info, options | WEXITED) == -1) {
+          return -1;
+        }
+
+        return info->si_pid;
+      });
+  if (result == -1) {
     return -1;
-  } else {
-    return pid;
+  } else if (!filled_by_original) {
+    std::memset(info, 0, sizeof(*info));
+    if (result != 0) {
+      StatusToSiginfo(result, status, info);
+    }
   }
+
+  return 0;
 }
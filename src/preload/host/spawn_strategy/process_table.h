@@ -0,0 +1,295 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "base/base.h"
+#include "base/debug.h"
+
+namespace zypak::preload {
+
+// A hash map from pids to values, using open addressing with linear probing, so that all the
+// entries live in a single flat array instead of a separate allocation per entry. Erased entries
+// leave tombstones behind, which are dropped whenever the table is rebuilt, so the memory used only
+// depends on the most entries that were ever present at once.
+template <typename Value>
+class PidMap {
+ public:
+  size_t size() const { return size_; }
+  // The # of slots, which only grows with the most entries that were present at once.
+  size_t capacity() const { return slots_.size(); }
+
+  const Value* Find(pid_t pid) const {
+    ZYPAK_ASSERT(pid > 0);
+
+    if (std::optional<size_t> index = FindIndex(pid)) {
+      return &slots_[*index].value;
+    }
+
+    return nullptr;
+  }
+
+  Value* Find(pid_t pid) {
+    return const_cast<Value*>(static_cast<const PidMap*>(this)->Find(pid));
+  }
+
+  // Inserts the value, replacing any existing one for the same pid.
+  Value* Insert(pid_t pid, Value value) {
+    ZYPAK_ASSERT(pid > 0);
+
+    if (Value* existing = Find(pid)) {
+      *existing = std::move(value);
+      return existing;
+    }
+
+    // Keep the table at most half full, counting tombstones, so probes stay short.
+    if ((used_ + 1) * 2 > slots_.size()) {
+      // If most of what's used is tombstones, rebuilding at the same size is enough.
+      size_t capacity = std::max(kMinCapacity, slots_.size());
+      if ((size_ + 1) * 2 > capacity / 2) {
+        capacity *= 2;
+      }
+
+      Rehash(capacity);
+    }
+
+    for (size_t index = Hash(pid);; index = (index + 1) & (slots_.size() - 1)) {
+      Slot& slot = slots_[index];
+      if (slot.key == kEmpty || slot.key == kTombstone) {
+        if (slot.key == kEmpty) {
+          used_++;
+        }
+
+        size_++;
+        slot.key = pid;
+        slot.value = std::move(value);
+        return &slot.value;
+      }
+    }
+  }
+
+  bool Erase(pid_t pid) {
+    ZYPAK_ASSERT(pid > 0);
+
+    std::optional<size_t> index = FindIndex(pid);
+    if (!index) {
+      return false;
+    }
+
+    Slot& slot = slots_[*index];
+    slot.key = kTombstone;
+    // Don't keep anything the value owns alive until the slot is reused.
+    slot.value = Value();
+    size_--;
+    return true;
+  }
+
+  // Calls the function with each pid and its value. The map must not be modified until it returns.
+  template <typename Func>
+  void ForEach(Func func) {
+    for (Slot& slot : slots_) {
+      if (slot.key > 0) {
+        func(slot.key, slot.value);
+      }
+    }
+  }
+
+  template <typename Func>
+  void ForEach(Func func) const {
+    for (const Slot& slot : slots_) {
+      if (slot.key > 0) {
+        func(slot.key, slot.value);
+      }
+    }
+  }
+
+ private:
+  // pid 0 never refers to a process, and negative ones are process groups.
+  static constexpr pid_t kEmpty = 0;
+  static constexpr pid_t kTombstone = -1;
+
+  static constexpr size_t kMinCapacity = 16;
+
+  struct Slot {
+    pid_t key = kEmpty;
+    Value value;
+  };
+
+  size_t Hash(pid_t pid) const {
+    // pids are mostly sequential, so spread them out over the table (Fibonacci hashing).
+    return (static_cast<std::uint64_t>(pid) * 0x9E3779B97F4A7C15ull >> 32) & (slots_.size() - 1);
+  }
+
+  std::optional<size_t> FindIndex(pid_t pid) const {
+    if (slots_.empty()) {
+      return {};
+    }
+
+    for (size_t index = Hash(pid);; index = (index + 1) & (slots_.size() - 1)) {
+      const Slot& slot = slots_[index];
+      if (slot.key == pid) {
+        return index;
+      } else if (slot.key == kEmpty) {
+        return {};
+      }
+    }
+  }
+
+  void Rehash(size_t capacity) {
+    std::vector<Slot> old_slots(capacity);
+    std::swap(slots_, old_slots);
+    size_ = 0;
+    used_ = 0;
+
+    for (Slot& slot : old_slots) {
+      if (slot.key > 0) {
+        Insert(slot.key, std::move(slot.value));
+      }
+    }
+  }
+
+  std::vector<Slot> slots_;
+  size_t size_ = 0;
+  // The # of slots that aren't empty, i.e. the size plus the tombstones.
+  size_t used_ = 0;
+};
+
+// The table of supervised processes, keyed by stub pid, with a secondary index by external pid.
+// Every entry gets a new generation when it's inserted, so a handle to an entry can tell if the
+// entry was since removed, even if the same stub pid was reused for a new one.
+template <typename Value>
+class ProcessTable {
+ public:
+  struct Handle {
+    pid_t stub;
+    std::uint64_t generation;
+  };
+
+  size_t size() const { return entries_.size(); }
+  size_t capacity() const { return entries_.capacity() + by_external_.capacity(); }
+
+  // Adds a new entry for the stub, replacing any existing one.
+  Handle Insert(pid_t stub) {
+    Erase(stub);
+
+    std::uint64_t generation = next_generation_++;
+    entries_.Insert(stub, Entry{generation, 0, Value()});
+    return Handle{stub, generation};
+  }
+
+  const Value* Find(pid_t stub) const {
+    if (const Entry* entry = entries_.Find(stub)) {
+      return &entry->value;
+    }
+
+    return nullptr;
+  }
+
+  Value* Find(pid_t stub) {
+    return const_cast<Value*>(static_cast<const ProcessTable*>(this)->Find(stub));
+  }
+
+  // Returns nullptr if the handle's entry was removed.
+  const Value* Find(Handle handle) const {
+    const Entry* entry = entries_.Find(handle.stub);
+    if (entry == nullptr || entry->generation != handle.generation) {
+      return nullptr;
+    }
+
+    return &entry->value;
+  }
+
+  Value* Find(Handle handle) {
+    return const_cast<Value*>(static_cast<const ProcessTable*>(this)->Find(handle));
+  }
+
+  bool Contains(pid_t stub) const { return entries_.Find(stub) != nullptr; }
+
+  // Associates the external pid with the stub, replacing any previous process with the same
+  // external pid.
+  void SetExternal(pid_t stub, pid_t external) {
+    Entry* entry = entries_.Find(stub);
+    ZYPAK_ASSERT(entry != nullptr);
+
+    entry->external = external;
+    by_external_.Insert(external, ExternalEntry{stub, entry->generation});
+  }
+
+  // Returns the stub whose process has the given external pid.
+  std::optional<pid_t> FindStubByExternal(pid_t external) {
+    ExternalEntry* external_entry = by_external_.Find(external);
+    if (external_entry == nullptr) {
+      return {};
+    }
+
+    // The index is always updated along with the entries, so this can't be out of date.
+    ZYPAK_ASSERT(Find(Handle{external_entry->stub, external_entry->generation}) != nullptr);
+    return external_entry->stub;
+  }
+
+  bool Erase(pid_t stub) {
+    Entry* entry = entries_.Find(stub);
+    if (entry == nullptr) {
+      return false;
+    }
+
+    // If the external pid was since reused by a newer process, the index belongs to that one now.
+    if (entry->external > 0) {
+      ExternalEntry* external_entry = by_external_.Find(entry->external);
+      if (external_entry != nullptr && external_entry->stub == stub &&
+          external_entry->generation == entry->generation) {
+        by_external_.Erase(entry->external);
+      }
+    }
+
+    entries_.Erase(stub);
+    return true;
+  }
+
+  // Like Erase(pid_t), but only if the handle's entry is still present.
+  bool Erase(Handle handle) {
+    if (Find(handle) == nullptr) {
+      return false;
+    }
+
+    return Erase(handle.stub);
+  }
+
+  // Calls the function with each stub pid and its value. The table must not be modified until it
+  // returns.
+  template <typename Func>
+  void ForEach(Func func) {
+    entries_.ForEach([&](pid_t stub, Entry& entry) { func(stub, entry.value); });
+  }
+
+  template <typename Func>
+  void ForEach(Func func) const {
+    entries_.ForEach([&](pid_t stub, const Entry& entry) { func(stub, entry.value); });
+  }
+
+ private:
+  struct Entry {
+    std::uint64_t generation = 0;
+    pid_t external = 0;
+    Value value;
+  };
+
+  struct ExternalEntry {
+    pid_t stub = 0;
+    std::uint64_t generation = 0;
+  };
+
+  PidMap<Entry> entries_;
+  PidMap<ExternalEntry> by_external_;
+  std::uint64_t next_generation_ = 1;
+};
+
+}  // namespace zypak::preload
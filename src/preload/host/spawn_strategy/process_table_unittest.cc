@@ -0,0 +1,250 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Puts PidMap and ProcessTable through the same kind of churn that a long-running browser does,
+// checking that memory stays flat and reporting what lookups cost.
+
+#include "preload/host/spawn_strategy/process_table.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+#include "base/debug.h"
+
+using namespace zypak;
+using namespace zypak::preload;
+
+namespace {
+
+// The kernel hands out pids sequentially and wraps around at pid_max, so pids get reused all the
+// time in a long-running session. This is the default pid_max on 32-bit systems, small enough for
+// the soak to wrap around several times.
+constexpr pid_t kPidMax = 32768;
+
+constexpr int kSoakSpawns = 100 * 1000;
+// Roughly how many processes a busy browser keeps around at once.
+constexpr size_t kSoakLive = 64;
+// Memory has to be flat from this point of the soak onwards.
+constexpr int kSoakWarmupSpawns = 1000;
+
+constexpr int kLookupRounds = 1000;
+
+class PidAllocator {
+ public:
+  pid_t Next() {
+    next_ = next_ % kPidMax + 1;
+    return next_;
+  }
+
+ private:
+  pid_t next_ = 0;
+};
+
+void TestInsertErase() {
+  PidMap<int> map;
+  ZYPAK_ASSERT(map.Find(1) == nullptr);
+  ZYPAK_ASSERT(!map.Erase(1));
+
+  for (pid_t pid = 1; pid <= 1000; pid++) {
+    ZYPAK_ASSERT(*map.Insert(pid, pid * 2) == pid * 2);
+  }
+
+  ZYPAK_ASSERT(map.size() == 1000);
+
+  // Inserting an existing pid replaces its value.
+  map.Insert(10, 1);
+  ZYPAK_ASSERT(map.size() == 1000);
+  ZYPAK_ASSERT(*map.Find(10) == 1);
+
+  for (pid_t pid = 1; pid <= 1000; pid += 2) {
+    ZYPAK_ASSERT(map.Erase(pid));
+    ZYPAK_ASSERT(!map.Erase(pid));
+  }
+
+  ZYPAK_ASSERT(map.size() == 500);
+  for (pid_t pid = 1; pid <= 1000; pid++) {
+    int* value = map.Find(pid);
+    if (pid % 2 == 1) {
+      ZYPAK_ASSERT(value == nullptr, << pid);
+    } else {
+      ZYPAK_ASSERT(value != nullptr && *value == (pid == 10 ? 1 : pid * 2), << pid);
+    }
+  }
+
+  size_t visited = 0;
+  map.ForEach([&](pid_t pid, int& value) {
+    ZYPAK_ASSERT(pid % 2 == 0);
+    visited++;
+  });
+  ZYPAK_ASSERT(visited == 500);
+}
+
+void TestTombstones() {
+  PidMap<int> map;
+  for (pid_t pid = 1; pid <= 100; pid++) {
+    map.Insert(pid, pid);
+  }
+
+  size_t capacity = map.capacity();
+
+  // Churn through far more pids than there are slots, one at a time, so nearly every slot ends up
+  // as a tombstone between rebuilds. Probes for missing pids must still terminate, and the table
+  // must not grow, since it never holds more than one entry at once.
+  for (pid_t pid = 1; pid <= 100; pid++) {
+    ZYPAK_ASSERT(map.Erase(pid));
+  }
+
+  for (pid_t pid = 1000; pid < 1000 + static_cast<pid_t>(capacity) * 16; pid++) {
+    map.Insert(pid, pid);
+    ZYPAK_ASSERT(map.Find(pid - 1) == nullptr);
+    ZYPAK_ASSERT(map.Find(pid + 1) == nullptr);
+    ZYPAK_ASSERT(map.Erase(pid));
+  }
+
+  ZYPAK_ASSERT(map.size() == 0);
+  ZYPAK_ASSERT(map.capacity() == capacity, << map.capacity() << " != " << capacity);
+  ZYPAK_ASSERT(map.Find(1) == nullptr);
+}
+
+void TestReuseAcrossGenerations() {
+  ProcessTable<int> table;
+
+  // A stub pid reused by a new stub gets a new generation, so handles to the old one go stale.
+  auto old_handle = table.Insert(100);
+  *table.Find(old_handle) = 1;
+  ZYPAK_ASSERT(table.Erase(100));
+  ZYPAK_ASSERT(table.Find(old_handle) == nullptr);
+
+  auto new_handle = table.Insert(100);
+  ZYPAK_ASSERT(new_handle.generation != old_handle.generation);
+  ZYPAK_ASSERT(table.Find(old_handle) == nullptr);
+  ZYPAK_ASSERT(*table.Find(new_handle) == 0);
+  ZYPAK_ASSERT(!table.Erase(old_handle));
+  ZYPAK_ASSERT(table.Contains(100));
+
+  // Replacing an entry in place also invalidates old handles, along with its external pid.
+  table.SetExternal(100, 5000);
+  auto replaced_handle = table.Insert(100);
+  ZYPAK_ASSERT(table.Find(new_handle) == nullptr);
+  ZYPAK_ASSERT(table.Find(replaced_handle) != nullptr);
+  ZYPAK_ASSERT(!table.FindStubByExternal(5000));
+
+  // An external pid reused by a newer process belongs to that one, even once the older process's
+  // stub goes away.
+  table.Insert(200);
+  table.SetExternal(100, 6000);
+  table.SetExternal(200, 6000);
+  ZYPAK_ASSERT(table.FindStubByExternal(6000) == 200);
+  ZYPAK_ASSERT(table.Erase(replaced_handle));
+  ZYPAK_ASSERT(table.FindStubByExternal(6000) == 200);
+  ZYPAK_ASSERT(table.Erase(200));
+  ZYPAK_ASSERT(!table.FindStubByExternal(6000));
+
+  ZYPAK_ASSERT(table.size() == 0);
+}
+
+// Both the stub and external pids wrap around, and external pids come from a separate namespace,
+// so they get reused independently of the stubs.
+void SoakAndReportLookupCost() {
+  ProcessTable<int> table;
+  PidAllocator stub_pids;
+  PidAllocator external_pids;
+
+  struct Live {
+    ProcessTable<int>::Handle handle;
+    pid_t external;
+  };
+
+  std::deque<Live> live;
+  size_t warm_capacity = 0;
+
+  for (int spawn = 0; spawn < kSoakSpawns; spawn++) {
+    if (spawn == kSoakWarmupSpawns) {
+      warm_capacity = table.capacity();
+    }
+
+    pid_t stub = stub_pids.Next();
+    // Every so often, a stub outlives so many newer ones that its pid comes around again while
+    // it's still present, replacing it.
+    std::erase_if(live, [stub](const Live& entry) { return entry.handle.stub == stub; });
+
+    Live entry{table.Insert(stub), external_pids.Next()};
+    *table.Find(entry.handle) = spawn;
+    table.SetExternal(stub, entry.external);
+    live.push_back(entry);
+
+    if (live.size() > kSoakLive) {
+      // Processes don't exit in the order they started, so mix it up a bit.
+      size_t index = spawn % 3 == 0 ? live.size() / 2 : 0;
+      Live exited = live[index];
+      live.erase(live.begin() + index);
+
+      ZYPAK_ASSERT(table.FindStubByExternal(exited.external) == exited.handle.stub);
+      ZYPAK_ASSERT(table.Erase(exited.handle));
+      ZYPAK_ASSERT(table.Find(exited.handle) == nullptr);
+    }
+  }
+
+  ZYPAK_ASSERT(table.size() == live.size());
+  ZYPAK_ASSERT(table.capacity() == warm_capacity,
+               << "capacity grew from " << warm_capacity << " to " << table.capacity());
+  Log() << "Soak of " << kSoakSpawns << " spawns with " << kSoakLive
+        << " live kept capacity at " << warm_capacity << " slots";
+
+  using Clock = std::chrono::steady_clock;
+
+  // Keep the results alive so the lookups can't be optimized out.
+  std::uint64_t found = 0;
+  auto start = Clock::now();
+  for (int round = 0; round < kLookupRounds; round++) {
+    for (const Live& entry : live) {
+      found += table.Find(entry.handle) != nullptr;
+    }
+  }
+  auto stub_elapsed = Clock::now() - start;
+
+  start = Clock::now();
+  for (int round = 0; round < kLookupRounds; round++) {
+    for (const Live& entry : live) {
+      found += table.FindStubByExternal(entry.external).has_value();
+    }
+  }
+  auto external_elapsed = Clock::now() - start;
+
+  // Misses have to probe until an empty slot, so they're the worst case.
+  start = Clock::now();
+  for (int round = 0; round < kLookupRounds; round++) {
+    for (const Live& entry : live) {
+      found += table.Contains(entry.handle.stub % kPidMax + kPidMax);
+    }
+  }
+  auto miss_elapsed = Clock::now() - start;
+
+  ZYPAK_ASSERT(found == 2 * kLookupRounds * live.size());
+
+  auto per_lookup = [&](Clock::duration elapsed) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() /
+           static_cast<double>(kLookupRounds * live.size());
+  };
+
+  Log() << "Lookup cost: " << per_lookup(stub_elapsed) << "ns by stub, "
+        << per_lookup(external_elapsed) << "ns by external pid, " << per_lookup(miss_elapsed)
+        << "ns for a miss";
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("process_table_unittest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  TestInsertErase();
+  TestTombstones();
+  TestReuseAcrossGenerations();
+  SoakAndReportLookupCost();
+
+  Log() << "All tests passed";
+  return 0;
+}
@@ -0,0 +1,189 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how long it takes to terminate and reap 150 children at browser shutdown, the way the
+// supervisor tracks them, minus the portal: each child's pidfd is watched from an EvLoopThread
+// standing in for the bus thread, which collects the child once it exits and queues its exit like
+// SpawnExited does. Like a renderer, each child takes a moment to exit after SIGTERM. Chromium's
+// own shutdown, killing each child then waiting on it in turn, is compared against a single group
+// kill that fans out to every child, followed by waits on the group that take the exits in
+// whatever order they arrive.
+
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "base/coroutine.h"
+#include "base/debug.h"
+#include "base/evloop_thread.h"
+#include "base/guarded_value.h"
+#include "base/pidfd.h"
+#include "base/unique_fd.h"
+#include "preload/host/spawn_strategy/exit_queue.h"
+
+using namespace zypak;
+using namespace zypak::preload;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kChildCount = 150;
+constexpr int kRounds = 5;
+// How long a child takes to clean up once it's asked to exit.
+constexpr auto kChildExitDelay = std::chrono::milliseconds(2);
+
+using Exits = KeyedNotifyingGuardedValue<ExitQueue, pid_t>;
+
+struct Child {
+  pid_t pid;
+  std::uint64_t generation;
+  unique_fd pidfd;
+};
+
+// Stands in for the portal's SpawnExited message, along with the stub being collected.
+Task<> WatchChild(EvLoop* ev, Exits* exits, pid_t pid, int pidfd, pid_t group) {
+  std::optional<EvLoop::Events> events =
+      co_await ev->AwaitFd(pidfd, EvLoop::Events::Status::kRead);
+  ZYPAK_ASSERT(events && !events->empty());
+
+  siginfo_t info;
+  info.si_pid = 0;
+  ZYPAK_ASSERT_WITH_ERRNO(
+      syscall(SYS_waitid, P_PIDFD, pidfd, &info, WEXITED | WNOHANG, nullptr) == 0);
+  ZYPAK_ASSERT(info.si_pid == pid);
+
+  auto guard = exits->Acquire();
+  ZYPAK_ASSERT(guard->MarkExited(pid));
+  // Waits on the specific child and on its group, like HandleSpawnExited notifies them.
+  guard.Notify(pid);
+  guard.Notify(group);
+  guard.Notify(ExitQueue::kAnyGroup);
+}
+
+std::vector<Child> SpawnChildren(EvLoop* ev, Exits* exits, pid_t group) {
+  static std::uint64_t next_generation = 0;
+
+  std::vector<Child> children;
+  for (int i = 0; i < kChildCount; i++) {
+    pid_t pid = fork();
+    ZYPAK_ASSERT_WITH_ERRNO(pid != -1);
+    if (pid == 0) {
+      for (;;) {
+        pause();
+      }
+    }
+
+    std::optional<unique_fd> pidfd = Pidfd::Open(pid);
+    ZYPAK_ASSERT(pidfd);
+
+    Child& child = children.emplace_back(Child{pid, next_generation++, std::move(*pidfd)});
+    exits->Acquire()->Add(child.pid, child.generation, group);
+  }
+
+  for (const Child& child : children) {
+    ZYPAK_ASSERT(ev->AddTask([ev, exits, pid = child.pid, pidfd = child.pidfd.get(), group]() {
+      WatchChild(ev, exits, pid, pidfd, group).Detach();
+    }));
+  }
+
+  return children;
+}
+
+// Kills each child, then waits for it to exit before moving on to the next.
+void ShutDownSerially(Exits* exits, const std::vector<Child>& children) {
+  for (const Child& child : children) {
+    ZYPAK_ASSERT(Pidfd::SendSignal(child.pidfd.get(), SIGTERM));
+
+    auto guard = exits->AcquireWhen(child.pid, [&child](ExitQueue* exits) {
+      return exits->HasExited(child.pid, child.generation);
+    });
+    guard->DropExit(child.pid);
+    ZYPAK_ASSERT(guard->Remove(child.pid, child.generation));
+  }
+}
+
+// Kills every child at once, the way SendGroupSignal does, then takes the exits in the order they
+// come in.
+void ShutDownGroup(Exits* exits, const std::vector<Child>& children, pid_t group) {
+  for (const Child& child : children) {
+    ZYPAK_ASSERT(Pidfd::SendSignal(child.pidfd.get(), SIGTERM));
+  }
+
+  for (;;) {
+    auto guard = exits->AcquireWhen(group, [group](ExitQueue* exits) {
+      return exits->HasExits(group) || !exits->HasStubs(group);
+    });
+
+    std::optional<pid_t> next = guard->TakeNext(group);
+    if (!next) {
+      break;
+    }
+
+    auto it = std::find_if(children.begin(), children.end(),
+                           [&next](const Child& child) { return child.pid == *next; });
+    ZYPAK_ASSERT(it != children.end());
+    ZYPAK_ASSERT(guard->Remove(it->pid, it->generation));
+  }
+}
+
+void MeasureShutdown(EvLoop* ev, const char* name, bool group_kill) {
+  Exits exits;
+  pid_t group = getpgrp();
+  std::vector<double> times;
+
+  for (int round = 0; round < kRounds; round++) {
+    std::vector<Child> children = SpawnChildren(ev, &exits, group);
+
+    Clock::time_point start = Clock::now();
+    if (group_kill) {
+      ShutDownGroup(&exits, children, group);
+    } else {
+      ShutDownSerially(&exits, children);
+    }
+
+    times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    ZYPAK_ASSERT(exits.AcquireShared()->size() == 0);
+  }
+
+  std::sort(times.begin(), times.end());
+  Log() << "Shutting down " << kChildCount << " children (" << name << "): median "
+        << times[times.size() / 2] << "ms, best " << times.front() << "ms";
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("shutdown_perftest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  // The children inherit this.
+  struct sigaction action {};
+  action.sa_handler = [](int signal) {
+    std::this_thread::sleep_for(kChildExitDelay);
+    _exit(0);
+  };
+  ZYPAK_ASSERT_WITH_ERRNO(sigaction(SIGTERM, &action, nullptr) == 0);
+
+  std::unique_ptr<EvLoopThread> thread = EvLoopThread::Create("zypak-perf");
+  ZYPAK_ASSERT(thread);
+  thread->Start();
+
+  // Posting tasks doesn't need the loop's lock.
+  EvLoop* ev = thread->evloop()->unsafe();
+
+  MeasureShutdown(ev, "kill and wait on each", /*group_kill=*/false);
+  MeasureShutdown(ev, "group kill", /*group_kill=*/true);
+
+  thread->Shutdown();
+  return 0;
+}
@@ -6,7 +6,6 @@
 
 #include <nickle.h>
 
-#include "base/container_util.h"
 #include "base/debug.h"
 #include "base/fd_map.h"
 #include "base/socket.h"
@@ -15,11 +14,11 @@
 
 namespace zypak::preload {
 
-bool SpawnLauncherDelegate::Spawn(const Launcher::Helper& helper, std::vector<std::string> command,
-                                  const FdMap& fd_map, EnvMap env,
-                                  std::vector<std::string> exposed_paths,
+bool SpawnLauncherDelegate::Spawn(const Launcher::Helper& helper,
+                                  std::vector<cstring_view> command, const FdMap& fd_map,
+                                  EnvMap env, std::vector<std::string> exposed_paths,
                                   Launcher::Flags flags) /*override*/ {
-  ZYPAK_ASSERT(!was_called_);
+  ZYPAK_ASSERT(!spawn_);
 
   constexpr cstring_view kSpawnDirectory = "/";
 
@@ -28,14 +27,13 @@ bool SpawnLauncherDelegate::Spawn(const Launcher::Helper& helper, std::vector<st
 
   // Since we map the descriptors ourselves via the portal API, there's no need for zypak-helper to
   // adjust them as well.
-  ExtendContainerMove(&spawn.argv, helper.BuildCommandWrapper(FdMap()));
-  ExtendContainerMove(&spawn.argv, std::move(command));
+  wrapper_ = helper.BuildCommandWrapper(FdMap());
+  spawn.argv.reserve(wrapper_.size() + command.size());
+  spawn.argv.insert(spawn.argv.end(), wrapper_.begin(), wrapper_.end());
+  spawn.argv.insert(spawn.argv.end(), command.begin(), command.end());
 
   spawn.fds = &fd_map;
-
-  for (const auto& [var, value] : env) {
-    spawn.env.emplace(var, value);
-  }
+  spawn.env = std::move(env);
 
   for (const auto& path : exposed_paths) {
     spawn.options.ExposePathRo(path);
@@ -59,10 +57,13 @@ bool SpawnLauncherDelegate::Spawn(const Launcher::Helper& helper, std::vector<st
     spawn.flags |= dbus::FlatpakPortalProxy::SpawnFlags::kWatchBus;
   }
 
-  portal_->SpawnAsync(std::move(spawn), std::move(handler_));
-  was_called_ = true;
-
+  spawn_ = std::move(spawn);
   return true;
 }
 
+dbus::FlatpakPortalProxy::SpawnCall SpawnLauncherDelegate::TakeSpawnCall() {
+  ZYPAK_ASSERT(spawn_);
+  return std::move(*spawn_);
+}
+
 }  // namespace zypak::preload
@@ -4,25 +4,33 @@
 
 #pragma once
 
+#include <optional>
+
 #include "base/base.h"
 #include "base/launcher.h"
 #include "dbus/flatpak_portal_proxy.h"
 
 namespace zypak::preload {
 
+// A delegate that builds the portal call to spawn the command, without actually performing it. The
+// caller is responsible for sending the call, e.g. via FlatpakPortalProxy::AwaitSpawn.
 class SpawnLauncherDelegate : public Launcher::Delegate {
  public:
-  SpawnLauncherDelegate(dbus::FlatpakPortalProxy* portal,
-                        dbus::FlatpakPortalProxy::SpawnReplyHandler handler)
-      : portal_(portal), handler_(handler) {}
+  SpawnLauncherDelegate() {}
+
+  bool Spawn(const Launcher::Helper& helper, std::vector<cstring_view> command,
+             const FdMap& fd_map, EnvMap env, std::vector<std::string> exposed_paths,
+             Launcher::Flags flags) override;
 
-  bool Spawn(const Launcher::Helper& helper, std::vector<std::string> command, const FdMap& fd_map,
-             EnvMap env, std::vector<std::string> exposed_paths, Launcher::Flags flags) override;
+  // Returns the call built by Spawn, which must have been called first. Note that the call points
+  // to the FdMap and command that were passed to Spawn, as well as into this delegate, so all of
+  // them must outlive it.
+  dbus::FlatpakPortalProxy::SpawnCall TakeSpawnCall();
 
  private:
-  bool was_called_ = false;
-  dbus::FlatpakPortalProxy* portal_;
-  dbus::FlatpakPortalProxy::SpawnReplyHandler handler_;
+  // The zypak-helper command line that the command is wrapped with, which the call refers to.
+  std::vector<std::string> wrapper_;
+  std::optional<dbus::FlatpakPortalProxy::SpawnCall> spawn_;
 };
 
 }  // namespace zypak::preload
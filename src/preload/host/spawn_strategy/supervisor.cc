@@ -5,12 +5,20 @@
 
 #include "supervisor.h"
 
+#include <fcntl.h>
 #include <sys/signal.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
-#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
+#include "base/async_socket.h"
 #include "base/launcher.h"
+#include "base/pidfd.h"
+#include "base/process_usage.h"
 #include "base/singleton.h"
 #include "base/socket.h"
 #include "base/unique_fd.h"
@@ -24,6 +32,36 @@ namespace zypak::preload {
 
 using namespace supervisor_internal;
 
+namespace {
+
+// Includes the null terminator.
+constexpr size_t kSpawnRequestSize = sandbox::kZypakSupervisorSpawnRequest.size() + 1;
+constexpr size_t kMaxSpawnRequestsPerRead = 16;
+constexpr int kSpawnRequestTimeoutMs = 30 * 1000;
+// How often to check again on a stub that closed its connection but isn't a zombie yet.
+constexpr int kStubReapRetryMs = 10;
+// How often the resource usage of spawned processes is read. Anything a process does after the last
+// snapshot before it exits isn't reported, so this trades accuracy for overhead.
+constexpr int kUsageSnapshotIntervalMs = 1000;
+constexpr int kUsageSnapshotAccuracyMs = 250;
+
+// Wakes up all the waits whose targets include the given group, e.g. because they might not have
+// anything left to wait for.
+void NotifyExitWaiters(KeyedNotifyingGuard<ExitQueue, pid_t>* exits, pid_t group) {
+  exits->Notify(group);
+  exits->Notify(ExitQueue::kAnyGroup);
+}
+
+// Wakes up a single wait that can take an exit queued in the given group, preferring one on the
+// group itself, since waits on any group can take any other exit as well.
+void HandOffExit(KeyedNotifyingGuard<ExitQueue, pid_t>* exits, pid_t group) {
+  if (!exits->NotifyOne(group)) {
+    exits->NotifyOne(ExitQueue::kAnyGroup);
+  }
+}
+
+}  // namespace
+
 // static
 Supervisor* Supervisor::Acquire() {
   static Singleton<Supervisor> instance;
@@ -31,7 +69,9 @@ Supervisor* Supervisor::Acquire() {
 }
 
 bool Supervisor::InitAndAttachToBusThread(dbus::Bus* bus) {
-  auto request_pair = Socket::OpenSocketPair();
+  // Every stub shares this socket, so it has to keep each request in its own message, regardless of
+  // how many are written at once.
+  auto request_pair = Socket::OpenSocketPair(SOCK_SEQPACKET);
   if (!request_pair) {
     return false;
   }
@@ -50,9 +90,47 @@ bool Supervisor::InitAndAttachToBusThread(dbus::Bus* bus) {
 
   request_fd_ = std::move(supervisor_end);
 
-  bus->evloop()->Acquire()->AddFd(
-      request_fd_.get(), EvLoop::Events::Status::kRead,
-      std::bind(&Supervisor::HandleSpawnRequest, this, std::placeholders::_1));
+  Socket::ReadBatch::Options batch_options;
+  batch_options.max_fds = 1;
+  batch_options.receive_pid = true;
+  request_batch_.emplace(kMaxSpawnRequestsPerRead, kSpawnRequestSize, batch_options);
+
+  ingestion_thread_ = EvLoopThread::Create("zypak-ingest");
+  if (!ingestion_thread_) {
+    Log() << "Failed to create spawn request ingestion thread";
+    return false;
+  }
+
+  {
+    // New spawn requests are read on their own thread, so that a burst of them can't delay the
+    // started / exited signals that blocked waitpid calls are waiting on.
+    auto ev = ingestion_thread_->evloop()->Acquire();
+    auto source = ev->AddFd(request_fd_.get(), EvLoop::Events::Status::kRead,
+                            std::bind(&Supervisor::HandleSpawnRequest, this, std::placeholders::_1));
+    if (!source) {
+      Log() << "Failed to add supervisor fd to event loop";
+      return false;
+    }
+
+    source->SetDescription("supervisor-requests");
+
+    // Reading /proc is slow enough that it shouldn't hold up the bus thread either. The timer
+    // stays disabled until there are processes to read from.
+    EvLoop::TimerOptions usage_options;
+    usage_options.periodic = true;
+    usage_options.accuracy_ms = kUsageSnapshotAccuracyMs;
+    usage_timer_ = ev->AddTimerMs(
+        kUsageSnapshotIntervalMs,
+        std::bind(&Supervisor::SnapshotUsage, this, std::placeholders::_1), usage_options);
+    if (!usage_timer_) {
+      Log() << "Failed to add usage snapshot timer";
+      return false;
+    }
+
+    usage_timer_->source().SetDescription("supervisor-usage-snapshot");
+    usage_timer_->Disable();
+  }
+
   portal_.AttachToBus(bus);
 
   portal_.SubscribeToSpawnStarted(
@@ -60,15 +138,50 @@ bool Supervisor::InitAndAttachToBusThread(dbus::Bus* bus) {
   portal_.SubscribeToSpawnExited(
       std::bind(&Supervisor::HandleSpawnExited, this, std::placeholders::_1));
 
+  // Only start reading requests once everything they need is in place.
+  ingestion_thread_->Start();
   return true;
 }
 
-Supervisor::Result Supervisor::GetExitStatus(pid_t stub_pid, int* status) {
-  StubPidData* data = nullptr;
+void Supervisor::Shutdown() {
+  if (ingestion_thread_ == nullptr) {
+    return;
+  }
+
+  if (ingestion_thread_->IsRunning()) {
+    ingestion_thread_->Shutdown();
+  }
 
+  ingestion_thread_->evloop()->Acquire()->DumpStats();
+
+  // Anything still pending exited right before shutdown, or is stuck being unreapable.
+  if (std::size_t pending = pending_stub_zombies_.load()) {
+    Log() << "Stub zombies: " << pending << " pending, " << collected_stub_zombies_
+          << " collected";
+  } else {
+    Debug() << "Stub zombies: " << collected_stub_zombies_ << " collected";
+  }
+}
+
+void Supervisor::Pause() {
+  if (ingestion_thread_ != nullptr && ingestion_thread_->IsRunning()) {
+    ingestion_thread_->Shutdown();
+  }
+}
+
+void Supervisor::Resume() {
+  if (ingestion_thread_ != nullptr && !ingestion_thread_->IsRunning()) {
+    ingestion_thread_->Start();
+  }
+}
+
+Supervisor::Result Supervisor::GetExitStatus(pid_t stub_pid, int* status,
+                                             struct rusage* usage /*= nullptr*/) {
   {
-    auto stub_pids_data = stub_pids_data_.Acquire(GuardReleaseNotify::kAll);
-    data = FindStubPidData(StubPid(stub_pid), *stub_pids_data);
+    // Callers tend to poll this until the process exits, so only take the exclusive lock once
+    // there's something to take.
+    auto stub_pids_data = stub_pids_data_.AcquireShared();
+    const StubPidData* data = stub_pids_data->Find(stub_pid);
     if (data == nullptr) {
       Debug() << "Could not find stub pid data for " << stub_pid;
       return Result::kNotFound;
@@ -78,21 +191,37 @@ Supervisor::Result Supervisor::GetExitStatus(pid_t stub_pid, int* status) {
       Debug() << "Still running, try later for " << stub_pid;
       return Result::kTryLater;
     }
+  }
+
+  StubPidData reaped;
+
+  {
+    auto stub_pids_data = stub_pids_data_.Acquire();
+    StubPidData* data = FindStubPidData(StubPid(stub_pid), stub_pids_data.raw());
+    if (data == nullptr) {
+      // Someone else took the status in the meantime.
+      return Result::kNotFound;
+    }
 
-    stub_pids_data->erase(stub_pid);
+    reaped = std::move(*data);
+    stub_pids_data->Erase(stub_pid);
+    stub_pids_data.Notify(StubPid(stub_pid));
+    exits_.Acquire()->DropExit(stub_pid);
   }
 
-  ReapProcess(stub_pid, data, status);
+  ReapProcess(stub_pid, std::move(reaped), status, usage);
   return Result::kOk;
 }
 
-Supervisor::Result Supervisor::WaitForExitStatus(pid_t stub_pid, int* status) {
+Supervisor::Result Supervisor::WaitForExitStatus(pid_t stub_pid, int* status,
+                                                 struct rusage* usage /*= nullptr*/) {
   StubPidData* data = nullptr;
+  StubPidData reaped;
 
   {
-    auto stub_pids_data =
-        stub_pids_data_.AcquireWhen([this, stub_pid, &data](auto* stub_pids_data) {
-          data = FindStubPidData(StubPid(stub_pid), *stub_pids_data);
+    auto stub_pids_data = stub_pids_data_.AcquireWhen(
+        StubPid(stub_pid), [this, stub_pid, &data](auto* stub_pids_data) {
+          data = FindStubPidData(StubPid(stub_pid), stub_pids_data);
           return data == nullptr || data->exit_status.has_value();
         });
 
@@ -101,34 +230,194 @@ Supervisor::Result Supervisor::WaitForExitStatus(pid_t stub_pid, int* status) {
       return Result::kNotFound;
     }
 
-    stub_pids_data->erase(stub_pid);
+    reaped = std::move(*data);
+    stub_pids_data->Erase(stub_pid);
+    stub_pids_data.Notify(StubPid(stub_pid));
+    exits_.Acquire()->DropExit(stub_pid);
   }
 
-  ReapProcess(stub_pid, data, status);
+  ReapProcess(stub_pid, std::move(reaped), status, usage);
   return Result::kOk;
 }
 
 Supervisor::Result Supervisor::SendSignal(pid_t stub_pid, int signal) {
-  auto stub_pids_data = stub_pids_data_.Acquire(GuardReleaseNotify::kNone);
-  auto it = stub_pids_data->find(stub_pid);
-  if (it == stub_pids_data->end()) {
+  ExternalPid external = -1;
+  Result result;
+
+  {
+    auto stub_pids_data = stub_pids_data_.AcquireShared();
+    const StubPidData* data = stub_pids_data->Find(stub_pid);
+    if (data == nullptr) {
+      return Result::kNotFound;
+    }
+
+    result = DeliverSignalLocked(*data, signal, &external);
+  }
+
+  if (result == Result::kTryLater) {
+    result = QueueSignal(stub_pid, signal, &external);
+  }
+
+  // Neither the lock nor the caller is held up waiting for the portal, any failures are only
+  // logged.
+  if (external.pid != -1) {
+    SendSignalViaPortal(external, signal);
+  }
+
+  return result;
+}
+
+Supervisor::Result Supervisor::SendGroupSignal(pid_t pid, int signal) {
+  ZYPAK_ASSERT(pid <= 0);
+
+  pid_t target_group = pid == 0 ? getpgrp() : -pid;
+
+  std::vector<ExternalPid> portal_targets;
+  // The processes that haven't been spawned yet, whose signals need to be queued.
+  std::vector<StubPid> unspawned;
+  bool found = false;
+  bool failed = false;
+
+  {
+    auto stub_pids_data = stub_pids_data_.AcquireShared();
+    stub_pids_data->ForEach([&](pid_t stub, const StubPidData& data) {
+      if (data.exit_status.has_value()) {
+        return;
+      }
+
+      if (pid != -1 && data.group != target_group) {
+        return;
+      }
+
+      found = true;
+
+      ExternalPid external = -1;
+      switch (DeliverSignalLocked(data, signal, &external)) {
+      case Result::kOk:
+        break;
+      case Result::kTryLater:
+        unspawned.push_back(stub);
+        break;
+      default:
+        failed = true;
+      }
+
+      if (external.pid != -1) {
+        portal_targets.push_back(external);
+      }
+    });
+  }
+
+  for (StubPid stub : unspawned) {
+    ExternalPid external = -1;
+    // If the stub is gone by now, there's nothing left to signal.
+    if (QueueSignal(stub, signal, &external) == Result::kFailed) {
+      failed = true;
+    }
+
+    if (external.pid != -1) {
+      portal_targets.push_back(external);
+    }
+  }
+
+  Debug() << "Sending signal " << signal << " to " << portal_targets.size()
+          << " process(es) via the portal";
+
+  // These are all sent at once, rather than waiting on each reply in turn.
+  for (ExternalPid external : portal_targets) {
+    SendSignalViaPortal(external, signal);
+  }
+
+  if (!found) {
     return Result::kNotFound;
   }
 
-  if (std::optional<dbus::InvocationError> error = portal_.SpawnSignalBlocking(stub_pid, signal)) {
-    Log() << "Failed to call SpawnSignal(" << stub_pid << ',' << signal << "): " << *error;
-    return Result::kFailed;
+  return failed ? Result::kFailed : Result::kOk;
+}
+
+Supervisor::Result Supervisor::TakeNextExitStatus(pid_t pid, pid_t* stub_pid, int* status,
+                                                  std::chrono::milliseconds timeout,
+                                                  struct rusage* usage /*= nullptr*/) {
+  ZYPAK_ASSERT(pid <= 0);
+
+  pid_t target = pid == -1 ? ExitQueue::kAnyGroup : pid == 0 ? getpgrp() : -pid;
+
+  for (;;) {
+    StubPid stub = -1;
+
+    {
+      // Either an exit to take or the last targeted stub going away ends the wait.
+      auto exits = exits_.AcquireWhenOrTimeout(
+          target,
+          [target](ExitQueue* exits) {
+            return exits->HasExits(target) || !exits->HasStubs(target);
+          },
+          timeout);
+
+      std::optional<pid_t> next = exits->TakeNext(target);
+      if (!next) {
+        // Stubs whose statuses were already taken are still targeted until they're reaped, so the
+        // caller doesn't fall back to a wait that could reap one of them instead.
+        return exits->HasStubs(target) ? Result::kTryLater : Result::kNotFound;
+      }
+
+      stub = *next;
+
+      // The exit that was taken might not be the one this wait was woken for (e.g. a wait on any
+      // group takes whichever exit came first), so make sure whatever is left gets taken too.
+      // Anyone already woken is skipped, so this only wakes another wait if nobody else would
+      // take the rest.
+      exits->ForEachGroupWithExits([&exits](pid_t group) { HandOffExit(&exits, group); });
+    }
+
+    StubPidData reaped;
+
+    {
+      auto stub_pids_data = stub_pids_data_.Acquire();
+      StubPidData* data = FindStubPidData(stub, stub_pids_data.raw());
+      if (data == nullptr || !data->exit_status.has_value()) {
+        // Someone waiting on this specific stub got to it first.
+        continue;
+      }
+
+      reaped = std::move(*data);
+      stub_pids_data->Erase(stub.pid);
+      stub_pids_data.Notify(stub);
+    }
+
+    ReapProcess(stub, std::move(reaped), status, usage);
+    *stub_pid = stub.pid;
+    return Result::kOk;
   }
+}
 
-  return Result::kOk;
+bool Supervisor::ManagesStub(pid_t stub_pid) {
+  // Every stub with an entry in the table is tracked here as well, along with the stubs whose
+  // statuses were taken but that weren't reaped yet.
+  return exits_.AcquireShared()->Contains(stub_pid);
 }
 
 Supervisor::Result Supervisor::FindInternalPidBlocking(pid_t stub_pid, pid_t* internal_pid) {
+  {
+    // By the time anyone asks, the process has usually started already.
+    auto stub_pids_data = stub_pids_data_.AcquireShared();
+    const StubPidData* data = stub_pids_data->Find(stub_pid);
+    if (data == nullptr) {
+      return Result::kNotFound;
+    }
+
+    if (data->internal.pid != -1) {
+      *internal_pid = data->internal.pid;
+      return Result::kOk;
+    }
+  }
+
   StubPidData* data = nullptr;
-  auto stub_pids_data = stub_pids_data_.AcquireWhen([this, stub_pid, &data](auto* stub_pids_data) {
-    data = FindStubPidData(StubPid(stub_pid), *stub_pids_data);
-    return data == nullptr || data->internal.pid != -1;
-  });
+  auto stub_pids_data =
+      stub_pids_data_.AcquireWhen(StubPid(stub_pid), [this, stub_pid, &data](auto* stub_pids_data) {
+        data = FindStubPidData(StubPid(stub_pid), stub_pids_data);
+        return data == nullptr || data->internal.pid != -1;
+      });
 
   if (data == nullptr) {
     return Result::kNotFound;
@@ -139,152 +428,299 @@ Supervisor::Result Supervisor::FindInternalPidBlocking(pid_t stub_pid, pid_t* in
   return Result::kOk;
 }
 
-Supervisor::StubPidData*
-Supervisor::FindStubPidData(ExternalPid external,
-                            const std::unordered_map<StubPid, StubPidData>& stub_pids_data) {
-  auto it = external_to_stub_pids_.find(external);
-  if (it == external_to_stub_pids_.end()) {
+Supervisor::StubPidData* Supervisor::FindStubPidData(ExternalPid external,
+                                                     StubTable* stub_pids_data,
+                                                     StubPid* stub /*= nullptr*/) {
+  std::optional<pid_t> stub_pid = stub_pids_data->FindStubByExternal(external.pid);
+  if (!stub_pid) {
     Log() << "External pid " << external.pid << " has no associated stub PID";
     return nullptr;
   }
 
-  StubPidData* data = FindStubPidData(it->second, stub_pids_data);
-  ZYPAK_ASSERT(data != nullptr ? data->external.pid == external.pid : true);
+  StubPidData* data = FindStubPidData(StubPid(*stub_pid), stub_pids_data);
+  ZYPAK_ASSERT(data != nullptr && data->external.pid == external.pid);
+  if (stub != nullptr) {
+    *stub = *stub_pid;
+  }
+
   return data;
 }
 
-Supervisor::StubPidData*
-Supervisor::FindStubPidData(StubPid stub,
-                            const std::unordered_map<StubPid, StubPidData>& stub_pids_data) {
-  auto it = stub_pids_data.find(stub);
-  if (it == stub_pids_data.end()) {
+Supervisor::StubPidData* Supervisor::FindStubPidData(StubPid stub, StubTable* stub_pids_data) {
+  StubPidData* data = stub_pids_data->Find(stub.pid);
+  if (data == nullptr) {
     Debug() << "Can't find stub pid data " << stub.pid;
-    return nullptr;
   }
 
-  return const_cast<StubPidData*>(&it->second);
+  return data;
 }
 
-void Supervisor::ReapProcess(StubPid stub, StubPidData* data, int* status) {
-  Debug() << "Reaping " << stub.pid;
+void Supervisor::ReapProcess(StubPid stub, StubPidData data, int* status, struct rusage* usage) {
+  ZYPAK_ASSERT(data.exit_status.has_value());
+  if (status != nullptr) {
+    *status = data.exit_status.value();
+  }
 
-  ZYPAK_ASSERT(data->exit_status.has_value());
-  *status = data->exit_status.value();
+  if (usage != nullptr) {
+    *usage = data.usage.value_or(rusage{});
+  }
 
-  if (!Socket::Write(data->notify_exit.get(), sandbox::kZypakSupervisorExitReply)) {
-    Errno() << "Failed to let stub process " << stub.pid << " know of exit";
-    if (kill(stub.pid, SIGKILL) == -1) {
-      Errno() << "Failed to emergency kill " << stub.pid;
-    }
+  // The stub was already told about the exit back when it happened, so it's on its way out. If it's
+  // being watched, the bus thread collects it once it's gone, so there's no need to make the caller
+  // wait for that.
+  if (data.watched) {
+    Debug() << "Leaving " << stub.pid << " to be reaped by the bus thread";
+    return;
   }
 
+  Debug() << "Reaping " << stub.pid;
   if (HANDLE_EINTR(waitpid(stub.pid, nullptr, 0)) == -1) {
     Errno() << "Failed to wait for stub process " << stub.pid;
   }
+
+  ForgetStub(stub, data.generation);
 }
 
-void Supervisor::HandleSpawnStarted(dbus::FlatpakPortalProxy::SpawnStartedMessage message) {
-  auto stub_pids_data = stub_pids_data_.Acquire(GuardReleaseNotify::kAll);
-  StubPidData* data = FindStubPidData(ExternalPid(message.external_pid), *stub_pids_data);
-  if (data == nullptr) {
-    Log() << "SpawnStarted handler could not find stub pid data";
+void Supervisor::DropStubLocked(StubTableGuard* stub_pids_data, StubTable::Handle handle) {
+  if (!stub_pids_data->raw()->Erase(handle)) {
     return;
   }
 
-  Debug() << "Marking as started: " << message.external_pid << ' ' << message.internal_pid;
-  data->internal = message.internal_pid;
+  stub_pids_data->Notify(handle.stub);
+  ForgetStub(handle.stub, handle.generation);
+}
+
+void Supervisor::ForgetStub(StubPid stub, std::uint64_t generation) {
+  auto exits = exits_.Acquire();
+  if (std::optional<pid_t> group = exits->Remove(stub.pid, generation)) {
+    NotifyExitWaiters(&exits, *group);
+  }
+}
+
+Supervisor::Result Supervisor::DeliverSignalLocked(const StubPidData& data, int signal,
+                                                   ExternalPid* portal_target) {
+  if (!data.internal_pidfd.invalid()) {
+    // The process is directly reachable, so skip the portal entirely.
+    if (!Pidfd::SendSignal(data.internal_pidfd.get(), signal) && errno != ESRCH) {
+      return Result::kFailed;
+    }
+
+    return Result::kOk;
+  }
+
+  if (data.external.pid == -1) {
+    return Result::kTryLater;
+  }
+
+  *portal_target = data.external;
+  return Result::kOk;
+}
+
+Supervisor::Result Supervisor::QueueSignal(StubPid stub, int signal, ExternalPid* portal_target) {
+  auto stub_pids_data = stub_pids_data_.Acquire();
+  StubPidData* data = stub_pids_data->Find(stub.pid);
+  if (data == nullptr) {
+    return Result::kNotFound;
+  }
+
+  Result result = DeliverSignalLocked(*data, signal, portal_target);
+  if (result != Result::kTryLater) {
+    return result;
+  }
+
+  Debug() << "Queueing signal " << signal << " for " << stub.pid << " until it's spawned";
+  data->pending_signals.push_back(signal);
+  return Result::kOk;
+}
+
+void Supervisor::HandleSpawnStarted(dbus::FlatpakPortalProxy::SpawnStartedMessage message) {
+  // Since the pids are exposed, the process is visible from here, so signals can go to it
+  // directly. The pid is only trusted this once, instead of on every signal sent. Both of these go
+  // to procfs, so they're opened before taking the lock that every kill() needs.
+  std::optional<unique_fd> pidfd = Pidfd::Open(message.internal_pid);
+  std::optional<unique_fd> proc_dir = ProcessUsage::OpenProcDir(message.internal_pid);
+
+  {
+    auto stub_pids_data = stub_pids_data_.Acquire();
+    StubPid stub = -1;
+    StubPidData* data =
+        FindStubPidData(ExternalPid(message.external_pid), stub_pids_data.raw(), &stub);
+    if (data == nullptr) {
+      Log() << "SpawnStarted handler could not find stub pid data";
+      return;
+    }
+
+    Debug() << "Marking as started: " << message.external_pid << ' ' << message.internal_pid;
+    data->internal = message.internal_pid;
+    stub_pids_data.Notify(stub);
+
+    if (pidfd) {
+      data->internal_pidfd = std::move(*pidfd);
+    }
+
+    if (!proc_dir) {
+      return;
+    }
+
+    data->internal_proc_dir = std::move(*proc_dir);
+  }
+
+  ZYPAK_ASSERT(ingestion_thread_->evloop()->unsafe()->AddTask([this]() {
+    if (usage_timer_->state() == EvLoop::SourceRef::kDisabled) {
+      usage_timer_->RearmMs(kUsageSnapshotIntervalMs);
+    }
+  }));
 }
 
 void Supervisor::HandleSpawnExited(dbus::FlatpakPortalProxy::SpawnExitedMessage message) {
-  auto stub_pids_data = stub_pids_data_.Acquire(GuardReleaseNotify::kAll);
-  StubPidData* data = FindStubPidData(ExternalPid(message.external_pid), *stub_pids_data);
+  auto stub_pids_data = stub_pids_data_.Acquire();
+  StubPid stub = -1;
+  StubPidData* data =
+      FindStubPidData(ExternalPid(message.external_pid), stub_pids_data.raw(), &stub);
   if (data == nullptr) {
     Log() << "SpawnExited handler could not find stub pid data";
     return;
   }
 
   if (!Socket::Write(data->notify_exit.get(), sandbox::kZypakSupervisorExitReply)) {
+    // If the stub is already gone, there's nobody left to tell, but the exit still needs to be
+    // recorded for whoever waits on the stub.
+    bool stub_gone = errno == EPIPE || errno == ECONNRESET;
     Errno() << "Failed to let stub process know of exit";
-    return;
+    if (!stub_gone) {
+      return;
+    }
   }
 
   Debug() << "Marking as dead: " << message.external_pid;
   data->exit_status = message.exit_status;
+  stub_pids_data.Notify(stub);
+
+  // The process is most likely already gone, but if not, this is its final usage.
+  if (!data->internal_proc_dir.invalid()) {
+    if (std::optional<struct rusage> usage = ProcessUsage::Read(data->internal_proc_dir.get())) {
+      data->usage = usage;
+    }
+
+    data->internal_proc_dir.reset();
+  }
+
+  auto exits = exits_.Acquire();
+  if (exits->MarkExited(stub.pid)) {
+    HandOffExit(&exits, data->group);
+  }
 }
 
 void Supervisor::HandleSpawnRequest(EvLoop::SourceRef source) {
-  // Include the null terminator.
-  std::array<std::byte, sandbox::kZypakSupervisorSpawnRequest.size() + 1> buffer;
-  std::vector<unique_fd> fds;
-  pid_t stub_pid;
+  Debug() << "Ready to read spawn requests";
 
-  Debug() << "Ready to read spawn request";
+  // Requests tend to arrive in bursts (e.g. several renderers being started at once), so drain all
+  // of the pending ones now, instead of waking up the loop again for each one.
+  Socket::ReadManyOptions options;
+  options.nonblocking = true;
 
-  Socket::ReadOptions options;
-  options.fds = &fds;
-  options.pid = &stub_pid;
-  if (ssize_t bytes_read = Socket::Read(request_fd_.get(), &buffer, options); bytes_read == -1) {
-    Errno() << "Failed to read spawn request";
-    return;
-  }
+  for (;;) {
+    ssize_t count = Socket::ReadMany(request_fd_.get(), &*request_batch_, options);
+    if (count == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        Errno() << "Failed to read spawn requests";
+      }
+
+      return;
+    }
 
-  Debug() << "Read spawn request";
+    Debug() << "Read " << count << " spawn request(s)";
 
-  if (sandbox::kZypakSupervisorSpawnRequest != reinterpret_cast<const char*>(buffer.data())) {
-    Log() << "Invalid supervisor spawn request data";
+    for (ssize_t i = 0; i < count; i++) {
+      HandleSpawnRequestMessage(&request_batch_->message(i));
+    }
+
+    if (static_cast<size_t>(count) < request_batch_->capacity()) {
+      return;
+    }
+  }
+}
+
+void Supervisor::HandleSpawnRequestMessage(Socket::ReadBatch::Message* message) {
+  if (message->error != 0) {
+    Errno(message->error) << "Failed to read spawn request";
     return;
   }
 
-  if (fds.size() != 1) {
-    Log() << "Expected one of from supervisor client, got " << fds.size();
+  bool valid = message->size == kSpawnRequestSize &&
+               memcmp(message->data, sandbox::kZypakSupervisorSpawnRequest.c_str(),
+                      kSpawnRequestSize) == 0;
+  if (!valid) {
+    Log() << "Invalid supervisor spawn request data";
     return;
   }
 
-  unique_fd communication_fd = std::move(fds[0]);
-  if (!FulfillSpawnRequest(std::move(communication_fd), stub_pid)) {
-    Log() << "Failed to fulfill spawn request";
+  if (message->fds.size() != 1) {
+    Log() << "Expected one of from supervisor client, got " << message->fds.size();
     return;
   }
 
-  Debug() << "Starting as " << stub_pid;
-  auto stub_pids_data = stub_pids_data_.Acquire(GuardReleaseNotify::kNone);
-  auto it = stub_pids_data->emplace(stub_pid, StubPidData{}).first;
-  it->second.notify_exit = std::move(communication_fd);
+  FulfillSpawnRequest(std::move(message->fds[0]), message->pid).Detach();
 }
 
-bool Supervisor::FulfillSpawnRequest(unique_fd fd, pid_t stub_pid) {
-  std::array<std::byte, sandbox::kZypakSupervisorMaxMessageLength> target;
+Task<> Supervisor::FulfillSpawnRequest(unique_fd fd, pid_t stub_pid) {
+  // This only ever runs on the ingestion thread, either from HandleSpawnRequest or after being
+  // resumed by an event loop callback, so the loop is already locked.
+  EvLoop* ev = ingestion_thread_->evloop()->unsafe();
+
+  AsyncSocket socket(ev, std::move(fd));
+  std::vector<std::byte> header;
   std::vector<unique_fd> fds;
 
-  Socket::ReadOptions options;
-  options.fds = &fds;
-  ssize_t len = Socket::Read(fd.get(), &target, options);
-  if (len <= 0) {
-    if (len == 0) {
-      Log() << "No data could be read from supervisor client";
-    } else {
-      Errno() << "Failed to read message from supervisor client";
-    }
+  // Don't let a stub that never finishes its request keep its fds around forever.
+  AsyncSocket::OperationOptions read_options;
+  read_options.timeout_ms = kSpawnRequestTimeoutMs;
+  bool ok = co_await socket.ReadFramed(&header, &fds, {}, read_options);
+  if (!ok) {
+    Errno() << "Failed to read message from supervisor client";
+    co_return;
   }
 
-  nickle::buffers::ReadOnlyContainerBuffer buffer(target);
+  // The arguments are used in place from here on, all the way into the spawn call, so this must
+  // outlive it.
+  std::vector<std::byte> args_block;
+  std::vector<unique_fd> no_fds;
+
+  AsyncSocket::FramedReadOptions args_framed_options;
+  args_framed_options.max_fds = 0;
+  ok = co_await socket.ReadFramed(&args_block, &no_fds, args_framed_options, read_options);
+  if (!ok) {
+    Errno() << "Failed to read command from supervisor client";
+    co_return;
+  }
+
+  nickle::buffers::ReadOnlyContainerBuffer buffer(header);
   nickle::Reader reader(&buffer);
 
   std::uint64_t argc;
   if (!reader.Read<nickle::codecs::UInt64>(&argc)) {
     Log() << "Failed to read command size";
-    return false;
+    co_return;
   }
 
-  std::vector<std::string> argv;
-  for (std::uint64_t i = 0; i < argc; i++) {
-    std::string item;
-    if (!reader.Read<nickle::codecs::String>(&item)) {
-      Log() << "Failed to read comment argument #" << i;
-      return false;
-    }
+  if (args_block.empty() || args_block.back() != std::byte{0}) {
+    Log() << "Command is not null-terminated";
+    co_return;
+  }
+
+  std::vector<cstring_view> argv;
+  argv.reserve(std::min<std::uint64_t>(argc, args_block.size()));
+  // The block ends with a null terminator, so none of the arguments can run past it.
+  const char* args_end = reinterpret_cast<const char*>(args_block.data()) + args_block.size();
+  for (const char* arg = reinterpret_cast<const char*>(args_block.data()); arg != args_end;) {
+    cstring_view view(arg);
+    argv.push_back(view);
+    arg += view.size() + 1;
+  }
 
-    argv.push_back(std::move(item));
+  if (argv.size() != argc) {
+    Log() << "Expected " << argc << " command arguments, got " << argv.size();
+    co_return;
   }
 
   FdMap fd_map;
@@ -292,41 +728,300 @@ bool Supervisor::FulfillSpawnRequest(unique_fd fd, pid_t stub_pid) {
     std::uint32_t target_fd;
     if (!reader.Read<nickle::codecs::UInt32>(&target_fd)) {
       Log() << "Failed to read target fd #" << i;
-      return false;
+      co_return;
     }
 
     fd_map.push_back(FdAssignment(std::move(fds[i]), target_fd));
   }
 
-  SpawnLauncherDelegate delegate(
-      &portal_, std::bind(&Supervisor::HandleSpawnReply, this, stub_pid, std::placeholders::_1));
+  SpawnLauncherDelegate delegate;
   Launcher launcher(&delegate);
-  return launcher.Run(std::move(argv), fd_map);
+  if (!launcher.Run(std::move(argv), fd_map)) {
+    Log() << "Failed to fulfill spawn request";
+    co_return;
+  }
+
+  Debug() << "Starting as " << stub_pid;
+
+  pid_t group = getpgid(stub_pid);
+  if (group == -1) {
+    Errno() << "Failed to get process group of " << stub_pid;
+    group = 0;
+  }
+
+  // The stub opened the connection, so on newer kernels it can tell us its pidfd directly, which
+  // avoids even a brief window where the pid could refer to something else.
+  std::optional<unique_fd> pidfd = Socket::GetPeerPidfd(socket.fd());
+  if (!pidfd) {
+    pidfd = Pidfd::Open(stub_pid);
+  }
+
+  // Both a pidfd and the stub's connection become readable once the stub is gone, but the pidfd is
+  // exact, whereas the connection could have been passed on to another process.
+  unique_fd exit_fd;
+  bool exit_fd_is_pidfd = pidfd.has_value();
+  if (pidfd) {
+    exit_fd = std::move(*pidfd);
+  } else {
+    exit_fd = unique_fd(dup(socket.fd()));
+    if (exit_fd.invalid()) {
+      Errno() << "Failed to dup stub connection for " << stub_pid;
+    }
+  }
+
+  // The call holds its own copies of the fds and arguments, so neither the fd map nor the command
+  // need to outlive this.
+  dbus::MethodCall call = portal_.BuildSpawnMethodCall(delegate.TakeSpawnCall());
+
+  StubTable::Handle handle;
+
+  {
+    auto stub_pids_data = stub_pids_data_.Acquire();
+    handle = stub_pids_data->Insert(stub_pid);
+
+    StubPidData* data = stub_pids_data->Find(handle);
+    data->generation = handle.generation;
+    data->group = group;
+    data->notify_exit = socket.TakeFd();
+    data->watched = !exit_fd.invalid();
+
+    exits_.Acquire()->Add(stub_pid, handle.generation, group);
+  }
+
+  // Posting a task is thread-safe, and the bus thread runs them in order, so it acts as the queue
+  // of calls that are ready to be sent.
+  ZYPAK_ASSERT(portal_.bus()->evloop()->unsafe()->AddTask(
+      [this, handle, exit_fd = std::move(exit_fd), exit_fd_is_pidfd,
+       call = std::move(call)]() mutable {
+        SendSpawn(handle, std::move(exit_fd), exit_fd_is_pidfd, std::move(call)).Detach();
+      }));
+}
+
+Task<> Supervisor::SendSpawn(StubTable::Handle handle, unique_fd exit_fd, bool exit_fd_is_pidfd,
+                             dbus::MethodCall call) {
+  // This was started by a task posted to the bus thread, and the call's reply resumes it there too.
+  if (!exit_fd.invalid()) {
+    WatchStub(handle, std::move(exit_fd), exit_fd_is_pidfd).Detach();
+  }
+
+  std::optional<dbus::FlatpakPortalProxy::SpawnReply> reply =
+      co_await portal_.AwaitSpawn(std::move(call));
+  if (!reply) {
+    Log() << "Failed to parse Spawn reply for " << handle.stub;
+    auto stub_pids_data = stub_pids_data_.Acquire();
+    DropStubLocked(&stub_pids_data, handle);
+    co_return;
+  }
+
+  HandleSpawnReply(handle, std::move(*reply));
 }
 
-void Supervisor::HandleSpawnReply(pid_t stub_pid, dbus::FlatpakPortalProxy::SpawnReply reply) {
-  Debug() << "Got bus reply for " << stub_pid;
+void Supervisor::HandleSpawnReply(StubTable::Handle handle,
+                                  dbus::FlatpakPortalProxy::SpawnReply reply) {
+  Debug() << "Got bus reply for " << handle.stub;
+
+  auto stub_pids_data = stub_pids_data_.Acquire();
+  // The entry may have been removed (and even replaced by a new stub with the same pid) while the
+  // call was in flight.
+  StubPidData* data = stub_pids_data->Find(handle);
 
-  auto stub_pids_data = stub_pids_data_.Acquire(GuardReleaseNotify::kNone);
-  auto it = stub_pids_data->find(stub_pid);
+  if (data == nullptr) {
+    Log() << "Stub PID " << handle.stub << " has no data entry";
+
+    // The stub died while the call was in flight, so whatever it started is now orphaned.
+    if (std::uint32_t* external_pid = std::get_if<std::uint32_t>(&reply)) {
+      KillOrphanedProcess(handle.stub, *external_pid).Detach();
+    }
 
-  if (it == stub_pids_data->end()) {
-    Log() << "Stub PID " << stub_pid << " has no data entry";
     return;
   }
 
   if (dbus::InvocationError* error = std::get_if<dbus::InvocationError>(&reply)) {
     Log() << "Failed to call Spawn: " << *error;
-    stub_pids_data->erase(it);
+    DropStubLocked(&stub_pids_data, handle);
     return;
   }
 
   pid_t external_pid = std::get<std::uint32_t>(reply);
 
-  Debug() << "Initially spawned " << external_pid << " as " << stub_pid;
+  Debug() << "Initially spawned " << external_pid << " as " << handle.stub;
+
+  data->external = external_pid;
+  stub_pids_data->SetExternal(handle.stub, external_pid);
+
+  for (int signal : std::exchange(data->pending_signals, {})) {
+    SendSignalViaPortal(external_pid, signal);
+  }
+}
+
+void Supervisor::SnapshotUsage(EvLoop::SourceRef source) {
+  struct Snapshot {
+    StubTable::Handle handle;
+    unique_fd proc_dir;
+    std::optional<struct rusage> usage;
+  };
+
+  std::vector<Snapshot> snapshots;
+
+  {
+    // Only grab the directories here, so that nobody waits on the lock while /proc is read.
+    auto stub_pids_data = stub_pids_data_.AcquireShared();
+    stub_pids_data->ForEach([&](pid_t stub, const StubPidData& data) {
+      if (data.internal_proc_dir.invalid()) {
+        return;
+      }
+
+      int proc_dir = fcntl(data.internal_proc_dir.get(), F_DUPFD_CLOEXEC, 0);
+      if (proc_dir == -1) {
+        Errno() << "Failed to dup /proc directory of " << stub;
+        return;
+      }
+
+      snapshots.push_back({{stub, data.generation}, unique_fd(proc_dir)});
+    });
+  }
+
+  if (snapshots.empty()) {
+    // Re-armed by HandleSpawnStarted once there's something to read again.
+    usage_timer_->Disable();
+    return;
+  }
+
+  for (Snapshot& snapshot : snapshots) {
+    snapshot.usage = ProcessUsage::Read(snapshot.proc_dir.get());
+  }
+
+  auto stub_pids_data = stub_pids_data_.Acquire();
+  for (Snapshot& snapshot : snapshots) {
+    StubPidData* data = stub_pids_data->Find(snapshot.handle);
+    // If the directory was closed in the meantime, the process exited, and its final usage was
+    // already read.
+    if (data == nullptr || data->internal_proc_dir.invalid()) {
+      continue;
+    }
+
+    if (snapshot.usage) {
+      data->usage = snapshot.usage;
+    } else {
+      // The process is gone, so the last snapshot is as good as it'll get.
+      data->internal_proc_dir.reset();
+    }
+  }
+}
+
+void Supervisor::SendSignalViaPortal(ExternalPid external, int signal) {
+  portal_.SpawnSignalAsync(external.pid, signal,
+                           [external, signal](std::optional<dbus::InvocationError> error) {
+                             if (error) {
+                               Log() << "Failed to call SpawnSignal(" << external.pid << ','
+                                     << signal << "): " << *error;
+                             }
+                           });
+}
+
+Task<> Supervisor::WatchStub(StubTable::Handle handle, unique_fd exit_fd, bool exit_fd_is_pidfd) {
+  EvLoop* ev = portal_.bus()->evloop()->unsafe();
+  StubPid stub = handle.stub;
+
+  // The fd only becomes readable once the stub is gone (if it's the stub's connection, the source
+  // may also be dropped on hangup, giving an empty result).
+  co_await ev->AwaitFd(exit_fd.get(), EvLoop::Events::Status::kRead);
+
+  bool exited = false;
+  ExternalPid external = -1;
+
+  {
+    // SpawnExited marks the exit while holding the table, so it can't come in between.
+    auto stub_pids_data = stub_pids_data_.Acquire();
+    exited = exits_.AcquireShared()->HasExited(stub.pid, handle.generation);
+
+    if (!exited) {
+      StubPidData* data = stub_pids_data->Find(handle);
+      if (data == nullptr) {
+        // The spawn failed, so whoever waits on the stub is left to reap it.
+        co_return;
+      }
+
+      // Drop the stub's entry right away, so anyone waiting on it falls back to waiting on the stub
+      // itself and gets its real exit status. If the Spawn reply hasn't arrived yet,
+      // HandleSpawnReply will find the entry missing and kill the process then instead.
+      Log() << "Stub " << stub.pid << " exited before its process";
+      external = data->external;
+      DropStubLocked(&stub_pids_data, handle);
+    }
+  }
+
+  if (exited) {
+    // The stub was told about the exit and left normally, and its status isn't needed by anyone
+    // (the waitpid override reports the process's status instead). Until it's forgotten, nobody
+    // else will try to reap it.
+    pending_stub_zombies_++;
+    CollectStub(handle, exit_fd_is_pidfd ? std::move(exit_fd) : unique_fd());
+    co_return;
+  }
 
-  it->second.external = external_pid;
-  external_to_stub_pids_.emplace(external_pid, stub_pid);
+  if (external.pid != -1) {
+    co_await KillOrphanedProcess(stub, external);
+  }
+}
+
+void Supervisor::CollectStub(StubTable::Handle handle, unique_fd pidfd) {
+  StubPid stub = handle.stub;
+
+  // A pidfd is only readable once the stub is a zombie, so it can be reaped right away, but a
+  // closed connection only means that the stub is on its way out. Either way, never block the bus
+  // thread on it. This goes straight to the kernel, so that the wait overrides can't mistake it for
+  // the app waiting on the stub.
+  siginfo_t info;
+  info.si_pid = 0;
+  long result = -1;
+  if (!pidfd.invalid()) {
+    result = HANDLE_EINTR(
+        syscall(SYS_waitid, P_PIDFD, pidfd.get(), &info, WEXITED | WNOHANG, nullptr));
+  }
+  if (result == -1 && (pidfd.invalid() || errno == EINVAL)) {
+    // P_PIDFD is newer than pidfds themselves.
+    result =
+        HANDLE_EINTR(syscall(SYS_waitid, P_PID, stub.pid, &info, WEXITED | WNOHANG, nullptr));
+  }
+
+  if (result == -1) {
+    Errno() << "Failed to reap stub process " << stub.pid;
+  } else if (info.si_pid == 0) {
+    EvLoop* ev = portal_.bus()->evloop()->unsafe();
+    auto retry = ev->AddTimerMs(kStubReapRetryMs, [this, handle](EvLoop::SourceRef source) {
+      CollectStub(handle, unique_fd());
+    });
+    if (retry) {
+      retry->source().SetDescription("stub-reap-retry");
+      return;
+    }
+
+    // It stays counted as pending, since it really is.
+    Log() << "Failed to schedule another reap of stub " << stub.pid << ", leaving it as a zombie";
+    ForgetStub(stub, handle.generation);
+    return;
+  } else {
+    collected_stub_zombies_++;
+  }
+
+  pending_stub_zombies_--;
+  Debug() << "Done with stub " << stub.pid << ", stub zombies: " << pending_stub_zombies_
+          << " pending, " << collected_stub_zombies_ << " collected";
+  ForgetStub(stub, handle.generation);
+}
+
+Task<> Supervisor::KillOrphanedProcess(StubPid stub, ExternalPid external) {
+  // Nothing is left to forward signals to the process or to report its exit status, so kill it.
+  // The stub's entry is already gone by now, so the SpawnExited signal that follows finds nothing
+  // to complete and the exit is discarded; whoever waits on the stub gets the stub's own status.
+  Debug() << "Killing " << external.pid << ", orphaned by stub " << stub.pid;
+
+  std::optional<dbus::InvocationError> error =
+      co_await portal_.AwaitSpawnSignal(external.pid, SIGKILL);
+  if (error) {
+    Log() << "Failed to kill orphaned process " << external.pid << ": " << *error;
+  }
 }
 
 }  // namespace zypak::preload
@@ -5,17 +5,26 @@
 
 #pragma once
 
+#include <sys/resource.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <optional>
-#include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
 #include "base/base.h"
+#include "base/coroutine.h"
+#include "base/evloop_thread.h"
 #include "base/guarded_value.h"
+#include "base/socket.h"
 #include "base/strong_typedef.h"
 #include "dbus/bus.h"
 #include "dbus/flatpak_portal_proxy.h"
+#include "preload/host/spawn_strategy/exit_queue.h"
+#include "preload/host/spawn_strategy/process_table.h"
 #include "sandbox/spawn_strategy/supervisor_communication.h"
 
 namespace zypak::preload::supervisor_internal {
@@ -37,48 +46,133 @@ class Supervisor {
   static Supervisor* Acquire();
 
   bool InitAndAttachToBusThread(dbus::Bus* bus);
+  // Stops reading spawn requests for good. Must be called before the bus is shut down.
+  void Shutdown();
+
+  // Pauses and resumes the thread that reads spawn requests, for the same reasons as Bus::Pause.
+  void Pause();
+  void Resume();
 
   enum Result { kOk, kNotFound, kTryLater, kFailed };
 
-  Result GetExitStatus(pid_t stub_pid, int* status);
-  Result WaitForExitStatus(pid_t stub_pid, int* status);
+  // If usage is given, it's filled in with the process's last known resource usage, if any could
+  // be read, otherwise it's zeroed.
+  Result GetExitStatus(pid_t stub_pid, int* status, struct rusage* usage = nullptr);
+  Result WaitForExitStatus(pid_t stub_pid, int* status, struct rusage* usage = nullptr);
   Result SendSignal(pid_t stub_pid, int signal);
+  // Sends the signal to every tracked process whose stub is targeted by the given kill() pid,
+  // which must be <= 0 (i.e. the caller's process group, all processes, or a specific process
+  // group). Returns kNotFound if no process was targeted.
+  Result SendGroupSignal(pid_t pid, int signal);
+
+  // Takes the exit status of the next spawned process targeted by the given waitpid() pid, which
+  // must be <= 0, in the order the processes exited, waiting up to the timeout for one to exit.
+  // Returns kNotFound if no targeted process is tracked at all, and kTryLater if none have exited.
+  Result TakeNextExitStatus(pid_t pid, pid_t* stub_pid, int* status,
+                            std::chrono::milliseconds timeout, struct rusage* usage = nullptr);
+  // Returns true if the supervisor is in charge of the given stub, meaning that it must not be
+  // reaped by anyone else.
+  bool ManagesStub(pid_t stub_pid);
 
   Result FindInternalPidBlocking(pid_t stub_pid, pid_t* internal_pid);
 
  private:
   struct StubPidData {
+    // The generation of the stub's entry in the table.
+    std::uint64_t generation = 0;
+    // The stub's process group as of its spawn request, or 0 if it couldn't be found. The spawned
+    // processes live outside of any of our process groups, so the stubs' groups stand in for
+    // theirs.
+    pid_t group = 0;
     supervisor_internal::ExternalPid external = -1;
     supervisor_internal::InternalPid internal = -1;
     std::optional<std::uint32_t> exit_status;
     unique_fd notify_exit;
+    // Refers to the spawned process, once its internal pid is known and if it's reachable from here.
+    unique_fd internal_pidfd;
+    // The /proc directory of the spawned process, and the last resource usage read from it. The
+    // process is gone by the time anyone waits on it, so the usage has to be read ahead of time.
+    unique_fd internal_proc_dir;
+    std::optional<struct rusage> usage;
+    // Signals sent before the Spawn reply arrived, delivered once the external pid is known.
+    std::vector<int> pending_signals;
+    // Set if WatchStub is waiting for the stub to exit, in which case it also reaps the stub.
+    bool watched = false;
   };
 
-  StubPidData* FindStubPidData(
-      supervisor_internal::ExternalPid external,
-      const std::unordered_map<supervisor_internal::StubPid, StubPidData>& stub_pids_data);
-  StubPidData* FindStubPidData(
-      supervisor_internal::StubPid stub,
-      const std::unordered_map<supervisor_internal::StubPid, StubPidData>& stub_pids_data);
-
-  void ReapProcess(supervisor_internal::StubPid stub, StubPidData* data, int* status);
+  using StubTable = ProcessTable<StubPidData>;
+  using StubTableGuard = KeyedNotifyingGuard<StubTable, supervisor_internal::StubPid>;
+
+  // If found, the stub pid is stored in *stub.
+  StubPidData* FindStubPidData(supervisor_internal::ExternalPid external,
+                               StubTable* stub_pids_data,
+                               supervisor_internal::StubPid* stub = nullptr);
+  StubPidData* FindStubPidData(supervisor_internal::StubPid stub, StubTable* stub_pids_data);
+
+  void ReapProcess(supervisor_internal::StubPid stub, StubPidData data, int* status,
+                   struct rusage* usage);
+  // Removes the entry of a stub whose spawn failed or that exited before its process, leaving the
+  // stub itself to be reaped by whoever waits on it.
+  void DropStubLocked(StubTableGuard* stub_pids_data, StubTable::Handle handle);
+  // Stops tracking the stub in exits_, once it was reaped or left for someone else to reap.
+  void ForgetStub(supervisor_internal::StubPid stub, std::uint64_t generation);
+
+  // Must be called with stub_pids_data_ held, though only a shared lock is needed. If the signal
+  // has to go through the portal, the external pid is returned via portal_target, so the call can
+  // be made after releasing the lock. If the process wasn't spawned yet, kTryLater is returned,
+  // and the signal needs to be queued via QueueSignal instead.
+  Result DeliverSignalLocked(const StubPidData& data, int signal,
+                             supervisor_internal::ExternalPid* portal_target);
+  // Queues the signal until the stub's process is spawned, or delivers it like DeliverSignalLocked
+  // if that happened in the meantime. Acquires stub_pids_data_ exclusively.
+  Result QueueSignal(supervisor_internal::StubPid stub, int signal,
+                     supervisor_internal::ExternalPid* portal_target);
 
   void HandleSpawnStarted(dbus::FlatpakPortalProxy::SpawnStartedMessage message);
   void HandleSpawnExited(dbus::FlatpakPortalProxy::SpawnExitedMessage message);
 
   void HandleSpawnRequest(EvLoop::SourceRef source);
-  bool FulfillSpawnRequest(unique_fd fd, pid_t stub_pid);
-  void HandleSpawnReply(pid_t stub_pid, dbus::FlatpakPortalProxy::SpawnReply reply);
+  void HandleSpawnRequestMessage(Socket::ReadBatch::Message* message);
+  Task<> FulfillSpawnRequest(unique_fd fd, pid_t stub_pid);
+  Task<> SendSpawn(StubTable::Handle handle, unique_fd exit_fd, bool exit_fd_is_pidfd,
+                   dbus::MethodCall call);
+  void HandleSpawnReply(StubTable::Handle handle, dbus::FlatpakPortalProxy::SpawnReply reply);
+  void SendSignalViaPortal(supervisor_internal::ExternalPid external, int signal);
+  void SnapshotUsage(EvLoop::SourceRef source);
+  Task<> WatchStub(StubTable::Handle handle, unique_fd exit_fd, bool exit_fd_is_pidfd);
+  // Reaps a stub that was told about its exit, once it's a zombie, without blocking. The pidfd may
+  // be invalid, in which case the stub is found by its pid.
+  void CollectStub(StubTable::Handle handle, unique_fd pidfd);
+  Task<> KillOrphanedProcess(supervisor_internal::StubPid stub,
+                             supervisor_internal::ExternalPid external);
 
   unique_fd request_fd_;
+  // Only accessed by the ingestion thread, when reading from the request fd.
+  std::optional<Socket::ReadBatch> request_batch_;
+
+  // Reads spawn requests and builds the Spawn calls for them, so that none of that work holds up
+  // the bus thread, which only has to send the finished calls.
+  std::unique_ptr<EvLoopThread> ingestion_thread_;
+  // Runs SnapshotUsage on the ingestion thread, only enabled while any process's /proc directory
+  // is open. Only accessed by the ingestion thread once it's set up.
+  std::optional<EvLoop::TimerSourceRef> usage_timer_;
 
   dbus::FlatpakPortalProxy portal_;
 
-  // NOTE: This doesn't need to be guarded, because it's only ever accessed by the bus thread.
-  std::unordered_map<supervisor_internal::ExternalPid, supervisor_internal::StubPid>
-      external_to_stub_pids_;
-  NotifyingGuardedValue<std::unordered_map<supervisor_internal::StubPid, StubPidData>>
-      stub_pids_data_;
+  // Waiters are keyed by the stub they're waiting on, so a change to one process only wakes the
+  // threads waiting on it.
+  KeyedNotifyingGuardedValue<StubTable, supervisor_internal::StubPid> stub_pids_data_;
+  // Every stub that's managed here, along with the exits that waits on any child or on a group can
+  // take. Waiters are keyed by the group they target (or ExitQueue::kAnyGroup). Each exit wakes a
+  // single waiter that can take it, while a stub going away wakes every waiter on its group and on
+  // any group, since they might have nothing left to wait for. Always acquired after
+  // stub_pids_data_ when both are needed.
+  KeyedNotifyingGuardedValue<ExitQueue, pid_t> exits_;
+
+  // Stubs that are done but still need to be reaped by CollectStub, and the # that were. Only
+  // changed on the bus thread.
+  std::atomic<std::size_t> pending_stub_zombies_ = 0;
+  std::atomic<std::size_t> collected_stub_zombies_ = 0;
 };
 
 }  // namespace zypak::preload
@@ -153,7 +153,8 @@ std::optional<pid_t> HandleFork(nickle::Reader* reader, const unique_fd& sandbox
   MimicLauncherDelegate launcher_delegate(std::move(pid_oracle), &child);
   Launcher launcher(&launcher_delegate);
 
-  if (!launcher.Run(std::move(args), fd_map)) {
+  std::vector<cstring_view> command(args.begin(), args.end());
+  if (!launcher.Run(std::move(command), fd_map)) {
     return {};
   }
 
@@ -14,9 +14,9 @@
 
 namespace zypak::sandbox::mimic_strategy {
 
-bool MimicLauncherDelegate::Spawn(const Launcher::Helper& helper, std::vector<std::string> command,
-                                  const FdMap& fd_map, EnvMap env,
-                                  std::vector<std::string> exposed_paths,
+bool MimicLauncherDelegate::Spawn(const Launcher::Helper& helper,
+                                  std::vector<cstring_view> command, const FdMap& fd_map,
+                                  EnvMap env, std::vector<std::string> exposed_paths,
                                   Launcher::Flags flags) /*override*/ {
   std::vector<std::string> spawn_command;
   spawn_command.push_back("flatpak-spawn");
@@ -47,7 +47,9 @@ bool MimicLauncherDelegate::Spawn(const Launcher::Helper& helper, std::vector<st
   }
 
   ExtendContainerMove(&spawn_command, helper.BuildCommandWrapper(fd_map));
-  ExtendContainerMove(&spawn_command, std::move(command));
+  for (cstring_view arg : command) {
+    spawn_command.push_back(arg.ToOwned());
+  }
 
   pid_t child = fork();
   if (child == -1) {
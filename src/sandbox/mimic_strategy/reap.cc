@@ -19,7 +19,13 @@ class ReapTimerHandler {
 
   void AddToLoop() {
     constexpr int kSecondsToWaitForDeath = 2;
-    ZYPAK_ASSERT(ev_->AddTimerSec(kSecondsToWaitForDeath, *this));
+
+    // Keep retrying until the child is reaped, using a single timer throughout.
+    EvLoop::TimerOptions options;
+    options.periodic = true;
+    auto source = ev_->AddTimerSec(kSecondsToWaitForDeath, *this, options);
+    ZYPAK_ASSERT(source);
+    source->source().SetDescription("reap-timer");
   }
 
   void operator()(EvLoop::SourceRef source) {
@@ -27,7 +33,7 @@ class ReapTimerHandler {
     if (wret > 0) {
       // XXX: in original code this was a logged error, but can this really occur?
       ZYPAK_ASSERT(wret == child_pid_);
-      // Return before the timer is re-added.
+      source.Disable();
       return;
     }
 
@@ -38,7 +44,6 @@ class ReapTimerHandler {
     }
 
     sent_sigkill_ = true;
-    AddToLoop();
   }
 
  private:
@@ -6,6 +6,7 @@
 #include "sandbox/mimic_strategy/zygote.h"
 
 #include <array>
+#include <functional>
 
 #include <nickle.h>
 
@@ -117,6 +118,8 @@ bool MimicZygoteRunner::Run() {
       return false;
     }
 
+    zygote_host_ref->SetDescription("zygote-host");
+
     Debug() << "Going to run main loop";
     zygote_host_ref->AddDestroyHandler([this]() {
       Log() << "Host is gone, preparing to exit...";
@@ -129,8 +132,6 @@ bool MimicZygoteRunner::Run() {
     case EvLoop::WaitResult::kError:
       Log() << "Wait error, aborting mimic Zygote...";
       return false;
-    case EvLoop::WaitResult::kIdle:
-      continue;
     case EvLoop::WaitResult::kReady:
       break;
     }
@@ -141,6 +142,7 @@ bool MimicZygoteRunner::Run() {
       return false;
     case EvLoop::DispatchResult::kExit:
       Log() << "Quitting Zygote...";
+      ev_.DumpStats();
       return ev_.exit_status() == EvLoop::ExitStatus::kSuccess;
     case EvLoop::DispatchResult::kContinue:
       continue;
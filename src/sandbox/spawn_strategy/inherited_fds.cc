@@ -0,0 +1,80 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sandbox/spawn_strategy/inherited_fds.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <charconv>
+#include <string_view>
+
+#include "base/debug.h"
+#include "base/unique_fd.h"
+#include "sandbox/spawn_strategy/supervisor_communication.h"
+
+namespace zypak::sandbox::spawn_strategy {
+
+namespace {
+
+constexpr size_t kDirentBufferSize = 4096;
+
+}  // namespace
+
+// This is on the critical path of every process launch, so the directory is read via getdents64
+// directly (without readdir's allocations), and nothing is dup'd: the FDs are sent to the
+// supervisor as-is.
+std::optional<std::vector<int>> FindInheritedFds() {
+  unique_fd fd_dir(open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+  if (fd_dir.invalid()) {
+    Errno() << "Failed to open /proc/self/fd";
+    return {};
+  }
+
+  std::vector<int> fds;
+
+  alignas(struct dirent64) std::array<std::byte, kDirentBufferSize> buffer;
+  for (;;) {
+    long len = HANDLE_EINTR(syscall(SYS_getdents64, fd_dir.get(), buffer.data(), buffer.size()));
+    if (len == -1) {
+      Errno() << "Failed to read /proc/self/fd";
+      return {};
+    } else if (len == 0) {
+      break;
+    }
+
+    for (long offset = 0; offset < len;) {
+      auto* entry = reinterpret_cast<struct dirent64*>(buffer.data() + offset);
+      offset += entry->d_reclen;
+
+      std::string_view name(entry->d_name);
+      int fd = -1;
+      auto [end, ec] = std::from_chars(name.data(), name.data() + name.size(), fd);
+      if (ec != std::errc() || end != name.data() + name.size()) {
+        // This is "." or "..".
+        continue;
+      }
+
+      if (fd == fd_dir.get() || fd == kZypakSupervisorFd) {
+        continue;
+      }
+
+      // Anything that's close-on-exec was opened by us, rather than being inherited from whoever
+      // ran zypak-sandbox, so the target process wouldn't have gotten it either.
+      int flags = fcntl(fd, F_GETFD);
+      if (flags == -1 || (flags & FD_CLOEXEC)) {
+        continue;
+      }
+
+      fds.push_back(fd);
+    }
+  }
+
+  return std::move(fds);
+}
+
+}  // namespace zypak::sandbox::spawn_strategy
@@ -0,0 +1,19 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include "base/base.h"
+
+namespace zypak::sandbox::spawn_strategy {
+
+// Finds every FD that should be forwarded to the spawned process, i.e. all of the ones inherited
+// from whoever ran zypak-sandbox, except for the supervisor's. Returns an empty optional on
+// failure.
+std::optional<std::vector<int>> FindInheritedFds();
+
+}  // namespace zypak::sandbox::spawn_strategy
@@ -0,0 +1,99 @@
+// Copyright 2026 Ryan Gonzalez
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Times the scan zypak-sandbox does of its inherited FDs before every spawn request, with 10, 100,
+// and 1000 FDs open. Close-on-exec FDs are opened alongside them, to make sure they're both skipped
+// and accounted for in the cost.
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <vector>
+
+#include "base/debug.h"
+#include "base/unique_fd.h"
+#include "sandbox/spawn_strategy/inherited_fds.h"
+
+using namespace zypak;
+using namespace zypak::sandbox::spawn_strategy;
+
+namespace {
+
+constexpr size_t kFdCounts[] = {10, 100, 1000};
+// One close-on-exec FD for every this many inherited ones.
+constexpr size_t kInheritedPerCloexec = 4;
+constexpr auto kMinDurationPerCount = std::chrono::milliseconds(500);
+
+bool RaiseFdLimit(size_t needed) {
+  struct rlimit limit;
+  ZYPAK_ASSERT_WITH_ERRNO(getrlimit(RLIMIT_NOFILE, &limit) != -1);
+  limit.rlim_cur = limit.rlim_max;
+  ZYPAK_ASSERT_WITH_ERRNO(setrlimit(RLIMIT_NOFILE, &limit) != -1);
+  return limit.rlim_cur >= needed;
+}
+
+void MeasureScan(size_t count) {
+  unique_fd null_fd(open("/dev/null", O_RDONLY | O_CLOEXEC));
+  ZYPAK_ASSERT_WITH_ERRNO(!null_fd.invalid());
+
+  std::vector<unique_fd> inherited;
+  std::vector<unique_fd> cloexec;
+  for (size_t i = 0; i < count; i++) {
+    inherited.emplace_back(fcntl(null_fd.get(), F_DUPFD, 0));
+    ZYPAK_ASSERT_WITH_ERRNO(!inherited.back().invalid());
+
+    if (i % kInheritedPerCloexec == 0) {
+      cloexec.emplace_back(fcntl(null_fd.get(), F_DUPFD_CLOEXEC, 0));
+      ZYPAK_ASSERT_WITH_ERRNO(!cloexec.back().invalid());
+    }
+  }
+
+  // Everything opened above must be found, along with whatever this process inherited itself.
+  std::optional<std::vector<int>> found = FindInheritedFds();
+  ZYPAK_ASSERT(found);
+  for (const unique_fd& fd : inherited) {
+    ZYPAK_ASSERT(std::find(found->begin(), found->end(), fd.get()) != found->end(),
+                 << "missing FD " << fd.get());
+  }
+  for (const unique_fd& fd : cloexec) {
+    ZYPAK_ASSERT(std::find(found->begin(), found->end(), fd.get()) == found->end(),
+                 << "found close-on-exec FD " << fd.get());
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = std::chrono::steady_clock::duration::zero();
+  int scans = 0;
+  do {
+    found = FindInheritedFds();
+    ZYPAK_ASSERT(found);
+    scans++;
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed < kMinDurationPerCount);
+
+  Log() << count << " inherited FDs (" << found->size() << " found, " << cloexec.size()
+        << " close-on-exec skipped): "
+        << std::chrono::duration<double, std::micro>(elapsed).count() / scans << "us per scan";
+}
+
+}  // namespace
+
+int main() {
+  DebugContext::instance()->set_name("inherited_fds_perftest");
+  DebugContext::instance()->LoadFromEnvironment();
+
+  for (size_t count : kFdCounts) {
+    if (!RaiseFdLimit(count * 2)) {
+      Log() << "Skipping " << count << " FDs, the FD limit is too low";
+      continue;
+    }
+
+    MeasureScan(count);
+  }
+
+  return 0;
+}
@@ -4,72 +4,25 @@
 
 #include "run.h"
 
-#include <dirent.h>
 #include <sys/prctl.h>
 #include <sys/signal.h>
+#include <unistd.h>
 
-#include <memory>
+#include <array>
 #include <string>
 #include <vector>
 
 #include "base/debug.h"
-#include "base/fd_map.h"
-#include "base/launcher.h"
 #include "base/socket.h"
 #include "base/unique_fd.h"
 #include "nickle.h"
+#include "sandbox/spawn_strategy/inherited_fds.h"
 #include "sandbox/spawn_strategy/supervisor_communication.h"
 
 namespace zypak::sandbox::spawn_strategy {
 
 namespace {
 
-struct DirDeleter {
-  void operator()(DIR* dir) {
-    if (dir != nullptr) {
-      closedir(dir);
-    }
-  }
-};
-
-std::optional<FdMap> FindAllFds() {
-  std::unique_ptr<DIR, DirDeleter> fd_dir(opendir("/proc/self/fd"));
-  if (!fd_dir) {
-    Errno() << "Failed to open /proc/self/fd";
-    return {};
-  }
-
-  std::vector<int> fds;
-
-  struct dirent* dp;
-  while ((dp = readdir(fd_dir.get())) != nullptr) {
-    int fd = -1;
-    try {
-      fd = std::stoi(dp->d_name);
-    } catch (std::exception& ex) {
-      Debug() << "Ignoring /proc/self/fd/" << dp->d_name << ": " << ex.what();
-    }
-
-    // Do nothing if the FD was invalid or one we don't want to forward.
-    if (fd != -1 && fd != dirfd(fd_dir.get()) && fd != kZypakSupervisorFd) {
-      fds.push_back(fd);
-    }
-  }
-
-  FdMap fd_map;
-  for (int fd : fds) {
-    unique_fd copy(dup(fd));
-    if (copy.invalid()) {
-      Errno() << "Failed to dup " << fd;
-      return {};
-    }
-
-    fd_map.push_back(FdAssignment(std::move(copy), fd));
-  }
-
-  return std::move(fd_map);
-}
-
 std::optional<unique_fd> OpenSpawnRequest() {
   auto sockets = Socket::OpenSocketPair();
   if (!sockets) {
@@ -92,25 +45,36 @@ std::optional<unique_fd> OpenSpawnRequest() {
   return std::move(our_end);
 }
 
-bool SendSpawnRequest(int request_pipe, const std::vector<std::string>& args, const FdMap& fd_map) {
-  std::vector<std::byte> target;
-  nickle::buffers::ContainerBuffer buffer(&target);
+bool SendSpawnRequest(int request_pipe, const std::vector<std::string>& args,
+                      const std::vector<int>& fds) {
+  std::vector<std::byte> header;
+  nickle::buffers::ContainerBuffer buffer(&header);
   nickle::Writer writer(&buffer);
 
   ZYPAK_ASSERT(writer.Write<nickle::codecs::UInt64>(args.size()));
+
+  // Every FD keeps the same number in the target process.
+  for (int fd : fds) {
+    ZYPAK_ASSERT(writer.Write<nickle::codecs::UInt32>(fd));
+  }
+
+  size_t args_size = 0;
   for (const std::string& arg : args) {
-    ZYPAK_ASSERT(writer.Write<nickle::codecs::String>(arg));
+    args_size += arg.size() + 1;
   }
 
-  std::vector<int> fds;
-  for (const FdAssignment& assignment : fd_map) {
-    fds.push_back(assignment.fd().get());
-    ZYPAK_ASSERT(writer.Write<nickle::codecs::UInt32>(assignment.target()));
+  std::vector<std::byte> args_block;
+  args_block.reserve(args_size);
+  for (const std::string& arg : args) {
+    const std::byte* data = reinterpret_cast<const std::byte*>(arg.c_str());
+    // +1 to include the null terminator.
+    args_block.insert(args_block.end(), data, data + arg.size() + 1);
   }
 
-  Socket::WriteOptions options;
-  options.fds = &fds;
-  if (!Socket::Write(request_pipe, target, options)) {
+  // The FD list and command line can both get rather large, so these are sent as frames instead of
+  // single messages.
+  if (!Socket::WriteFramed(request_pipe, header, fds) ||
+      !Socket::WriteFramed(request_pipe, args_block, {})) {
     Errno() << "Failed to write spawn request data";
     return false;
   }
@@ -142,8 +106,8 @@ bool RunSpawnStrategy(std::vector<std::string> args) {
     Errno() << "Warning: prctl(PDEATHSIG) failed";
   }
 
-  std::optional<FdMap> fd_map = FindAllFds();
-  if (!fd_map) {
+  std::optional<std::vector<int>> fds = FindInheritedFds();
+  if (!fds) {
     return false;
   }
 
@@ -152,7 +116,7 @@ bool RunSpawnStrategy(std::vector<std::string> args) {
     return false;
   }
 
-  return SendSpawnRequest(request_pipe->get(), args, *fd_map) && ReadExitReply(request_pipe->get());
+  return SendSpawnRequest(request_pipe->get(), args, *fds) && ReadExitReply(request_pipe->get());
 }
 
 }  // namespace zypak::sandbox::spawn_strategy
@@ -10,8 +10,11 @@
 
 namespace zypak::sandbox {
 
+// A SOCK_SEQPACKET socket shared by all the stubs, each sending a spawn request message along with
+// the fd of a new connection that the rest of the request goes through. That consists of two
+// frames: first the argument count and the target of every fd, with the fds themselves attached,
+// then every argument followed by a null terminator, so the supervisor can use them in place.
 ATTR_NO_WARN_UNUSED constexpr int kZypakSupervisorFd = 235;
-ATTR_NO_WARN_UNUSED constexpr int kZypakSupervisorMaxMessageLength = 16 * 1024;
 ATTR_NO_WARN_UNUSED constexpr cstring_view kZypakSupervisorSpawnRequest = "SPAWN";
 ATTR_NO_WARN_UNUSED constexpr cstring_view kZypakSupervisorExitReply = "EXIT";
 